@@ -0,0 +1,551 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Assembler_h_
+#define _Assembler_h_
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "Jit.h"
+
+#ifdef TVM_JIT
+
+enum HostRegister
+{
+    RAX = 0,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+enum ConditionCode
+{
+    CC_E  = 0x4,
+    CC_NE = 0x5,
+    CC_A  = 0x7,
+    CC_L  = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,
+    CC_G  = 0xF,
+};
+
+// The condition that makes a b* instruction take its branch
+// when the host flags come from 'cmp lhs, rhs'.
+inline int BranchCondition(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_JEQ:
+        return CC_E;
+    case OP_JNE:
+        return CC_NE;
+    case OP_JLT:
+        return CC_L;
+    case OP_JGT:
+        return CC_G;
+    case OP_JLE:
+        return CC_LE;
+    case OP_JGE:
+    default:
+        return CC_GE;
+    }
+}
+
+#define RT_OFFSET(x) ((int32_t)offsetof(JitRuntime, x))
+#define REG_OFFSET(x) ((int32_t)(sizeof(Register) * (x)))
+
+// Minimal x86-64 emitter shared by the function and trace compilers.
+class Assembler
+{
+public:
+    typedef size_t Label;
+
+private:
+    struct Fixup
+    {
+        size_t at;
+        Label  label;
+    };
+
+    typedef std::vector<Fixup> Fixups;
+
+    std::vector<uint8_t> m_buf;
+    std::vector<size_t>  m_labels;
+    Fixups               m_fixups;
+
+    void rex(bool w, int reg, int base, bool force = false)
+    {
+        uint8_t b = 0x40;
+        if (w)
+            b |= 0x08;
+        if (reg & 8)
+            b |= 0x04;
+        if (base & 8)
+            b |= 0x01;
+        if (b != 0x40 || force)
+            byte(b);
+    }
+
+    void modrm(int reg, int rm)
+    {
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void mem(int reg, int base, int32_t disp)
+    {
+        uint8_t mod;
+        if (disp == 0 && (base & 7) != RBP)
+            mod = 0;
+        else if (disp >= -128 && disp <= 127)
+            mod = 1;
+        else
+            mod = 2;
+
+        byte((mod << 6) | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP)
+            byte(0x24);
+
+        if (mod == 1)
+            byte((uint8_t)disp);
+        else if (mod == 2)
+            dword((uint32_t)disp);
+    }
+
+    void rel32(Label label)
+    {
+        Fixup fix = {m_buf.size(), label};
+        m_fixups.push_back(fix);
+        dword(0);
+    }
+
+public:
+    inline size_t size(void) const
+    {
+        return m_buf.size();
+    }
+
+    inline const uint8_t* data(void) const
+    {
+        return m_buf.data();
+    }
+
+    Label label(void)
+    {
+        m_labels.push_back(-1);
+        return m_labels.size() - 1;
+    }
+
+    void bind(Label label)
+    {
+        m_labels[label] = m_buf.size();
+    }
+
+    size_t offset(Label label) const
+    {
+        return m_labels[label];
+    }
+
+    bool resolve(void)
+    {
+        Fixups::iterator it = m_fixups.begin();
+        while (it != m_fixups.end())
+        {
+            const Fixup& fix = (*it++);
+
+            size_t dest = m_labels[fix.label];
+            if (dest == (size_t)-1)
+                return false;
+
+            int32_t rel = (int32_t)((int64_t)dest - (int64_t)(fix.at + 4));
+            memcpy(&m_buf[fix.at], &rel, 4);
+        }
+        m_fixups.clear();
+        return true;
+    }
+
+    void byte(uint8_t v)
+    {
+        m_buf.push_back(v);
+    }
+
+    void dword(uint32_t v)
+    {
+        const uint8_t* p = (const uint8_t*)&v;
+        m_buf.insert(m_buf.end(), p, p + 4);
+    }
+
+    void qword(uint64_t v)
+    {
+        const uint8_t* p = (const uint8_t*)&v;
+        m_buf.insert(m_buf.end(), p, p + 8);
+    }
+
+    void push(int r)
+    {
+        rex(false, 0, r);
+        byte(0x50 + (r & 7));
+    }
+
+    void pop(int r)
+    {
+        rex(false, 0, r);
+        byte(0x58 + (r & 7));
+    }
+
+    void ret(void)
+    {
+        byte(0xC3);
+    }
+
+    void load64(int dst, int base, int32_t disp)
+    {
+        rex(true, dst, base);
+        byte(0x8B);
+        mem(dst, base, disp);
+    }
+
+    void store64(int base, int32_t disp, int src)
+    {
+        rex(true, src, base);
+        byte(0x89);
+        mem(src, base, disp);
+    }
+
+    void store32(int base, int32_t disp, int src)
+    {
+        rex(false, src, base);
+        byte(0x89);
+        mem(src, base, disp);
+    }
+
+    void store16(int base, int32_t disp, int src)
+    {
+        byte(0x66);
+        rex(false, src, base);
+        byte(0x89);
+        mem(src, base, disp);
+    }
+
+    void store8(int base, int32_t disp, int src)
+    {
+        rex(false, src, base, src >= RSP);
+        byte(0x88);
+        mem(src, base, disp);
+    }
+
+    void store32i(int base, int32_t disp, uint32_t imm)
+    {
+        rex(false, 0, base);
+        byte(0xC7);
+        mem(0, base, disp);
+        dword(imm);
+    }
+
+    void movzx16(int dst, int base, int32_t disp)
+    {
+        rex(false, dst, base);
+        byte(0x0F);
+        byte(0xB7);
+        mem(dst, base, disp);
+    }
+
+    void movzx8(int dst, int src)
+    {
+        rex(false, dst, src, src >= RSP);
+        byte(0x0F);
+        byte(0xB6);
+        modrm(dst, src);
+    }
+
+    void movi(int dst, uint64_t imm)
+    {
+        if (imm <= 0xFFFFFFFF)
+        {
+            rex(false, 0, dst);
+            byte(0xB8 + (dst & 7));
+            dword((uint32_t)imm);
+        }
+        else
+        {
+            rex(true, 0, dst);
+            byte(0xB8 + (dst & 7));
+            qword(imm);
+        }
+    }
+
+    void mov(int dst, int src)
+    {
+        rex(true, src, dst);
+        byte(0x89);
+        modrm(src, dst);
+    }
+
+    // add, sub, cmp, test, xor in the form 'op dst, src'
+    void alu(uint8_t opc, int dst, int src)
+    {
+        rex(true, src, dst);
+        byte(opc);
+        modrm(src, dst);
+    }
+
+    void add(int dst, int src)
+    {
+        alu(0x01, dst, src);
+    }
+
+    void sub(int dst, int src)
+    {
+        alu(0x29, dst, src);
+    }
+
+    void cmp(int dst, int src)
+    {
+        alu(0x39, dst, src);
+    }
+
+    void test(int dst, int src)
+    {
+        alu(0x85, dst, src);
+    }
+
+    void xor32(int dst, int src)
+    {
+        rex(false, src, dst);
+        byte(0x31);
+        modrm(src, dst);
+    }
+
+    void imul(int dst, int src)
+    {
+        rex(true, dst, src);
+        byte(0x0F);
+        byte(0xAF);
+        modrm(dst, src);
+    }
+
+    // rdx:rax / src
+    void div(int src)
+    {
+        rex(true, 0, src);
+        byte(0xF7);
+        modrm(6, src);
+    }
+
+    void shl(int dst)
+    {
+        rex(true, 0, dst);
+        byte(0xD3);
+        modrm(4, dst);
+    }
+
+    void shr(int dst)
+    {
+        rex(true, 0, dst);
+        byte(0xD3);
+        modrm(5, dst);
+    }
+
+    void inc(int dst)
+    {
+        rex(true, 0, dst);
+        byte(0xFF);
+        modrm(0, dst);
+    }
+
+    void dec(int dst)
+    {
+        rex(true, 0, dst);
+        byte(0xFF);
+        modrm(1, dst);
+    }
+
+    void orr(int dst, int src)
+    {
+        alu(0x09, dst, src);
+    }
+
+    void shli(int dst, uint8_t imm)
+    {
+        rex(true, 0, dst);
+        byte(0xC1);
+        modrm(4, dst);
+        byte(imm);
+    }
+
+    void shri(int dst, uint8_t imm)
+    {
+        rex(true, 0, dst);
+        byte(0xC1);
+        modrm(5, dst);
+        byte(imm);
+    }
+
+    // zero extends into the upper half of dst
+    void mov32(int dst, int src)
+    {
+        rex(false, src, dst);
+        byte(0x89);
+        modrm(src, dst);
+    }
+
+    void mov16(int dst, int src)
+    {
+        byte(0x66);
+        rex(false, src, dst);
+        byte(0x89);
+        modrm(src, dst);
+    }
+
+    void mov8(int dst, int src)
+    {
+        rex(false, src, dst, src >= RSP || dst >= RSP);
+        byte(0x88);
+        modrm(src, dst);
+    }
+
+    void movzx16(int dst, int src)
+    {
+        rex(false, dst, src);
+        byte(0x0F);
+        byte(0xB7);
+        modrm(dst, src);
+    }
+
+    void test32i(int base, int32_t disp, uint32_t imm)
+    {
+        rex(false, 0, base);
+        byte(0xF7);
+        mem(0, base, disp);
+        dword(imm);
+    }
+
+    void inc64(int base, int32_t disp)
+    {
+        rex(true, 0, base);
+        byte(0xFF);
+        mem(0, base, disp);
+    }
+
+    void dec64(int base, int32_t disp)
+    {
+        rex(true, 0, base);
+        byte(0xFF);
+        mem(1, base, disp);
+    }
+
+    void cmp64i(int base, int32_t disp, int32_t imm)
+    {
+        rex(true, 0, base);
+        byte(0x81);
+        mem(7, base, disp);
+        dword((uint32_t)imm);
+    }
+
+    void cmp32i(int base, int32_t disp, int8_t imm)
+    {
+        rex(false, 0, base);
+        byte(0x83);
+        mem(7, base, disp);
+        byte((uint8_t)imm);
+    }
+
+    void addi(int dst, int8_t imm)
+    {
+        rex(true, 0, dst);
+        byte(0x83);
+        modrm(0, dst);
+        byte((uint8_t)imm);
+    }
+
+    void subi(int dst, int8_t imm)
+    {
+        rex(true, 0, dst);
+        byte(0x83);
+        modrm(5, dst);
+        byte((uint8_t)imm);
+    }
+
+    void setcc(int cc, int dst)
+    {
+        rex(false, 0, dst, dst >= RSP);
+        byte(0x0F);
+        byte(0x90 + cc);
+        modrm(0, dst);
+    }
+
+    // lea dst32, [base + index * scale]
+    void lea32(int dst, int base, int index, int scale)
+    {
+        uint8_t ss = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+        byte(0x8D);
+        byte(((dst & 7) << 3) | RSP);
+        byte((ss << 6) | ((index & 7) << 3) | (base & 7));
+    }
+
+    void callm(int base, int32_t disp)
+    {
+        rex(false, 0, base);
+        byte(0xFF);
+        mem(2, base, disp);
+    }
+
+    void callr(int r)
+    {
+        rex(false, 0, r);
+        byte(0xFF);
+        modrm(2, r);
+    }
+
+    void call(Label label)
+    {
+        byte(0xE8);
+        rel32(label);
+    }
+
+    void jmp(Label label)
+    {
+        byte(0xE9);
+        rel32(label);
+    }
+
+    void jcc(int cc, Label label)
+    {
+        byte(0x0F);
+        byte(0x80 + cc);
+        rel32(label);
+    }
+};
+
+#endif  // TVM_JIT
+#endif  //_Assembler_h_
@@ -0,0 +1,190 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Batch.h"
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "Server.h"
+
+struct BatchJob
+{
+    size_t         line;
+    str_t          input;
+    str_t          output;
+    ServerRequest  req;
+    ServerResponse resp;
+};
+
+typedef std::vector<BatchJob> BatchJobs;
+
+static bool ReadWhole(const str_t& path, str_t& dest)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    char   buf[4096];
+    size_t br;
+    while ((br = fread(buf, 1, sizeof(buf), fp)) > 0)
+        dest.append(buf, br);
+    fclose(fp);
+    return true;
+}
+
+static bool ParseJob(const str_t& text, BatchJob& job)
+{
+    std::istringstream ss(text);
+    if (!(ss >> job.req.path >> job.input >> job.output))
+        return false;
+
+    str_t assign;
+    while (ss >> assign)
+    {
+        char*         end = nullptr;
+        unsigned long reg = strtoul(assign.c_str(), &end, 10);
+        if (*end != '=' || reg >= MAX_REG)
+            return false;
+
+        job.req.regi[reg].x = strtoull(end + 1, &end, 0);
+        job.req.regmask |= 1u << reg;
+        if (*end != 0)
+            return false;
+    }
+    return true;
+}
+
+static void RunJob(Server& server, BatchJob& job)
+{
+    if (job.input != "-" && !ReadWhole(job.input, job.req.input))
+    {
+        job.resp.status = PS_ERROR;
+        job.resp.output = "failed to read '" + job.input + "'\n";
+        return;
+    }
+
+    server.execute(job.req, job.resp);
+    if (job.output == "-" || job.resp.status != PS_OK)
+        return;
+
+    FILE* fp = fopen(job.output.c_str(), "wb");
+    if (fp)
+    {
+        fwrite(job.resp.output.data(), 1, job.resp.output.size(), fp);
+        fclose(fp);
+    }
+}
+
+static void RunJobs(Server& server, BatchJobs& jobs, std::atomic<size_t>& next)
+{
+    size_t job;
+    while ((job = next++) < jobs.size())
+        RunJob(server, jobs[job]);
+}
+
+int RunBatch(const str_t& manifest,
+             const str_t& results,
+             const str_t& modpath,
+             const str_t& engine,
+             bool         lazy,
+             size_t       workers)
+{
+    std::ifstream in(manifest);
+    if (!in.is_open())
+    {
+        printf("failed to open the manifest '%s'\n", manifest.c_str());
+        return PS_ERROR;
+    }
+
+    BatchJobs jobs;
+    str_t     text;
+    size_t    line = 0;
+    while (std::getline(in, text))
+    {
+        ++line;
+        size_t st = text.find_first_not_of(" \t\r");
+        if (st == str_t::npos || text[st] == '#')
+            continue;
+
+        BatchJob job = {};
+        job.line     = line;
+        job.req.lazy = lazy;
+        if (!ParseJob(text, job))
+        {
+            printf("%s(%d): invalid job\n", manifest.c_str(), (int)line);
+            return PS_ERROR;
+        }
+        job.req.engine = engine;
+        jobs.push_back(job);
+    }
+
+    FILE* fp = fopen(results.c_str(), "wb");
+    if (!fp)
+    {
+        printf("failed to open '%s' for writing\n", results.c_str());
+        return PS_ERROR;
+    }
+
+    if (workers == 0)
+        workers = std::thread::hardware_concurrency();
+    if (workers == 0)
+        workers = 1;
+
+    // Up to one idle program per worker is kept loaded.
+    Server server(modpath, workers, workers);
+
+    std::atomic<size_t>      next(0);
+    std::vector<std::thread> threads;
+
+    size_t i;
+    for (i = 0; i < workers && i < jobs.size(); ++i)
+        threads.push_back(std::thread(RunJobs, std::ref(server), std::ref(jobs), std::ref(next)));
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    int status = PS_OK;
+    for (const BatchJob& job : jobs)
+    {
+        if (job.resp.status == PS_OK)
+        {
+            fprintf(fp,
+                    "%d %d %.6f %s\n",
+                    (int)job.line,
+                    (int)job.resp.exitCode,
+                    (double)job.resp.runTime * 1e-9,
+                    job.req.path.c_str());
+        }
+        else
+        {
+            fprintf(fp, "%d error 0 %s\n", (int)job.line, job.req.path.c_str());
+            printf("%s(%d): %s", manifest.c_str(), (int)job.line, job.resp.output.c_str());
+            status = PS_ERROR;
+        }
+    }
+    fclose(fp);
+    return status;
+}
@@ -0,0 +1,53 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Batch_h_
+#define _Batch_h_
+
+#include "Declarations.h"
+
+// Runs every job listed in manifest on a pool of worker threads and
+// writes one line per job to results, in the order of the manifest:
+//
+//    <line> <exit code> <run seconds> <image>
+//
+// The exit code is "error" when the image could not be loaded. Each
+// line of the manifest is a job
+//
+//    <image> <input> <output> [<register>=<value> ...]
+//
+// input is read as the program's stdin and its output is written to
+// output. "-" is an empty input, or discards the output. Values are
+// decimal, or hex with 0x. Blank lines and lines starting with # are
+// skipped. Jobs are run by Server::execute, so a program loaded for
+// one job is reset and reused by later jobs with the same image.
+//
+// engine is empty for the default engine, workers zero uses one
+// thread per core. Returns PS_ERROR when the manifest or the results
+// cannot be used, or a job failed to load.
+extern int RunBatch(const str_t& manifest,
+                    const str_t& results,
+                    const str_t& modpath,
+                    const str_t& engine,
+                    bool         lazy,
+                    size_t       workers);
+
+#endif  //_Batch_h_
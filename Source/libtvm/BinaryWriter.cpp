@@ -26,6 +26,7 @@
 #include "BinaryWriter.h"
 #include <stdio.h>
 #include <iostream>
+#include "Builtin.h"
 #include "SymbolUtils.h"
 
 inline uint16_t getAlignment(size_t al)
@@ -44,9 +45,11 @@ BinaryWriter::BinaryWriter(const str_t& modpath) :
     m_sizeOfData(0),
     m_sizeOfSym(0),
     m_sizeOfStr(0),
+    m_sizeOfExp(0),
     m_addrMap(),
     m_labels(),
     m_header({}),
+    m_headerFlags(0),
     m_modpath(modpath)
 {
 }
@@ -89,6 +92,13 @@ int BinaryWriter::mergeDataDeclarations(const DataLookup& data)
     return status;
 }
 
+void BinaryWriter::mergeExports(const strvec_t& exports)
+{
+    strvec_t::const_iterator it;
+    for (it = exports.begin(); it != exports.end(); ++it)
+        m_exports.push_back(*it);
+}
+
 int BinaryWriter::mergeLabels(const LabelMap& map)
 {
     int status = PS_OK;
@@ -341,8 +351,36 @@ uint64_t BinaryWriter::findLabel(const str_t& name)
     return -1;
 }
 
+int BinaryWriter::loadSymbols(const SymbolTable* avail, const str_t& lib)
+{
+    int status = PS_OK;
+    int i      = 0;
+    while (avail != nullptr && avail[i].name != nullptr && status == PS_OK)
+    {
+        const str_t            str = avail[i].name;
+        StringLookup::iterator it  = m_symbols.find(str);
+        if (it == m_symbols.end())
+            m_symbols[str] = lib;
+        else
+        {
+            printf("duplicate symbol %s found in library %s\n",
+                   str.c_str(),
+                   lib.c_str());
+
+            printf("first seen in %s\n", it->second.c_str());
+            status = PS_ERROR;
+        }
+        ++i;
+    }
+    return status;
+}
+
 int BinaryWriter::loadSharedLibrary(const str_t& lib)
 {
+    const BuiltinModule* builtin = FindBuiltinModule(lib);
+    if (builtin != nullptr)
+        return loadSymbols(builtin->init(), lib);
+
     int status = PS_OK;
 
     LibHandle shlib = LoadSharedLibrary(lib, m_modpath);
@@ -359,25 +397,8 @@ int BinaryWriter::loadSharedLibrary(const str_t& lib)
                        (m_modpath + lib).c_str());
                 status = PS_ERROR;
             }
-
-            int i = 0;
-            while (avail != nullptr && avail[i].name != nullptr && status == PS_OK)
-            {
-                const str_t            str = avail[i].name;
-                StringLookup::iterator it  = m_symbols.find(str);
-                if (it == m_symbols.end())
-                    m_symbols[str] = lib;
-                else
-                {
-                    printf("duplicate symbol %s found in library %s\n",
-                           str.c_str(),
-                           lib.c_str());
-
-                    printf("first seen in %s\n", it->second.c_str());
-                    status = PS_ERROR;
-                }
-                ++i;
-            }
+            else
+                status = loadSymbols(avail, lib);
         }
         else
         {
@@ -414,7 +435,8 @@ int BinaryWriter::writeHeader()
 
     m_header.code[0] = 'T';
     m_header.code[1] = 'V';
-    m_header.flags   = 0;
+    m_header.flags   = m_headerFlags;
+    m_header.version = TVM_VERSION_1;
 
     size_t offset = sizeof(TVMHeader);
     if (mapInstructions() != PS_OK)
@@ -434,6 +456,29 @@ int BinaryWriter::writeHeader()
     offset += m_sizeOfCode;
     offset += getAlignment(m_sizeOfCode);
 
+    // Each export is its address followed by its name.
+    m_sizeOfExp = 0;
+    strvec_t::iterator it;
+    for (it = m_exports.begin(); it != m_exports.end(); ++it)
+    {
+        if (findLabel(*it) == (uint64_t)-1)
+        {
+            printf("the exported label '%s' was not found\n", it->c_str());
+            return PS_ERROR;
+        }
+        m_sizeOfExp += sizeof(uint32_t) + it->size() + 1;
+    }
+
+    // It is not in the header, the loader finds
+    // it at the end of the code section.
+    if (m_sizeOfExp != 0)
+    {
+        m_header.flags |= HF_EXPORTS;
+        offset += sizeof(TVMSection);
+        offset += m_sizeOfExp;
+        offset += getAlignment(m_sizeOfExp);
+    }
+
     if (m_sizeOfData != 0)
     {
         m_header.dat = (uint32_t)offset;
@@ -546,6 +591,28 @@ size_t BinaryWriter::writeSymbolSection(void)
     return m_sizeOfSym;
 }
 
+size_t BinaryWriter::writeExportSection(void)
+{
+    TVMSection sec = {};
+    sec.size       = (uint32_t)m_sizeOfExp;
+    sec.align      = getAlignment(m_sizeOfExp);
+    write(&sec, sizeof(TVMSection));
+
+    strvec_t::iterator it = m_exports.begin();
+    while (it != m_exports.end())
+    {
+        const str_t& str = (*it++);
+        write32((uint32_t)findLabel(str));
+        write(str.c_str(), str.size());
+        write8(0);
+    }
+
+    int pb = sec.align;
+    while (pb--)
+        write8(0);
+    return m_sizeOfExp;
+}
+
 size_t BinaryWriter::writeStringSection(void)
 {
     TVMSection sec = {};
@@ -581,6 +648,13 @@ int BinaryWriter::writeSections()
             return PS_ERROR;
     }
 
+    if (m_sizeOfExp != 0)
+    {
+        size = writeExportSection();
+        if (size != m_sizeOfExp)
+            return PS_ERROR;
+    }
+
     if (m_sizeOfData != 0)
     {
         size = writeDataSection();
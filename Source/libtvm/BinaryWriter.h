@@ -35,14 +35,17 @@ private:
     size_t          m_sizeOfData;
     size_t          m_sizeOfSym;
     size_t          m_sizeOfStr;
+    size_t          m_sizeOfExp;
     IndexToPosition m_addrMap;
     LabelMap        m_labels;
     LabelMap        m_strtab;
     LabelMap        m_datatab;
     strvec_t        m_orderedString;
+    strvec_t        m_exports;
     strset_t        m_linkedLibraries;
     StringLookup    m_symbols;
     TVMHeader       m_header;
+    uint8_t         m_headerFlags;
     str_t           m_modpath;
     DataLookup      m_dataDecl;
     MemoryStream    m_dataTable;
@@ -57,6 +60,7 @@ private:
     size_t writeCodeSection(void);
     size_t writeSymbolSection(void);
     size_t writeStringSection(void);
+    size_t writeExportSection(void);
 
     int mapInstructions(void);
 
@@ -66,6 +70,7 @@ private:
     uint64_t addToStringTable(const str_t& symname);
     uint64_t addToDataTable(const DataDeclaration& dt);
     uint64_t addLinkedSymbol(const str_t& symname, const str_t& libname);
+    int      loadSymbols(const SymbolTable* avail, const str_t& lib);
     int      loadSharedLibrary(const str_t& lib);
 
 public:
@@ -74,6 +79,13 @@ public:
 
     void mergeInstructions(const Instructions& insl);
     int  mergeDataDeclarations(const DataLookup& data);
+    void mergeExports(const strvec_t& exports);
+
+    // Sets the HF_* flags that are written to the file header.
+    inline void setHeaderFlags(uint8_t flags)
+    {
+        m_headerFlags = flags;
+    }
 
     int mergeLabels(const LabelMap& map);
     int resolve(strvec_t& modules);
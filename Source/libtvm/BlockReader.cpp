@@ -29,10 +29,18 @@
 #include <algorithm>
 #include <cassert>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 BlockReader::BlockReader(const char *fname) :
     m_block(nullptr),
     m_fileLen(0),
-    m_loc(0)
+    m_loc(0),
+    m_mapped(false)
 {
     open(fname);
 }
@@ -40,14 +48,29 @@ BlockReader::BlockReader(const char *fname) :
 BlockReader::BlockReader() :
     m_block(nullptr),
     m_fileLen(0),
-    m_loc(0)
+    m_loc(0),
+    m_mapped(false)
 {
 }
 
 BlockReader::~BlockReader()
 {
-    if (m_block)
+    release();
+}
+
+void BlockReader::release(void)
+{
+#ifndef _WIN32
+    if (m_mapped)
+        munmap(m_block, m_fileLen);
+    else
+#endif
         delete[] m_block;
+
+    m_block   = nullptr;
+    m_fileLen = 0;
+    m_loc     = 0;
+    m_mapped  = false;
 }
 
 uint8_t BlockReader::next(void)
@@ -81,18 +104,19 @@ size_t BlockReader::read(void *blk, size_t nr)
     return nr;
 }
 
-void BlockReader::offset(int32_t nr)
+void BlockReader::offset(int64_t nr)
 {
-    if (m_loc == 0 && nr < 0)
-        return;
-
-    int32_t lo = (int32_t)m_loc;
-    lo += nr;
-    if (lo < 0)
-        lo = 0;
-    if (lo > (int32_t)m_fileLen)
-        lo = ((int32_t)m_fileLen) - 1;
-    m_loc = lo;
+    if (nr < 0)
+    {
+        size_t back = (size_t)(-nr);
+        m_loc       = back > m_loc ? 0 : m_loc - back;
+    }
+    else
+    {
+        m_loc += (size_t)nr;
+        if (m_loc > m_fileLen)
+            m_loc = m_fileLen > 0 ? m_fileLen - 1 : 0;
+    }
 }
 
 void BlockReader::moveTo(size_t loc)
@@ -101,28 +125,71 @@ void BlockReader::moveTo(size_t loc)
         m_loc = loc;
 }
 
+bool BlockReader::map(int fd, size_t len)
+{
+#ifndef _WIN32
+    // The mapping only has a zero after the last byte
+    // when the file does not end on a page boundary.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (len < page || len % page == 0)
+        return false;
+
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+        return false;
+
+    // The file is read once from the front.
+    madvise(addr, len, MADV_SEQUENTIAL);
+    madvise(addr, len, MADV_WILLNEED);
+
+    m_block   = (uint8_t *)addr;
+    m_fileLen = len;
+    m_mapped  = true;
+    return true;
+#else
+    (void)fd;
+    (void)len;
+    return false;
+#endif
+}
+
 void BlockReader::open(const char *fname)
 {
-    if (fname)
+    release();
+
+    if (!fname)
     {
-        FILE *fp = fopen(fname, "rb");
-        if (fp)
-        {
-            fseek(fp, 0L, SEEK_END);
-            m_fileLen = ftell(fp);
-            fseek(fp, 0L, SEEK_SET);
-            if (m_block)
-                delete[] m_block;
-
-            m_block = new uint8_t[m_fileLen + 1];
-            fread(m_block, 1, m_fileLen, fp);
-            m_block[m_fileLen] = 0;
-
-            fclose(fp);
-        }
-        else
-            puts("failed to open file.");
-    }
-    else
         puts("Invalid file name.");
+        return;
+    }
+
+    FILE *fp = fopen(fname, "rb");
+    if (!fp)
+    {
+        puts("failed to open file.");
+        return;
+    }
+
+    size_t len = 0;
+#ifdef _WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    len = (size_t)_ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+#else
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0)
+        len = (size_t)st.st_size;
+
+    if (map(fileno(fp), len))
+    {
+        fclose(fp);
+        return;
+    }
+#endif
+
+    m_block   = new uint8_t[len + 1];
+    m_fileLen = fread(m_block, 1, len, fp);
+
+    m_block[m_fileLen] = 0;
+    fclose(fp);
 }
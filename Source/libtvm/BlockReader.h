@@ -25,12 +25,20 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+// Reads a whole file into memory. Where mmap is available files of a
+// page or more are mapped read only with MAP_PRIVATE instead of being
+// copied, anything else or a failed mapping falls back to reading the
+// file into a buffer. Either way the byte after the end is zero.
 class BlockReader
 {
 private:
     uint8_t *m_block;
     size_t   m_fileLen;
     size_t   m_loc;
+    bool     m_mapped;
+
+    bool map(int fd, size_t len);
+    void release(void);
 
 public:
     BlockReader(const char *fname);
@@ -41,7 +49,7 @@ public:
     uint8_t next(void);
     uint8_t current(void);
     size_t  read(void *blk, size_t nr);
-    void    offset(int32_t nr);
+    void    offset(int64_t nr);
     void    moveTo(size_t loc);
 
     const uint8_t *ptr(void) const
@@ -63,6 +71,12 @@ public:
     {
         return m_fileLen;
     }
+
+    // True when the file is mapped rather than copied
+    inline bool isMapped(void) const
+    {
+        return m_mapped;
+    }
 };
 
 #endif  //_BlockReader_h_
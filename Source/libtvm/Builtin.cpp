@@ -0,0 +1,68 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Builtin.h"
+#include <vector>
+
+#ifdef TVM_BUILTIN_STD
+SYM_API SymbolTable* std_init();
+SYM_API int          std_abi();
+#endif
+
+typedef std::vector<BuiltinModule> BuiltinModules;
+
+static BuiltinModules& getBuiltinModules(void)
+{
+    static BuiltinModules modules = {
+#ifdef TVM_BUILTIN_STD
+        {"std", std_init, std_abi},
+#endif
+    };
+    return modules;
+}
+
+void RegisterBuiltinModule(const BuiltinModule& mod)
+{
+    if (mod.name == nullptr || mod.init == nullptr)
+        return;
+
+    BuiltinModules& modules = getBuiltinModules();
+    for (BuiltinModule& it : modules)
+    {
+        if (str_t(it.name) == mod.name)
+        {
+            it = mod;
+            return;
+        }
+    }
+    modules.push_back(mod);
+}
+
+const BuiltinModule* FindBuiltinModule(const str_t& name)
+{
+    const BuiltinModules& modules = getBuiltinModules();
+    for (const BuiltinModule& it : modules)
+    {
+        if (name == it.name)
+            return &it;
+    }
+    return nullptr;
+}
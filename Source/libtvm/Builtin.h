@@ -0,0 +1,46 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Builtin_h_
+#define _Builtin_h_
+
+#include "Declarations.h"
+#include "SharedLib.h"
+
+// A module that is linked into the executable instead of being
+// loaded from the module directory.
+struct BuiltinModule
+{
+    const char* name;
+    ModuleInit  init;  // same as the module's '<name>_init'
+    tvmabi_t    abi;   // same as the module's '<name>_abi', may be null
+};
+
+// Adds a module to the registry. It has to be registered before
+// a program that links it is compiled or loaded. A name that is
+// already registered is replaced.
+extern void RegisterBuiltinModule(const BuiltinModule& mod);
+
+// Returns the registered module with the given name or null.
+// Registered modules are used before the module directory is searched.
+extern const BuiltinModule* FindBuiltinModule(const str_t& name);
+
+#endif  //_Builtin_h_
@@ -0,0 +1,296 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "DataTable.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+DataTable::DataTable() :
+    m_data(nullptr),
+    m_capacity(0),
+    m_length(0),
+    m_pristine(nullptr),
+    m_fd(-1),
+    m_mapped(false),
+    m_map(nullptr),
+    m_mapLength(0)
+{
+}
+
+DataTable::~DataTable()
+{
+    clear();
+}
+
+void DataTable::clear(void)
+{
+#ifndef _WIN32
+    if (m_fd != -1)
+        close(m_fd);
+    if (m_mapped)
+        munmap(m_map, m_mapLength);
+    else
+#endif
+        delete[] m_data;
+
+    delete[] m_pristine;
+
+    m_data      = nullptr;
+    m_capacity  = 0;
+    m_length    = 0;
+    m_pristine  = nullptr;
+    m_fd        = -1;
+    m_mapped    = false;
+    m_map       = nullptr;
+    m_mapLength = 0;
+}
+
+void DataTable::reserve(size_t cap)
+{
+    clear();
+    if (cap == 0)
+        return;
+
+    m_capacity = cap;
+    m_length   = cap + 1;
+
+#ifndef _WIN32
+    // Only whole pages can be remapped, smaller
+    // tables are cheaper to copy than to map.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (m_length > page)
+    {
+        m_length = (m_length + page - 1) & ~(page - 1);
+
+        void* addr = mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr != MAP_FAILED)
+        {
+            m_data      = (uint8_t*)addr;
+            m_mapped    = true;
+            m_map       = m_data;
+            m_mapLength = m_length;
+            return;
+        }
+        m_length = cap + 1;
+    }
+#endif
+
+    m_data = new uint8_t[m_length];
+    memset(m_data, 0, m_length);
+}
+
+bool DataTable::mapSnapshot(void)
+{
+#ifndef _WIN32
+    if (!m_mapped)
+        return false;
+
+    int fd = -1;
+#ifdef __linux__
+    fd = memfd_create("toyvm-data", MFD_CLOEXEC);
+#else
+    char name[] = "/tmp/toyvm-data-XXXXXX";
+    fd          = mkstemp(name);
+    if (fd != -1)
+        unlink(name);
+#endif
+    if (fd == -1)
+        return false;
+
+    size_t  bw  = 0;
+    ssize_t cur = 0;
+    if (ftruncate(fd, (off_t)m_length) == 0)
+    {
+        while (bw < m_length && (cur = pwrite(fd, m_data + bw, m_length - bw, (off_t)bw)) > 0)
+            bw += (size_t)cur;
+    }
+
+    // MAP_FIXED replaces the anonymous pages in place.
+    if (bw != m_length ||
+        mmap(m_data, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DataTable::snapshot(void)
+{
+    if (!m_data)
+        return;
+
+#ifndef _WIN32
+    if (m_fd != -1)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+
+    if (mapSnapshot())
+    {
+        delete[] m_pristine;
+        m_pristine = nullptr;
+        return;
+    }
+
+    if (!m_pristine)
+        m_pristine = new uint8_t[m_length];
+    memcpy(m_pristine, m_data, m_length);
+}
+
+void DataTable::restore(void)
+{
+#ifndef _WIN32
+    if (m_fd != -1)
+    {
+        if (mmap(m_data, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, m_fd, 0) != MAP_FAILED)
+            return;
+
+        // Copy the snapshot from the file instead.
+        size_t  br  = 0;
+        ssize_t cur = 0;
+        while (br < m_length && (cur = pread(m_fd, m_data + br, m_length - br, (off_t)br)) > 0)
+            br += (size_t)cur;
+        return;
+    }
+#endif
+
+    if (m_pristine)
+        memcpy(m_data, m_pristine, m_length);
+}
+
+void DataTable::share(const DataTable& from)
+{
+    reserve(from.m_capacity);
+    if (!m_data)
+        return;
+
+#ifndef _WIN32
+    if (from.m_fd != -1 && m_mapped && m_length == from.m_length)
+    {
+        m_fd = fcntl(from.m_fd, F_DUPFD_CLOEXEC, 0);
+        if (m_fd != -1)
+        {
+            restore();
+            return;
+        }
+    }
+#endif
+
+    // Both tables hold at least capacity + 1 bytes.
+    m_pristine = new uint8_t[m_length];
+    memset(m_pristine, 0, m_length);
+    memcpy(m_pristine, from.m_pristine ? from.m_pristine : from.m_data, m_capacity + 1);
+    memcpy(m_data, m_pristine, m_length);
+}
+
+bool DataTable::load(const char* path, uint64_t offset)
+{
+    if (!m_data)
+        return true;
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    // The mapping holds its own reference to the file.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (m_mapped && offset % page == 0 &&
+        mmap(m_data, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, (off_t)offset) != MAP_FAILED)
+    {
+        close(fd);
+        return true;
+    }
+
+    size_t  br  = 0;
+    ssize_t cur = 0;
+    while (br < m_capacity && (cur = pread(fd, m_data + br, m_capacity - br, (off_t)(offset + br))) > 0)
+        br += (size_t)cur;
+
+    close(fd);
+    return br == m_capacity;
+#else
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    bool ok = _fseeki64(fp, (int64_t)offset, SEEK_SET) == 0 &&
+              fread(m_data, 1, m_capacity, fp) == m_capacity;
+    fclose(fp);
+    return ok;
+#endif
+}
+
+bool DataTable::moveTo(uint64_t addr)
+{
+    if (!m_data || addr == (uint64_t)(size_t)m_data)
+        return true;
+
+#ifndef _WIN32
+    // The address is only a hint without MAP_FIXED, a mapping that
+    // lands anywhere else means something is already there.
+    size_t   page   = (size_t)sysconf(_SC_PAGESIZE);
+    uint64_t start  = addr & ~(uint64_t)(page - 1);
+    size_t   offset = (size_t)(addr - start);
+    size_t   length = (offset + m_length + page - 1) & ~(page - 1);
+
+    void* map = mmap((void*)(size_t)start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return false;
+    if ((uint64_t)(size_t)map != start)
+    {
+        munmap(map, length);
+        return false;
+    }
+
+    uint8_t* data = (uint8_t*)map + offset;
+    memcpy(data, m_data, m_length);
+
+    if (m_mapped)
+        munmap(m_map, m_mapLength);
+    else
+        delete[] m_data;
+
+    // A snapshot file is still used by restore, it is read into
+    // the table when the new address is not page aligned.
+    m_data      = data;
+    m_mapped    = true;
+    m_map       = (uint8_t*)map;
+    m_mapLength = length;
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,114 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _DataTable_h_
+#define _DataTable_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// The program's data table. The address does not change once it is
+// reserved, adrp results and compiled code point into it.
+//
+// snapshot keeps the current contents so restore can put them back
+// after a run. Where mmap is available tables of a page or more are
+// remapped as a private copy on write mapping of a file holding the
+// snapshot. A run then only copies the pages it writes, and restore
+// drops those copies by mapping the file again. Smaller tables, and
+// tables the mapping fails for, are copied back instead.
+class DataTable
+{
+private:
+    uint8_t* m_data;
+    size_t   m_capacity;
+    size_t   m_length;     // bytes allocated, at least m_capacity + 1
+    uint8_t* m_pristine;   // the snapshot when it is copied
+    int      m_fd;         // the snapshot when it is mapped, or -1
+    bool     m_mapped;     // m_data came from mmap
+    uint8_t* m_map;        // the start of the mapping m_data is in
+    size_t   m_mapLength;  // its length
+
+    bool mapSnapshot(void);
+
+public:
+    DataTable();
+    ~DataTable();
+
+    // Releases the table and its snapshot.
+    void clear(void);
+
+    // Allocates cap zeroed bytes, discarding the current table.
+    void reserve(size_t cap);
+
+    // Records the current contents as the ones restore returns to.
+    void snapshot(void);
+
+    // Returns the table to the last snapshot.
+    void restore(void);
+
+    // Replaces the table with a copy of from's snapshot. A mapped
+    // snapshot is mapped again rather than copied, so the two tables
+    // share every page neither of them has written.
+    void share(const DataTable& from);
+
+    // Replaces the contents with the bytes of the file at offset. A
+    // mapped table maps the file in place, copy on write, so its clean
+    // pages are shared with every other process that maps it. The
+    // snapshot is not changed. offset has to be page aligned for that,
+    // and the file has to cover the table's last page.
+    bool load(const char* path, uint64_t offset);
+
+    // Moves the table to addr, keeping its contents and snapshot, so
+    // addresses taken in another process are valid again. It fails
+    // when the pages at addr are in use or cannot be mapped.
+    bool moveTo(uint64_t addr);
+
+    // The address of the byte at idx, or -1 when it is out of range
+    inline size_t addr(size_t idx) const
+    {
+        if (idx < m_capacity)
+            return (size_t)&m_data[idx];
+        return (size_t)-1;
+    }
+
+    inline uint8_t* ptr(void)
+    {
+        return m_data;
+    }
+
+    inline const uint8_t* ptr(void) const
+    {
+        return m_data;
+    }
+
+    inline size_t capacity(void) const
+    {
+        return m_capacity;
+    }
+
+    // True when restore remaps the snapshot rather than copying it
+    inline bool isCopyOnWrite(void) const
+    {
+        return m_fd != -1;
+    }
+};
+
+#endif  //_DataTable_h_
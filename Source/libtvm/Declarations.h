@@ -214,6 +214,8 @@ enum SectionCodes
     SEC_QUAD,   // .quad | .xword
     SEC_ZERO,   // Reserve a block of zeroed memory
     SEC_DECL_EN,
+    // Directives
+    SEC_GLOBAL,  // .global | .globl, exports a label
 };
 
 enum InstructionFlags
@@ -234,10 +236,31 @@ enum InstructionFlags
     IF_MAXF = 0x1000,  // needs an uint16_t
 };
 
+enum HeaderFlags
+{
+    // cmp only records its operands and each conditional branch
+    // compares them directly. The branches do not clear anything,
+    // so the result of a cmp can be tested any number of times.
+    HF_LAZY_FLAGS = 0x01,
+
+    // An export table of labels declared with .global directly
+    // follows the code section.
+    HF_EXPORTS = 0x02,
+};
+
+// The layout of the code section. The version shares what used to
+// be the upper byte of the flags, so files written before it existed
+// read as version 1.
+enum TVMVersion
+{
+    TVM_VERSION_1 = 0,  // variable width records, see SizeFlags
+};
+
 struct TVMHeader
 {
     uint8_t  code[2];
-    uint16_t flags;
+    uint8_t  flags;    // HF_*
+    uint8_t  version;  // TVM_VERSION_*
     uint32_t dat;
     uint32_t str;
     uint32_t sym;
@@ -282,13 +305,20 @@ struct ExecInstruction
     uint16_t flags;
     uint64_t argv[INS_ARG];
     uint16_t index;
+    uint8_t  abi;  // TVM_ABI_* of call
     Symbol   call;
 };
 
+struct HostCall
+{
+    Symbol  call;
+    uint8_t abi;
+};
+
 using Instructions     = std::vector<Instruction>;
 using IndexToPosition  = std::unordered_map<uint64_t, uint64_t>;
 using LabelMap         = std::unordered_map<str_t, uint64_t>;
-using SymbolMap        = std::unordered_map<str_t, Symbol>;
+using SymbolIndex      = std::vector<HostCall>;
 using StringLookup     = std::unordered_map<str_t, str_t>;
 using AddressLookup    = std::unordered_map<str_t, uint64_t>;
 using DynamicLib       = std::vector<void*>;
@@ -0,0 +1,110 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Embed.h"
+#include "Program.h"
+#include "SymbolUtils.h"
+
+// The handle is the program itself.
+struct tvmprogram
+{
+    Program prog;
+    bool    launched;
+
+    tvmprogram(const str_t& modpath) :
+        prog(modpath),
+        launched(false)
+    {
+    }
+};
+
+tvmprogram_t* tvm_create(void)
+{
+    str_t modpath;
+    FindModuleDirectory(modpath);
+    return new tvmprogram(modpath);
+}
+
+void tvm_free(tvmprogram_t* prog)
+{
+    delete prog;
+}
+
+int tvm_set_engine(tvmprogram_t* prog, const char* name)
+{
+    if (!prog || !name)
+        return -1;
+    return prog->prog.setEngine(name) == PS_OK ? 0 : -1;
+}
+
+int tvm_load(tvmprogram_t* prog, const char* path)
+{
+    if (!prog)
+        return -1;
+    return prog->prog.load(path) == PS_OK ? 0 : -1;
+}
+
+int tvm_run(tvmprogram_t* prog)
+{
+    if (!prog)
+        return -1;
+
+    // A second run starts from a clean state.
+    if (prog->launched)
+        prog->prog.reset();
+    prog->launched = true;
+    return prog->prog.launch();
+}
+
+void tvm_reset(tvmprogram_t* prog)
+{
+    if (prog)
+        prog->prog.reset();
+}
+
+int64_t tvm_find(tvmprogram_t* prog, const char* name)
+{
+    if (!prog || !name)
+        return -1;
+    return (int64_t)prog->prog.findExport(name);
+}
+
+int tvm_call(tvmprogram_t* prog, int64_t addr)
+{
+    if (!prog || addr < 0)
+        return -1;
+
+    prog->launched = true;
+    return prog->prog.call((uint64_t)addr);
+}
+
+uint64_t tvm_get_register(tvmprogram_t* prog, uint8_t reg)
+{
+    if (!prog || reg >= MAX_REG)
+        return 0;
+    return prog->prog.getRegisters()[reg].x;
+}
+
+void tvm_set_register(tvmprogram_t* prog, uint8_t reg, uint64_t v)
+{
+    if (prog && reg < MAX_REG)
+        prog->prog.setRegister(reg, v);
+}
@@ -0,0 +1,76 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Embed_h_
+#define _Embed_h_
+
+#include <stdint.h>
+
+// A C interface for running tvm images inside another program.
+// Labels declared with .global are exported by tcom and can be
+// called directly, with arguments and results passed in the
+// registers. Unless noted the functions return 0 on success.
+//
+//    tvmprogram_t* prog = tvm_create();
+//    tvm_load(prog, "image");
+//    int64_t fn = tvm_find(prog, "square");
+//    tvm_set_register(prog, 0, 12);
+//    tvm_call(prog, fn);
+//    uint64_t r = tvm_get_register(prog, 0);
+//    tvm_free(prog);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tvmprogram tvmprogram_t;
+
+// Modules are searched for in the module directory
+// of the executable, as with tvm.
+extern tvmprogram_t* tvm_create(void);
+extern void          tvm_free(tvmprogram_t* prog);
+
+// Selects the engine by name, see tvm -h. It has to be set before load.
+extern int tvm_set_engine(tvmprogram_t* prog, const char* name);
+
+extern int tvm_load(tvmprogram_t* prog, const char* path);
+
+// Runs main. Returns its exit code.
+extern int tvm_run(tvmprogram_t* prog);
+
+// Puts the registers and the data table back the way load left them.
+extern void tvm_reset(tvmprogram_t* prog);
+
+// Returns the address of an exported label, or -1.
+extern int64_t tvm_find(tvmprogram_t* prog, const char* name);
+
+// Runs the function at addr until it returns. The registers are
+// kept between calls. Returns w0, or -1 when the call failed.
+extern int tvm_call(tvmprogram_t* prog, int64_t addr);
+
+extern uint64_t tvm_get_register(tvmprogram_t* prog, uint8_t reg);
+extern void     tvm_set_register(tvmprogram_t* prog, uint8_t reg, uint64_t v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  //_Embed_h_
@@ -0,0 +1,185 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Engine.h"
+#include "JitEngine.h"
+#include "Program.h"
+#include "ThreadedEngine.h"
+#include "TraceEngine.h"
+
+int Engine::prepare(Program&)
+{
+    return PS_OK;
+}
+
+void Engine::runTo(Program& prog, uint64_t addr)
+{
+    const ExecInstructions& ins     = getInstructions(prog);
+    size_t                  tinst   = ins.size();
+    const ExecInstruction*  basePtr = ins.data();
+    uint64_t&               curinst = getCurrent(prog);
+
+    while (curinst != addr && curinst < tinst && !hasExited(prog))
+        step(prog, basePtr[curinst++]);
+}
+
+void Engine::rewind(Program&, uint64_t)
+{
+}
+
+bool Engine::runsSource(void) const
+{
+    return true;
+}
+
+const JitCompiler* Engine::getJit(void) const
+{
+    return nullptr;
+}
+
+const Tracer* Engine::getTracer(void) const
+{
+    return nullptr;
+}
+
+void Engine::forceExit(Program& prog, int returnCode)
+{
+    prog.forceExit(returnCode);
+}
+
+void Engine::reportError(Program& prog, const char* msg)
+{
+    prog.reportError("%s", msg);
+}
+
+void Engine::callSymbol(Program& prog, size_t idx)
+{
+    const HostCall& hc = prog.m_image->symbols[idx];
+    if (hc.call != nullptr || prog.bindCall(idx, nullptr))
+        prog.callHost(hc.call, hc.abi);
+}
+
+void Engine::derefRegister(Program& prog, uint64_t reg, uint32_t flags, uint8_t* ptr)
+{
+    prog.derefRegister(reg, flags, ptr);
+}
+
+void Engine::getEntryPoints(const Program& prog, std::vector<uint64_t>& dest)
+{
+    prog.getEntryPoints(dest);
+}
+
+class TableEngine : public Engine
+{
+public:
+    const char* getName(void) const
+    {
+        return "table";
+    }
+
+    void execute(Program& prog)
+    {
+        const ExecInstructions& ins     = getInstructions(prog);
+        size_t                  tinst   = ins.size();
+        const ExecInstruction*  basePtr = ins.data();
+        uint64_t&               curinst = getCurrent(prog);
+
+        while (curinst < tinst && !hasExited(prog))
+        {
+            const ExecInstruction& inst = basePtr[curinst++];
+            if (inst.op > OP_BEG && inst.op < OP_MAX)
+                step(prog, inst);
+        }
+    }
+};
+
+template <typename T>
+static Engine* createEngine(void)
+{
+    return new T();
+}
+
+static const EngineInfo Engines[] = {
+    {
+        "table",
+        "portable function table dispatch",
+        createEngine<TableEngine>,
+    },
+    {
+        "threaded",
+        "computed goto dispatch, the default when supported",
+#ifdef TVM_COMPUTED_GOTO
+        createEngine<ThreadedEngine>,
+#else
+        nullptr,
+#endif
+    },
+    {
+        "jit",
+        "x86-64 template compiler, interprets what it cannot compile",
+#ifdef TVM_JIT
+        createEngine<JitEngine>,
+#else
+        nullptr,
+#endif
+    },
+    {
+        "trace",
+        "computed goto dispatch that compiles hot loops",
+#ifdef TVM_TRACE
+        createEngine<TraceEngine>,
+#else
+        nullptr,
+#endif
+    },
+};
+
+const size_t EngineCount = sizeof(Engines) / sizeof(Engines[0]);
+
+size_t GetEngineCount(void)
+{
+    return EngineCount;
+}
+
+const EngineInfo& GetEngineInfo(size_t idx)
+{
+    return Engines[idx < EngineCount ? idx : 0];
+}
+
+const EngineInfo* FindEngine(const str_t& name)
+{
+    size_t i;
+    for (i = 0; i < EngineCount; ++i)
+    {
+        if (name == Engines[i].name)
+            return &Engines[i];
+    }
+    return nullptr;
+}
+
+Engine* CreateDefaultEngine(void)
+{
+#ifdef TVM_COMPUTED_GOTO
+    return new ThreadedEngine();
+#else
+    return new TableEngine();
+#endif
+}
@@ -0,0 +1,148 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Engine_h_
+#define _Engine_h_
+
+#include <vector>
+#include "Declarations.h"
+
+// Labels as values is a GNU extension. When it is not
+// available the table based dispatch is used instead.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(TVM_NO_COMPUTED_GOTO)
+#define TVM_COMPUTED_GOTO 1
+#endif
+
+class Program;
+class DataTable;
+class ArrayStack;
+class OutputBuffer;
+class JitCompiler;
+class Tracer;
+struct ProgramImage;
+
+// Runs a program that has already been loaded. Program owns the
+// image (instructions, data table and resolved symbols) and the
+// machine state, an engine decides how the instructions are
+// executed and owns whatever it builds to do so, compiled code
+// for instance. The protected functions are the only access
+// engines have to a program, those outside of libtvm included,
+// so that none of them needs to subclass or befriend Program.
+class Engine
+{
+public:
+    virtual ~Engine()
+    {
+    }
+
+    virtual const char* getName(void) const = 0;
+
+    // Called once the image has been loaded, before the first launch.
+    virtual int prepare(Program& prog);
+
+    // Runs from the current instruction until the program exits.
+    virtual void execute(Program& prog) = 0;
+
+    // Runs until the instruction at addr is the next one to execute
+    // or the program exits. By default the source instructions are
+    // stepped through with the program's handlers.
+    virtual void runTo(Program& prog, uint64_t addr);
+
+    // Called when the program is about to start again from addr
+    // with empty stacks, by launch, call and reset.
+    virtual void rewind(Program& prog, uint64_t addr);
+
+    // False for an engine that only runs the packed code. The image
+    // it loads does not keep the source instructions then, and an
+    // engine that needs them cannot run it.
+    virtual bool runsSource(void) const;
+
+    // Returns null unless the engine compiles functions.
+    virtual const JitCompiler* getJit(void) const;
+
+    // Returns null unless the engine compiles traces.
+    virtual const Tracer* getTracer(void) const;
+
+protected:
+    // The accessors are inline, see the end of Program.h.
+    static const ProgramImage&     getImage(const Program& prog);
+    static const ExecInstructions& getInstructions(const Program& prog);
+    static DataTable&              getDataTable(Program& prog);
+    static Registers&              getRegisters(Program& prog);
+    static ArrayStack&             getCallStack(Program& prog);
+    static ArrayStack&             getStack(Program& prog);
+    static OutputBuffer&           getOutput(Program& prog);
+
+    // The PF_* flags that a cmp sets, and the operands it
+    // records instead when the image uses lazy flags.
+    static uint32_t& getFlags(Program& prog);
+    static int64_t*  getCompare(Program& prog);
+    static bool      hasLazyFlags(const Program& prog);
+
+    // w0 as the last ret left it.
+    static int32_t& getReturn(Program& prog);
+
+    // The index of the next instruction. It is out of
+    // range once the program has exited.
+    static uint64_t& getCurrent(Program& prog);
+    static bool      hasExited(const Program& prog);
+
+    // Stops the program where it is, without changing the return code.
+    static void stop(Program& prog);
+
+    // Stops the program with returnCode, as a run time error does.
+    static void forceExit(Program& prog, int returnCode);
+    static void reportError(Program& prog, const char* msg);
+
+    // Calls the host function that string idx names, binding it
+    // first when the image was loaded with lazy binding.
+    static void callSymbol(Program& prog, size_t idx);
+
+    // Loads r(reg) from ptr with the width that flags select.
+    static void derefRegister(Program& prog, uint64_t reg, uint32_t flags, uint8_t* ptr);
+
+    // main and every exported label.
+    static void getEntryPoints(const Program& prog, std::vector<uint64_t>& dest);
+
+    // Executes a single instruction with the program's handlers.
+    static void step(Program& prog, const ExecInstruction& inst);
+};
+
+typedef Engine* (*EngineFactory)(void);
+
+struct EngineInfo
+{
+    const char*   name;
+    const char*   description;
+    EngineFactory create;  // null when the engine is not part of this build
+};
+
+// Every engine known to tvm, in the order they are listed by tvm -h.
+extern size_t            GetEngineCount(void);
+extern const EngineInfo& GetEngineInfo(size_t idx);
+
+// Returns null when there is no engine called name.
+extern const EngineInfo* FindEngine(const str_t& name);
+
+// The fastest interpreter that is available in this build.
+extern Engine* CreateDefaultEngine(void);
+
+#endif  //_Engine_h_
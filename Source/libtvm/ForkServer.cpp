@@ -0,0 +1,135 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "ForkServer.h"
+#include <stdio.h>
+#include "Program.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Reads one line from fd into dest without buffering past it, so
+// nothing meant for a run is consumed when control is stdin.
+static bool ReadRequest(int fd, str_t& dest)
+{
+    dest.clear();
+
+    char    ch;
+    ssize_t br;
+    while ((br = read(fd, &ch, 1)) == 1 && ch != '\n')
+    {
+        if (ch != '\r')
+            dest.push_back(ch);
+    }
+    return br == 1 || !dest.empty();
+}
+
+static bool Redirect(const str_t& path, int flags, int target)
+{
+    int fd = open(path.c_str(), flags, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "failed to open '%s'\n", path.c_str());
+        return false;
+    }
+
+    bool ok = dup2(fd, target) != -1;
+    close(fd);
+    return ok;
+}
+
+static int RunChild(Program& prog, const str_t& input, const str_t& output, bool resume)
+{
+    if (!input.empty() && !Redirect(input, O_RDONLY, STDIN_FILENO))
+        return 1;
+    if (!output.empty() && !Redirect(output, O_WRONLY | O_CREAT | O_TRUNC, STDOUT_FILENO))
+        return 1;
+
+    int rc = resume ? prog.resume() : prog.launch();
+    fflush(stdout);
+    return rc;
+}
+
+int RunForkServer(Program& prog, const str_t& control, bool resume)
+{
+    int fd = STDIN_FILENO;
+    if (control != "-")
+    {
+        fd = open(control.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            printf("failed to open the control file '%s'\n", control.c_str());
+            return PS_ERROR;
+        }
+    }
+
+    str_t line;
+    while (ReadRequest(fd, line) && !line.empty())
+    {
+        size_t sp    = line.find(' ');
+        str_t  input = line.substr(0, sp), output;
+        if (sp != str_t::npos && (sp = line.find_first_not_of(' ', sp)) != str_t::npos)
+            output = line.substr(sp);
+
+        if (input == "-")
+            input = fd == STDIN_FILENO ? "/dev/null" : "";
+
+        // Anything buffered now would be written by the child as well.
+        fflush(stdout);
+
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            printf("fork failed\n");
+            break;
+        }
+        if (pid == 0)
+            _exit(RunChild(prog, input, output, resume) & 0xFF);
+
+        int status = 0, rc = -1;
+        if (waitpid(pid, &status, 0) == pid)
+        {
+            if (WIFEXITED(status))
+                rc = WEXITSTATUS(status);
+            else if (WIFSIGNALED(status))
+                rc = 128 + WTERMSIG(status);
+        }
+
+        printf("%d\n", rc);
+        fflush(stdout);
+    }
+
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return PS_OK;
+}
+
+#else
+
+int RunForkServer(Program&, const str_t&, bool)
+{
+    printf("the fork server is not available on this platform\n");
+    return PS_ERROR;
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _ForkServer_h_
+#define _ForkServer_h_
+
+#include "Declarations.h"
+
+class Program;
+
+// Runs a loaded program once per request read from control, a path
+// or "-" for stdin. Each request is a line
+//
+//    <input> [<output>]
+//
+// naming the file the run reads as stdin and the file it writes
+// stdout to. "-" as input keeps stdin, or uses an empty input when
+// control is stdin. Without an output the run writes to stdout.
+//
+// Every run is a fork of this process, so the decoded code, bound
+// modules, compiled code and data table are shared copy on write,
+// and each run starts from the same state. With resume set runs
+// continue from the current instruction, see Program::resume,
+// otherwise main is launched. After each run a line with its exit
+// code is written to stdout, or 128 plus the signal that ended it.
+// Returns when control ends or an empty line is read.
+//
+// Only available where fork is, elsewhere it reports an error.
+extern int RunForkServer(Program& prog, const str_t& control, bool resume);
+
+#endif  //_ForkServer_h_
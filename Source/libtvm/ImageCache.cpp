@@ -0,0 +1,412 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "ImageCache.h"
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "BlockReader.h"
+#include "MemoryStream.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define tvm_mkdir(path) _mkdir(path)
+#define tvm_getpid() _getpid()
+#else
+#include <unistd.h>
+#define tvm_mkdir(path) mkdir(path, 0755)
+#define tvm_getpid() getpid()
+#endif
+
+const uint32_t CacheMagic = 0x434D5654;  // TVMC
+
+// The header is followed by what the loader needs besides the code,
+// then the packed code at an 8 byte aligned offset, then the source
+// instructions when the file has them. The checksum covers every byte
+// before the code but its own, the code is run as it is once the
+// checksum and the key match.
+const size_t CacheCodeAt     = 32;
+const size_t CacheLengthAt   = 40;
+const size_t CacheChecksumAt = 48;
+const size_t CacheHeaderSize = 56;
+
+// Set in the header's flags when the source instructions follow the code
+const uint32_t CacheHasSource = 1;
+
+#ifdef TVM_PACKED_SOA
+const uint32_t CachePacking = 0x8000;
+#else
+const uint32_t CachePacking = 0;
+#endif
+
+// Changes with the op code tables and the packed record
+const uint32_t CacheLayout = ((uint32_t)OP_MAX << 24) |
+                             ((uint32_t)MOP_MAX << 16) |
+                             CachePacking |
+                             (uint32_t)sizeof(PackedInstruction);
+
+uint64_t HashBytes(const void* src, size_t len, uint64_t seed)
+{
+    const uint8_t* ptr = (const uint8_t*)src;
+    uint64_t       h   = seed;
+
+    size_t i;
+    for (i = 0; i < len; ++i)
+    {
+        h ^= (uint64_t)ptr[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+str_t GetImageCachePath(uint64_t hash)
+{
+    str_t       dir;
+    const char* env = getenv("XDG_CACHE_HOME");
+    if (env != nullptr && *env != 0)
+        dir = env;
+    else
+    {
+#ifdef _WIN32
+        env = getenv("LOCALAPPDATA");
+#else
+        env = getenv("HOME");
+#endif
+        if (env == nullptr || *env == 0)
+            return str_t();
+
+        dir = env;
+#ifndef _WIN32
+        dir += "/.cache";
+#endif
+    }
+    dir += "/toyvm/";
+
+    char name[32];
+    snprintf(name, 32, "%016llx.tvmc", (unsigned long long)hash);
+    return dir + name;
+}
+
+static void WriteStrings(MemoryStream& dest, const strvec_t& src)
+{
+    dest.write32((uint32_t)src.size());
+    for (const str_t& str : src)
+    {
+        dest.write32((uint32_t)str.size());
+        dest.writeString(str.c_str(), str.size());
+    }
+}
+
+static bool ReadStrings(BlockReader& reader, strvec_t& dest)
+{
+    uint32_t n = 0, i, len;
+    reader.read(&n, 4);
+    dest.reserve(n);
+
+    for (i = 0; i < n; ++i)
+    {
+        len = 0;
+        reader.read(&len, 4);
+        if (reader.tell() + len + 1 > reader.size())
+            return false;
+
+        dest.push_back(str_t((const char*)reader.ptr() + reader.tell(), len));
+        reader.offset((int64_t)len + 1);
+    }
+    return !reader.eof();
+}
+
+// A source instruction as it is stored after the code
+struct TVMInstruction
+{
+    uint8_t  op;
+    uint8_t  argc;
+    uint16_t flags;
+    uint16_t index;
+    uint16_t reserved;
+    uint64_t argv[INS_ARG];
+};
+
+static void WriteSource(MemoryStream& dest, const ExecInstructions& src)
+{
+    for (const ExecInstruction& ins : src)
+    {
+        TVMInstruction rec = {};
+        rec.op             = ins.op;
+        rec.argc           = ins.argc;
+        rec.flags          = ins.flags;
+        rec.index          = ins.index;
+        rec.argv[0]        = ins.argv[0];
+        rec.argv[1]        = ins.argv[1];
+        rec.argv[2]        = ins.argv[2];
+        dest.writeBytes(&rec, sizeof(TVMInstruction));
+    }
+}
+
+static void ReadSource(const uint8_t* src, size_t n, ExecInstructions& dest)
+{
+    dest.resize(n);
+
+    size_t i;
+    for (i = 0; i < n; ++i)
+    {
+        TVMInstruction rec;
+        memcpy(&rec, src + i * sizeof(TVMInstruction), sizeof(TVMInstruction));
+
+        ExecInstruction& exec = dest[i];
+        exec                  = {};
+        exec.op               = rec.op;
+        exec.argc             = rec.argc;
+        exec.flags            = rec.flags;
+        exec.index            = rec.index;
+        exec.argv[0]          = rec.argv[0];
+        exec.argv[1]          = rec.argv[1];
+        exec.argv[2]          = rec.argv[2];
+    }
+}
+
+bool IsImageCacheEnabled(void)
+{
+    const char* env = getenv("TVM_NO_CACHE");
+    return env == nullptr || *env == 0 || strcmp(env, "0") == 0;
+}
+
+int ReadImageCache(const str_t& path, uint64_t hash, size_t size, bool source, CachedImage& dest)
+{
+    // BlockReader reports a missing file, a cold cache is not an error.
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) != 0)
+        return PS_ERROR;
+
+    // Kept open by dest, its code is read from the mapping.
+    std::unique_ptr<BlockReader> file(new BlockReader(path.c_str()));
+
+    BlockReader& reader = *file;
+    if (reader.eof() || reader.size() < CacheHeaderSize)
+        return PS_ERROR;
+
+    uint32_t magic = 0, version = 0, layout = 0, flags = 0;
+    uint64_t fhash = 0, fsize = 0, codeAt = 0, length = 0, checksum = 0;
+
+    reader.read(&magic, 4);
+    reader.read(&version, 4);
+    reader.read(&layout, 4);
+    reader.read(&flags, 4);
+    reader.read(&fhash, 8);
+    reader.read(&fsize, 8);
+    reader.read(&codeAt, 8);
+    reader.read(&length, 8);
+    reader.read(&checksum, 8);
+
+    if (magic != CacheMagic ||
+        version != TVM_CACHE_VERSION ||
+        layout != CacheLayout ||
+        fhash != hash ||
+        fsize != (uint64_t)size ||
+        length != (uint64_t)reader.size() ||
+        codeAt < CacheHeaderSize ||
+        codeAt > length ||
+        codeAt % 8 != 0)
+        return PS_ERROR;
+
+    // The engine that asked needs instructions the file does not have.
+    if (source && (flags & CacheHasSource) == 0)
+        return PS_ERROR;
+
+    uint64_t sum = HashBytes(reader.ptr(), CacheChecksumAt, TVM_HASH_SEED);
+    sum          = HashBytes(reader.ptr() + CacheHeaderSize, (size_t)codeAt - CacheHeaderSize, sum);
+    if (sum != checksum)
+        return PS_ERROR;
+
+    uint64_t fusion[3] = {}, verified = 0;
+    reader.read(&dest.moduleStamp, 8);
+    reader.read(&dest.entry, 8);
+    reader.read(fusion, sizeof(fusion));
+    reader.read(&verified, 8);
+
+    dest.fusion.compareBranch    = (size_t)fusion[0];
+    dest.fusion.incCompareBranch = (size_t)fusion[1];
+    dest.fusion.moveCall         = (size_t)fusion[2];
+    dest.verified                = verified != 0;
+
+    if (!ReadStrings(reader, dest.strings) || !ReadStrings(reader, dest.modules))
+        return PS_ERROR;
+
+    uint32_t n = 0;
+    reader.read(&n, 4);
+    if (n != dest.strings.size() || reader.tell() + (size_t)n * 4 > codeAt)
+        return PS_ERROR;
+
+    dest.providers.resize(n);
+
+    uint32_t i;
+    for (i = 0; i < n; ++i)
+    {
+        int32_t provider = -1;
+        reader.read(&provider, 4);
+        if (provider >= (int32_t)dest.modules.size())
+            return PS_ERROR;
+        dest.providers[i] = (int)provider;
+    }
+
+    n = 0;
+    reader.read(&n, 4);
+    if (reader.tell() + (size_t)n * 4 > codeAt)
+        return PS_ERROR;
+
+    dest.calls.resize(n);
+    for (i = 0; i < n; ++i)
+    {
+        reader.read(&dest.calls[i], 4);
+        if (dest.calls[i] >= dest.strings.size())
+            return PS_ERROR;
+    }
+
+    if (reader.tell() > codeAt)
+        return PS_ERROR;
+
+    const size_t used = dest.code.attach(reader.ptr() + codeAt, reader.size() - (size_t)codeAt);
+    if (used == 0 || dest.entry > dest.code.size())
+        return PS_ERROR;
+
+    // Anything left over means the file is not what it claims to be.
+    const size_t sourceAt = (size_t)codeAt + used;
+    const size_t records  = flags & CacheHasSource ? dest.code.size() : 0;
+    if (reader.size() - sourceAt != records * sizeof(TVMInstruction))
+        return PS_ERROR;
+
+    if (source)
+        ReadSource(reader.ptr() + sourceAt, records, dest.source);
+
+    dest.file = std::move(file);
+    return PS_OK;
+}
+
+static void MakeDirectories(const str_t& path)
+{
+    size_t i;
+    for (i = 1; i < path.size(); ++i)
+    {
+        if (path[i] == '/' || path[i] == '\\')
+            tvm_mkdir(path.substr(0, i).c_str());
+    }
+}
+
+int WriteImageCache(const str_t& path, uint64_t hash, size_t size, const CachedImage& src)
+{
+    if (path.empty())
+        return PS_ERROR;
+
+    const bool source = src.code.size() != 0 && src.source.size() == src.code.size();
+
+    size_t bytes = CacheHeaderSize + 64 + src.code.storedSize();
+    for (const str_t& str : src.strings)
+        bytes += str.size() + 13;
+    for (const str_t& str : src.modules)
+        bytes += str.size() + 5;
+    bytes += src.calls.size() * 4;
+    if (source)
+        bytes += src.source.size() * sizeof(TVMInstruction);
+
+    // Sized once, most of it is the code.
+    MemoryStream dest;
+    dest.reserve(bytes);
+
+    dest.write32(CacheMagic);
+    dest.write32(TVM_CACHE_VERSION);
+    dest.write32(CacheLayout);
+    dest.write32(source ? CacheHasSource : 0);
+    dest.write64(hash);
+    dest.write64((uint64_t)size);
+    dest.write64(0);
+    dest.write64(0);
+    dest.write64(0);
+    dest.write64(src.moduleStamp);
+    dest.write64(src.entry);
+    dest.write64((uint64_t)src.fusion.compareBranch);
+    dest.write64((uint64_t)src.fusion.incCompareBranch);
+    dest.write64((uint64_t)src.fusion.moveCall);
+    dest.write64(src.verified ? 1 : 0);
+
+    WriteStrings(dest, src.strings);
+    WriteStrings(dest, src.modules);
+
+    dest.write32((uint32_t)src.providers.size());
+    for (int provider : src.providers)
+        dest.write32((uint32_t)provider);
+
+    dest.write32((uint32_t)src.calls.size());
+    for (uint32_t call : src.calls)
+        dest.write32(call);
+
+    if (dest.size() % 8 != 0)
+        dest.fill(8 - dest.size() % 8, 0);
+
+    const uint64_t codeAt = (uint64_t)dest.size();
+
+    src.code.write(dest);
+    if (source)
+        WriteSource(dest, src.source);
+
+    const uint64_t length = (uint64_t)dest.size();
+
+    memcpy(dest.ptr() + CacheCodeAt, &codeAt, 8);
+    memcpy(dest.ptr() + CacheLengthAt, &length, 8);
+
+    uint64_t checksum = HashBytes(dest.ptr(), CacheChecksumAt, TVM_HASH_SEED);
+    checksum          = HashBytes(dest.ptr() + CacheHeaderSize, (size_t)codeAt - CacheHeaderSize, checksum);
+    memcpy(dest.ptr() + CacheChecksumAt, &checksum, 8);
+
+    MakeDirectories(path);
+
+    // Unique to each writer, threads of one process included.
+    static std::atomic<unsigned> sequence(0);
+
+    char pid[48];
+    snprintf(pid, 48, ".%d.%u", (int)tvm_getpid(), sequence++);
+    str_t temp = path + pid;
+
+    FILE* fp = fopen(temp.c_str(), "wb");
+    if (!fp)
+        return PS_ERROR;
+
+    size_t bw = fwrite(dest.ptr(), 1, dest.size(), fp);
+    fclose(fp);
+
+    if (bw != dest.size())
+    {
+        remove(temp.c_str());
+        return PS_ERROR;
+    }
+
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(temp.c_str(), path.c_str()) != 0)
+    {
+        remove(temp.c_str());
+        return PS_ERROR;
+    }
+    return PS_OK;
+}
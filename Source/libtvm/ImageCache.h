@@ -0,0 +1,88 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _ImageCache_h_
+#define _ImageCache_h_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "BlockReader.h"
+#include "Declarations.h"
+#include "Lowering.h"
+#include "Packed.h"
+
+// Bump whenever the loader, the verifier, lowering or fusion change
+// what they produce, so files written by an older build are rebuilt.
+const uint32_t TVM_CACHE_VERSION = 4;
+
+typedef std::unique_ptr<BlockReader> CacheFile;
+
+// What Program::load derives from an image that does not depend on
+// where it is loaded. Host calls are stored unbound, providers holds
+// the index of the module that bound each string, or -1, and calls
+// the string index of every host call in the code. The source
+// instructions are only stored for the engines that run them.
+struct CachedImage
+{
+    uint64_t              moduleStamp;
+    uint64_t              entry;
+    FusionStats           fusion;
+    bool                  verified;
+    strvec_t              strings;
+    strvec_t              modules;
+    std::vector<int>      providers;
+    std::vector<uint32_t> calls;
+    PackedCode            code;
+    ExecInstructions      source;
+
+    // The mapped file that ReadImageCache attached code to.
+    CacheFile file;
+};
+
+// 64-bit FNV-1a of len bytes, continuing from seed.
+// Pass TVM_HASH_SEED to start a new hash.
+const uint64_t TVM_HASH_SEED = 0xcbf29ce484222325ULL;
+
+extern uint64_t HashBytes(const void* src, size_t len, uint64_t seed);
+
+// Returns the cache file for an image with the given hash in
+// $XDG_CACHE_HOME/toyvm, or $HOME/.cache/toyvm when it is not set,
+// %LOCALAPPDATA%/toyvm on Windows. It is empty when neither is set.
+extern str_t GetImageCachePath(uint64_t hash);
+
+// Returns true unless $TVM_NO_CACHE is set to something other than 0.
+extern bool IsImageCacheEnabled(void);
+
+// Reads the file written by WriteImageCache. It fails when the file
+// is missing, was written by another build or for another image, is
+// not as long as its header says, or the checksum of everything before
+// the code does not match. The packed code is then run from the mapped
+// file as it is. With source set it also fails when the file has no
+// source instructions.
+extern int ReadImageCache(const str_t& path, uint64_t hash, size_t size, bool source, CachedImage& dest);
+
+// Writes to a temporary file and renames it over path, so a reader
+// never sees a partial file. The directory is created when needed.
+// The source instructions are stored when src has them.
+extern int WriteImageCache(const str_t& path, uint64_t hash, size_t size, const CachedImage& src);
+
+#endif  //_ImageCache_h_
@@ -0,0 +1,741 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Jit.h"
+
+#ifdef TVM_JIT
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include "Assembler.h"
+
+// Register usage in the generated code
+const int REG_FILE = RBX;  // Register*
+const int REG_RT   = R12;  // JitRuntime*
+const int REG_FLAG = R13;  // uint32_t*
+
+typedef Assembler::Label Label;
+
+struct JitFunction
+{
+    uint64_t              entry;
+    std::vector<uint64_t> body;
+    bool                  compilable;
+    Label                 label;
+};
+
+typedef std::vector<JitFunction> JitFunctions;
+
+class JitBuilder
+{
+private:
+    const ExecInstructions& m_ins;
+    uint8_t*                m_data;
+    size_t                  m_dataSize;
+    std::vector<bool>       m_targets;
+    std::vector<Label>      m_local;
+    JitFunctions            m_functions;
+    Assembler               m_asm;
+    Label                   m_exit;
+    Label                   m_end;
+    Label                   m_overflow;
+    bool                    m_lazyFlags;
+
+    static bool isConditional(const ExecInstruction& ins)
+    {
+        return ins.op >= OP_JEQ && ins.op <= OP_JGE;
+    }
+
+    void findTargets(const std::vector<uint64_t>& roots)
+    {
+        const size_t n = m_ins.size();
+        m_targets.assign(n + 1, false);
+
+        std::vector<uint64_t>::const_iterator rit;
+        for (rit = roots.begin(); rit != roots.end(); ++rit)
+        {
+            if (*rit < n)
+                m_targets[(size_t)*rit] = true;
+        }
+
+        ExecInstructions::const_iterator it = m_ins.begin();
+        while (it != m_ins.end())
+        {
+            const ExecInstruction& ins = (*it++);
+
+            uint64_t dest = n;
+            if (ins.flags & IF_INSP)
+            {
+                if (!(ins.flags & IF_REG1))
+                    dest = ins.argv[1];
+            }
+            else if (ins.flags & IF_ADDR)
+                dest = ins.argv[0];
+
+            if (dest < n)
+                m_targets[(size_t)dest] = true;
+        }
+    }
+
+    // A branch can only use the host flags if the program flags
+    // it tests were produced by a cmp in the same straight line
+    // of code. Anything else falls back to the interpreter, unless
+    // lazy flags allow the operands to be reloaded from memory.
+    bool hasCompareSource(size_t i) const
+    {
+        while (i > 0)
+        {
+            if (m_targets[i])
+                return false;
+
+            const ExecInstruction& prev = m_ins[i - 1];
+            if (prev.op == OP_CMP)
+                return true;
+            if (!isConditional(prev))
+                return false;
+            --i;
+        }
+        return false;
+    }
+
+    void findBody(JitFunction& fn)
+    {
+        const size_t n = m_ins.size();
+
+        std::vector<bool>     seen(n, false);
+        std::vector<uint64_t> work;
+        work.push_back(fn.entry);
+        fn.compilable = true;
+
+        while (!work.empty())
+        {
+            uint64_t i = work.back();
+            work.pop_back();
+            if (i >= n || seen[(size_t)i])
+                continue;
+
+            seen[(size_t)i] = true;
+            fn.body.push_back(i);
+
+            const ExecInstruction& ins = m_ins[(size_t)i];
+            switch (ins.op)
+            {
+            case OP_RET:
+                break;
+            case OP_JMP:
+                work.push_back(ins.argv[0]);
+                break;
+            case OP_JEQ:
+            case OP_JNE:
+            case OP_JLT:
+            case OP_JGT:
+            case OP_JLE:
+            case OP_JGE:
+                if (!m_lazyFlags && !hasCompareSource((size_t)i))
+                    fn.compilable = false;
+                work.push_back(ins.argv[0]);
+                work.push_back(i + 1);
+                break;
+            case OP_MOV:
+                if (ins.flags & IF_INSP)
+                {
+                    if (ins.flags & IF_REG1)
+                        fn.compilable = false;
+                    else
+                        work.push_back(ins.argv[1]);
+                }
+                else
+                    work.push_back(i + 1);
+                break;
+            default:
+                work.push_back(i + 1);
+                break;
+            }
+        }
+        std::sort(fn.body.begin(), fn.body.end());
+    }
+
+    JitFunction* findFunction(uint64_t entry)
+    {
+        JitFunctions::iterator it = m_functions.begin();
+        while (it != m_functions.end())
+        {
+            if (it->entry == entry)
+                return &(*it);
+            ++it;
+        }
+        return nullptr;
+    }
+
+    Label target(uint64_t i) const
+    {
+        if (i < m_local.size() && m_local[(size_t)i] != (Label)-1)
+            return m_local[(size_t)i];
+        return m_end;
+    }
+
+    void popSaved(void)
+    {
+        m_asm.addi(RSP, 8);
+        m_asm.pop(R15);
+        m_asm.pop(R14);
+        m_asm.pop(R13);
+        m_asm.pop(R12);
+        m_asm.pop(RBP);
+        m_asm.pop(RBX);
+        m_asm.ret();
+    }
+
+    // void entry(JitRuntime* rt, const void* fn)
+    void emitTrampoline(void)
+    {
+        m_asm.push(RBX);
+        m_asm.push(RBP);
+        m_asm.push(R12);
+        m_asm.push(R13);
+        m_asm.push(R14);
+        m_asm.push(R15);
+        m_asm.subi(RSP, 8);
+        m_asm.store64(RDI, RT_OFFSET(stack), RSP);
+        m_asm.mov(REG_RT, RDI);
+        m_asm.load64(REG_FILE, REG_RT, RT_OFFSET(regs));
+        m_asm.load64(REG_FLAG, REG_RT, RT_OFFSET(flags));
+        m_asm.callr(RSI);
+        popSaved();
+
+        // Unwinds any number of nested calls
+        m_asm.bind(m_exit);
+        m_asm.load64(RSP, REG_RT, RT_OFFSET(stack));
+        popSaved();
+
+        m_asm.bind(m_end);
+        m_asm.store32i(REG_RT, RT_OFFSET(status), 1);
+        m_asm.jmp(m_exit);
+
+        m_asm.bind(m_overflow);
+        m_asm.mov(RDI, REG_RT);
+        m_asm.callm(REG_RT, RT_OFFSET(overflow));
+        m_asm.jmp(m_exit);
+    }
+
+    void emitStatusCheck(void)
+    {
+        m_asm.cmp32i(REG_RT, RT_OFFSET(status), 0);
+        m_asm.jcc(CC_NE, m_exit);
+    }
+
+    void emitExecute(const ExecInstruction& ins)
+    {
+        m_asm.mov(RDI, REG_RT);
+        m_asm.movi(RSI, (uint64_t)(size_t)&ins);
+        m_asm.callm(REG_RT, RT_OFFSET(execute));
+        emitStatusCheck();
+    }
+
+    void emitOperand(int dst, const ExecInstruction& ins, int idx, uint16_t flag)
+    {
+        if (ins.flags & flag)
+            m_asm.load64(dst, REG_FILE, REG_OFFSET(ins.argv[idx]));
+        else
+            m_asm.movi(dst, ins.argv[idx]);
+    }
+
+    void emitCompare(const ExecInstruction& ins)
+    {
+        if (m_lazyFlags)
+        {
+            // The operands are kept for the interpreter, and
+            // the host flags are left for the branches.
+            emitOperand(RAX, ins, 0, IF_REG0);
+            emitOperand(RCX, ins, 1, IF_REG1);
+            m_asm.load64(RDX, REG_RT, RT_OFFSET(compare));
+            m_asm.store64(RDX, 0, RAX);
+            m_asm.store64(RDX, 8, RCX);
+            m_asm.cmp(RAX, RCX);
+            return;
+        }
+
+        // The interpreter tests the sign of the wrapped difference,
+        // so the same is done here rather than a signed compare.
+        emitOperand(RAX, ins, 0, IF_REG0);
+        emitOperand(RCX, ins, 1, IF_REG1);
+        m_asm.sub(RAX, RCX);
+        m_asm.test(RAX, RAX);
+
+        // PF_Z | PF_G << 1 | PF_L << 2, none of these touch the host flags
+        m_asm.setcc(CC_E, RCX);
+        m_asm.setcc(CC_G, RDX);
+        m_asm.setcc(CC_L, RAX);
+        m_asm.movzx8(RAX, RAX);
+        m_asm.movzx8(RCX, RCX);
+        m_asm.movzx8(RDX, RDX);
+        m_asm.lea32(RCX, RCX, RDX, 2);
+        m_asm.lea32(RAX, RCX, RAX, 4);
+        m_asm.store32(REG_FLAG, 0, RAX);
+    }
+
+    void emitBranch(const ExecInstruction& ins)
+    {
+        Label dest = target(ins.argv[0]);
+        if (m_lazyFlags)
+        {
+            // Reloads the operands when the host flags may not
+            // be the ones the last cmp produced.
+            if (!hasCompareSource((size_t)(&ins - m_ins.data())))
+            {
+                m_asm.load64(RDX, REG_RT, RT_OFFSET(compare));
+                m_asm.load64(RAX, RDX, 0);
+                m_asm.load64(RCX, RDX, 8);
+                m_asm.cmp(RAX, RCX);
+            }
+            m_asm.jcc(BranchCondition(ins.op), dest);
+            return;
+        }
+
+        if (ins.op == OP_JNE)
+        {
+            // only the zero flag is cleared, which is not set
+            m_asm.jcc(CC_NE, dest);
+            return;
+        }
+
+        // Skips over the taken path when the condition is false.
+        int inv;
+        switch (ins.op)
+        {
+        case OP_JEQ:
+            inv = CC_NE;
+            break;
+        case OP_JLT:
+            inv = CC_GE;
+            break;
+        case OP_JGT:
+            inv = CC_LE;
+            break;
+        case OP_JLE:
+            inv = CC_G;
+            break;
+        case OP_JGE:
+        default:
+            inv = CC_L;
+            break;
+        }
+
+        // A taken branch clears the flag it tested, which is
+        // the only flag that the compare set.
+        Label skip = m_asm.label();
+        m_asm.jcc(inv, skip);
+        m_asm.store32i(REG_FLAG, 0, 0);
+        m_asm.jmp(dest);
+        m_asm.bind(skip);
+    }
+
+    void emitMove(const ExecInstruction& ins)
+    {
+        if (ins.flags & IF_INSP)
+        {
+            m_asm.jmp(target(ins.argv[1]));
+            return;
+        }
+
+        const int32_t dest = REG_OFFSET(ins.argv[0]);
+        emitOperand(RAX, ins, 1, IF_REG1);
+
+        if (ins.flags & IF_BTEB)
+            m_asm.store8(REG_FILE, dest, RAX);
+        else if (ins.flags & IF_BTEW)
+            m_asm.store16(REG_FILE, dest, RAX);
+        else if (ins.flags & IF_BTEL)
+            m_asm.store32(REG_FILE, dest, RAX);
+        else
+            m_asm.store64(REG_FILE, dest, RAX);
+    }
+
+    void emitCall(const ExecInstruction& ins)
+    {
+        if (ins.flags & IF_SYMU || !(ins.flags & IF_ADDR))
+        {
+            // Host calls use the interpreter's copy of the registers.
+            emitExecute(ins);
+            return;
+        }
+
+        JitFunction* fn = findFunction(ins.argv[0]);
+        if (fn && fn->compilable)
+        {
+            m_asm.inc64(REG_RT, RT_OFFSET(depth));
+            m_asm.cmp64i(REG_RT, RT_OFFSET(depth), MAX_STK);
+            m_asm.jcc(CC_A, m_overflow);
+            m_asm.call(fn->label);
+        }
+        else
+        {
+            m_asm.mov(RDI, REG_RT);
+            m_asm.movi(RSI, ins.argv[0]);
+            m_asm.callm(REG_RT, RT_OFFSET(call));
+            emitStatusCheck();
+        }
+    }
+
+    void emitMath(const ExecInstruction& ins)
+    {
+        if (ins.flags & IF_ADRD)
+        {
+            emitExecute(ins);
+            return;
+        }
+
+        const int32_t dest = REG_OFFSET(ins.argv[0]);
+        if (ins.argc > 2)
+        {
+            emitOperand(RAX, ins, 1, IF_REG1);
+            emitOperand(RCX, ins, 2, IF_REG2);
+        }
+        else
+        {
+            m_asm.load64(RAX, REG_FILE, dest);
+            emitOperand(RCX, ins, 1, IF_REG1);
+        }
+
+        switch (ins.op)
+        {
+        case OP_ADD:
+            m_asm.add(RAX, RCX);
+            break;
+        case OP_SUB:
+            m_asm.sub(RAX, RCX);
+            break;
+        case OP_MUL:
+            m_asm.imul(RAX, RCX);
+            break;
+        case OP_SHR:
+            m_asm.shr(RAX);
+            break;
+        case OP_SHL:
+            m_asm.shl(RAX);
+            break;
+        case OP_DIV:
+        {
+            // The interpreter reports the error and exits.
+            Label ok = m_asm.label();
+            m_asm.test(RCX, RCX);
+            m_asm.jcc(CC_NE, ok);
+            emitExecute(ins);
+            m_asm.jmp(m_exit);
+            m_asm.bind(ok);
+            m_asm.xor32(RDX, RDX);
+            m_asm.div(RCX);
+            break;
+        }
+        default:
+            break;
+        }
+        m_asm.store64(REG_FILE, dest, RAX);
+    }
+
+    void emitReturn(void)
+    {
+        m_asm.movzx16(RAX, REG_FILE, REG_OFFSET(0));
+        m_asm.load64(RCX, REG_RT, RT_OFFSET(ret));
+        m_asm.store32(RCX, 0, RAX);
+        m_asm.dec64(REG_RT, RT_OFFSET(depth));
+        m_asm.jcc(CC_E, m_end);
+        m_asm.addi(RSP, 8);
+        m_asm.ret();
+    }
+
+    void emitInstruction(const ExecInstruction& ins)
+    {
+        switch (ins.op)
+        {
+        case OP_RET:
+            emitReturn();
+            break;
+        case OP_MOV:
+            emitMove(ins);
+            break;
+        case OP_GTO:
+            emitCall(ins);
+            break;
+        case OP_INC:
+            m_asm.inc64(REG_FILE, REG_OFFSET(ins.argv[0]));
+            break;
+        case OP_DEC:
+            m_asm.dec64(REG_FILE, REG_OFFSET(ins.argv[0]));
+            break;
+        case OP_CMP:
+            emitCompare(ins);
+            break;
+        case OP_JMP:
+            m_asm.jmp(target(ins.argv[0]));
+            break;
+        case OP_JEQ:
+        case OP_JNE:
+        case OP_JLT:
+        case OP_JGT:
+        case OP_JLE:
+        case OP_JGE:
+            emitBranch(ins);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_SHR:
+        case OP_SHL:
+            emitMath(ins);
+            break;
+        case OP_ADRP:
+            if ((ins.flags & IF_REG0) && (ins.flags & IF_ADRD) && ins.argv[1] < m_dataSize)
+            {
+                m_asm.movi(RAX, (uint64_t)(size_t)(m_data + ins.argv[1]));
+                m_asm.store64(REG_FILE, REG_OFFSET(ins.argv[0]), RAX);
+            }
+            break;
+        default:
+            // Stack, data and debugging instructions
+            // go through the interpreter's handler.
+            emitExecute(ins);
+            break;
+        }
+    }
+
+    static bool fallsThrough(const ExecInstruction& ins)
+    {
+        switch (ins.op)
+        {
+        case OP_RET:
+        case OP_JMP:
+            return false;
+        case OP_MOV:
+            return (ins.flags & IF_INSP) == 0;
+        default:
+            return true;
+        }
+    }
+
+    void emitFunction(const JitFunction& fn)
+    {
+        const size_t n = m_ins.size();
+        m_local.assign(n, (Label)-1);
+
+        std::vector<uint64_t>::const_iterator it;
+        for (it = fn.body.begin(); it != fn.body.end(); ++it)
+            m_local[(size_t)*it] = m_asm.label();
+
+        m_asm.bind(fn.label);
+        m_asm.subi(RSP, 8);
+
+        // The entry point is not always the first instruction
+        // in the body, so jump to it if needed.
+        if (fn.body.front() != fn.entry)
+            m_asm.jmp(target(fn.entry));
+
+        for (it = fn.body.begin(); it != fn.body.end(); ++it)
+        {
+            const size_t           i   = (size_t)*it;
+            const ExecInstruction& ins = m_ins[i];
+
+            m_asm.bind(m_local[i]);
+            emitInstruction(ins);
+
+            if (fallsThrough(ins) && i + 1 >= n)
+                m_asm.jmp(m_end);
+        }
+    }
+
+public:
+    JitBuilder(const ExecInstructions& ins,
+               uint8_t*                data,
+               size_t                  dataSize,
+               bool                    lazyFlags) :
+        m_ins(ins),
+        m_data(data),
+        m_dataSize(dataSize),
+        m_lazyFlags(lazyFlags)
+    {
+        m_exit     = m_asm.label();
+        m_end      = m_asm.label();
+        m_overflow = m_asm.label();
+    }
+
+    int build(const std::vector<uint64_t>& roots)
+    {
+        findTargets(roots);
+
+        std::vector<uint64_t> entries;
+        std::vector<uint64_t>::const_iterator rit;
+        for (rit = roots.begin(); rit != roots.end(); ++rit)
+        {
+            if (*rit < m_ins.size())
+                entries.push_back(*rit);
+        }
+
+        ExecInstructions::const_iterator it = m_ins.begin();
+        while (it != m_ins.end())
+        {
+            const ExecInstruction& ins = (*it++);
+            if (ins.op == OP_GTO && (ins.flags & (IF_SYMU | IF_ADDR)) == IF_ADDR && ins.argv[0] < m_ins.size())
+                entries.push_back(ins.argv[0]);
+        }
+
+        std::sort(entries.begin(), entries.end());
+        entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+        std::vector<uint64_t>::iterator eit;
+        for (eit = entries.begin(); eit != entries.end(); ++eit)
+        {
+            JitFunction fn;
+            fn.entry = *eit;
+            fn.label = m_asm.label();
+            findBody(fn);
+            m_functions.push_back(fn);
+        }
+
+        emitTrampoline();
+
+        JitFunctions::const_iterator fit;
+        for (fit = m_functions.begin(); fit != m_functions.end(); ++fit)
+        {
+            if (fit->compilable)
+                emitFunction(*fit);
+        }
+
+        return m_asm.resolve() ? (int)PS_OK : (int)PS_ERROR;
+    }
+
+    inline const Assembler& getAssembler(void) const
+    {
+        return m_asm;
+    }
+
+    inline const JitFunctions& getFunctions(void) const
+    {
+        return m_functions;
+    }
+};
+
+JitCompiler::JitCompiler() :
+    m_code(nullptr),
+    m_size(0),
+    m_functions(),
+    m_stats({})
+{
+}
+
+JitCompiler::~JitCompiler()
+{
+    if (m_code)
+        munmap(m_code, m_size);
+}
+
+int JitCompiler::compile(const ExecInstructions&     code,
+                         const std::vector<uint64_t>& entries,
+                         uint8_t*                     data,
+                         size_t                       dataSize,
+                         bool                         lazyFlags)
+{
+    JitBuilder builder(code, data, dataSize, lazyFlags);
+    if (builder.build(entries) != PS_OK)
+    {
+        printf("failed to resolve the generated code\n");
+        return PS_ERROR;
+    }
+
+    const Assembler& as = builder.getAssembler();
+
+    m_size = as.size();
+    m_code = (uint8_t*)mmap(nullptr,
+                            m_size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS,
+                            -1,
+                            0);
+    if (m_code == MAP_FAILED)
+    {
+        m_code = nullptr;
+        printf("failed to allocate executable memory\n");
+        return PS_ERROR;
+    }
+
+    memcpy(m_code, as.data(), m_size);
+    if (mprotect(m_code, m_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        printf("failed to protect executable memory\n");
+        return PS_ERROR;
+    }
+
+    const JitFunctions& functions = builder.getFunctions();
+
+    JitFunctions::const_iterator it;
+    for (it = functions.begin(); it != functions.end(); ++it)
+    {
+        if (it->compilable)
+        {
+            m_functions[it->entry] = as.offset(it->label);
+            m_stats.compiled++;
+        }
+    }
+
+    m_stats.functions = functions.size();
+    m_stats.codeSize  = m_size;
+    return PS_OK;
+}
+
+void JitCompiler::invoke(JitRuntime* rt, uint64_t addr) const
+{
+    FunctionMap::const_iterator it = m_functions.find(addr);
+    if (it == m_functions.end() || !m_code)
+        return;
+
+    // The trampoline is at the start of the code, and it saves the
+    // stack it was entered with. That needs to be restored when
+    // called recursively from the interpreter.
+    void* saved = rt->stack;
+    ((Entry)m_code)(rt, m_code + it->second);
+    rt->stack = saved;
+}
+
+#else
+
+JitCompiler::JitCompiler() :
+    m_code(nullptr),
+    m_size(0),
+    m_functions(),
+    m_stats({})
+{
+}
+
+JitCompiler::~JitCompiler()
+{
+}
+
+int JitCompiler::compile(const ExecInstructions&, const std::vector<uint64_t>&, uint8_t*, size_t, bool)
+{
+    return PS_ERROR;
+}
+
+void JitCompiler::invoke(JitRuntime*, uint64_t) const
+{
+}
+
+#endif  // TVM_JIT
@@ -0,0 +1,107 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Jit_h_
+#define _Jit_h_
+
+#include <unordered_map>
+#include <vector>
+#include "Declarations.h"
+
+// The template compiler emits System V x86-64 code.
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(TVM_NO_JIT)
+#define TVM_JIT 1
+#endif
+
+struct JitRuntime;
+
+typedef void (*JitExecute)(JitRuntime* rt, const ExecInstruction* inst);
+typedef void (*JitCall)(JitRuntime* rt, uint64_t addr);
+typedef void (*JitOverflow)(JitRuntime* rt);
+
+// Shared state between the generated code and the program.
+// The generated code keeps a pointer to this in r12, the
+// register file in rbx and the program flags in r13.
+struct JitRuntime
+{
+    Register*   regs;
+    uint32_t*   flags;
+    int64_t*    compare;  // operands of the last cmp with lazy flags
+    int32_t*    ret;
+    uint64_t    depth;   // current call depth
+    void*       stack;   // native stack pointer at entry
+    int32_t     status;  // non zero when execution has to stop
+    void*       user;
+    JitExecute  execute;   // runs a single instruction
+    JitCall     call;      // interprets a function
+    JitOverflow overflow;  // reports a call depth error
+};
+
+struct JitStats
+{
+    size_t functions;
+    size_t compiled;
+    size_t codeSize;
+};
+
+class JitCompiler
+{
+public:
+    typedef void (*Entry)(JitRuntime* rt, const void* fn);
+    typedef std::unordered_map<uint64_t, size_t> FunctionMap;
+
+private:
+    uint8_t*    m_code;
+    size_t      m_size;
+    FunctionMap m_functions;
+    JitStats    m_stats;
+
+public:
+    JitCompiler();
+    ~JitCompiler();
+
+    // Compiles every function in the instruction list that can be
+    // compiled. A function is the set of instructions reachable from
+    // one of the entry points or from the target of a bl instruction.
+    // The functions that cannot be compiled are left to the interpreter
+    // through JitRuntime::call. With lazyFlags a cmp stores its
+    // operands in JitRuntime::compare instead of the program flags.
+    int compile(const ExecInstructions&      code,
+                const std::vector<uint64_t>& entries,
+                uint8_t*                     data,
+                size_t                       dataSize,
+                bool                         lazyFlags);
+
+    // Runs the compiled function at addr.
+    void invoke(JitRuntime* rt, uint64_t addr) const;
+
+    inline bool isCompiled(uint64_t addr) const
+    {
+        return m_functions.find(addr) != m_functions.end();
+    }
+
+    inline const JitStats& getStats(void) const
+    {
+        return m_stats;
+    }
+};
+
+#endif  //_Jit_h_
@@ -0,0 +1,196 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "JitEngine.h"
+#include "Program.h"
+
+#ifdef TVM_JIT
+
+JitEngine::JitEngine() :
+    m_jit(nullptr),
+    m_runtime({}),
+    m_program(nullptr)
+{
+}
+
+JitEngine::~JitEngine()
+{
+    delete m_jit;
+}
+
+const char* JitEngine::getName(void) const
+{
+    return "jit";
+}
+
+int JitEngine::prepare(Program& prog)
+{
+    compile(prog);
+    return PS_OK;
+}
+
+const JitCompiler* JitEngine::getJit(void) const
+{
+    return m_jit;
+}
+
+void JitEngine::compile(Program& prog)
+{
+    // Functions that fail to compile are interpreted,
+    // so an error here is not fatal.
+    delete m_jit;
+    m_jit = new JitCompiler();
+
+    DataTable& data = getDataTable(prog);
+
+    std::vector<uint64_t> entries;
+    getEntryPoints(prog, entries);
+    m_jit->compile(getInstructions(prog),
+                   entries,
+                   data.ptr(),
+                   data.capacity(),
+                   hasLazyFlags(prog));
+}
+
+void JitEngine::prepareRuntime(Program& prog)
+{
+    m_program          = &prog;
+    m_runtime.regs     = getRegisters(prog);
+    m_runtime.flags    = &getFlags(prog);
+    m_runtime.compare  = getCompare(prog);
+    m_runtime.ret      = &getReturn(prog);
+    m_runtime.status   = 0;
+    m_runtime.user     = this;
+    m_runtime.execute  = jitExecute;
+    m_runtime.call     = jitCall;
+    m_runtime.overflow = jitOverflow;
+}
+
+void JitEngine::execute(Program& prog)
+{
+    if (!m_jit)
+        compile(prog);
+
+    prepareRuntime(prog);
+
+    ArrayStack& callStack = getCallStack(prog);
+    uint64_t&   curinst   = getCurrent(prog);
+
+    // A program resumed inside a call is interpreted until
+    // it is back in main, the calls it makes are still compiled.
+    if (callStack.size() == 1 && m_jit->isCompiled(curinst))
+    {
+        m_runtime.depth = callStack.size();
+        m_jit->invoke(&m_runtime, curinst);
+        if (m_runtime.status != 0)
+            stop(prog);
+    }
+    else
+        interpret(prog, 1);
+}
+
+void JitEngine::interpret(Program& prog, size_t base)
+{
+    const ExecInstructions& ins       = getInstructions(prog);
+    size_t                  tinst     = ins.size();
+    const ExecInstruction*  basePtr   = ins.data();
+    uint64_t&               curinst   = getCurrent(prog);
+    ArrayStack&             callStack = getCallStack(prog);
+
+    while (curinst < tinst && !hasExited(prog) && callStack.size() >= base)
+    {
+        const ExecInstruction& inst = basePtr[curinst++];
+
+        if (inst.op == OP_GTO && (inst.flags & (IF_SYMU | IF_ADDR)) == IF_ADDR && m_jit->isCompiled(inst.argv[0]))
+        {
+            // The compiled function only tracks the call depth,
+            // it returns here rather than through the call stack.
+            m_runtime.depth = callStack.size() + 1;
+            if (m_runtime.depth > MAX_STK)
+            {
+                reportError(prog, "maximum number of branches exceeded.");
+                forceExit(prog, -1);
+            }
+            else
+            {
+                m_jit->invoke(&m_runtime, inst.argv[0]);
+                if (m_runtime.status != 0)
+                    stop(prog);
+            }
+        }
+        else
+            step(prog, inst);
+    }
+}
+
+void JitEngine::jitExecute(JitRuntime* rt, const ExecInstruction* inst)
+{
+    Program& prog = *((JitEngine*)rt->user)->m_program;
+
+    step(prog, *inst);
+    rt->status = hasExited(prog) ? 1 : 0;
+}
+
+void JitEngine::jitCall(JitRuntime* rt, uint64_t addr)
+{
+    JitEngine*  engine = (JitEngine*)rt->user;
+    Program&    prog   = *engine->m_program;
+    ArrayStack& stack  = getCallStack(prog);
+
+    const uint64_t depth = rt->depth;
+    const uint32_t saved = stack.size();
+
+    // Bring the call stack up to the depth of the compiled
+    // code so that the interpreted return lands back here.
+    while (stack.size() < depth)
+        stack.push(0);
+    stack.push(0);
+
+    if (stack.size() > MAX_STK)
+    {
+        reportError(prog, "maximum number of branches exceeded.");
+        forceExit(prog, -1);
+    }
+    else
+    {
+        getCurrent(prog) = addr;
+        engine->interpret(prog, stack.size());
+        if (getCurrent(prog) >= getInstructions(prog).size())
+            stop(prog);
+    }
+
+    while (stack.size() > saved)
+        stack.pop();
+
+    rt->depth  = depth;
+    rt->status = hasExited(prog) ? 1 : 0;
+}
+
+void JitEngine::jitOverflow(JitRuntime* rt)
+{
+    Program& prog = *((JitEngine*)rt->user)->m_program;
+
+    reportError(prog, "maximum number of branches exceeded.");
+    forceExit(prog, -1);
+    rt->status = 1;
+}
+
+#endif  // TVM_JIT
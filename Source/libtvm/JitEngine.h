@@ -0,0 +1,61 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _JitEngine_h_
+#define _JitEngine_h_
+
+#include "Engine.h"
+#include "Jit.h"
+
+#ifdef TVM_JIT
+
+// Runs the functions JitCompiler could compile as native code
+// and interprets the rest with the program's handlers.
+class JitEngine : public Engine
+{
+private:
+    JitCompiler* m_jit;
+    JitRuntime   m_runtime;
+    Program*     m_program;
+
+    void compile(Program& prog);
+    void prepareRuntime(Program& prog);
+    void interpret(Program& prog, size_t base);
+
+    static void jitExecute(JitRuntime* rt, const ExecInstruction* inst);
+    static void jitCall(JitRuntime* rt, uint64_t addr);
+    static void jitOverflow(JitRuntime* rt);
+
+public:
+    JitEngine();
+    ~JitEngine();
+
+    const char* getName(void) const;
+
+    int  prepare(Program& prog);
+    void execute(Program& prog);
+
+    const JitCompiler* getJit(void) const;
+};
+
+#endif  // TVM_JIT
+
+#endif  //_JitEngine_h_
@@ -0,0 +1,379 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Lowering.h"
+#include <vector>
+#include "Verifier.h"
+
+// Offsets from the first entry of each math group.
+enum MathForm
+{
+    MF_RRR = 0,
+    MF_RRI,
+    MF_RIR,
+    MF_RR,
+    MF_RI,
+};
+
+static uint8_t getMathBase(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_ADD:
+        return MOP_ADD_RRR;
+    case OP_SUB:
+        return MOP_SUB_RRR;
+    case OP_MUL:
+        return MOP_MUL_RRR;
+    case OP_DIV:
+        return MOP_DIV_RRR;
+    case OP_SHR:
+        return MOP_SHR_RRR;
+    case OP_SHL:
+        return MOP_SHL_RRR;
+    default:
+        return OP_BEG;
+    }
+}
+
+static bool foldConstant(uint8_t op, uint64_t b, uint64_t c, uint64_t& res)
+{
+    switch (op)
+    {
+    case OP_ADD:
+        res = b + c;
+        return true;
+    case OP_SUB:
+        res = b - c;
+        return true;
+    case OP_MUL:
+        res = b * c;
+        return true;
+    case OP_DIV:
+        if (c == 0)
+            return false;
+        res = b / c;
+        return true;
+    case OP_SHR:
+        res = b >> c;
+        return true;
+    case OP_SHL:
+        res = b << c;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void lowerMath(ExecInstruction& ins)
+{
+    // Only add reads through an address, the other handlers
+    // treat its operands as plain values.
+    if (ins.op == OP_ADD && ins.argc > 2 && (ins.flags & IF_ADRD))
+        return;
+
+    const uint8_t base = getMathBase(ins.op);
+    if (base == OP_BEG)
+        return;
+
+    if (ins.argc > 2)
+    {
+        const bool rb = (ins.flags & IF_REG1) != 0;
+        const bool rc = (ins.flags & IF_REG2) != 0;
+
+        if (rb && rc)
+            ins.op = base + MF_RRR;
+        else if (rb)
+        {
+            if (ins.op == OP_DIV && ins.argv[2] == 0)
+                return;
+            ins.op = base + MF_RRI;
+        }
+        else if (rc)
+            ins.op = base + MF_RIR;
+        else
+        {
+            uint64_t res;
+            if (foldConstant(ins.op, ins.argv[1], ins.argv[2], res))
+            {
+                ins.op      = MOP_MOV_RI;
+                ins.argv[1] = res;
+                ins.argv[2] = 0;
+            }
+        }
+    }
+    else
+    {
+        if (ins.flags & IF_REG1)
+            ins.op = base + MF_RR;
+        else
+        {
+            if (ins.op == OP_DIV && ins.argv[1] == 0)
+                return;
+            ins.op = base + MF_RI;
+        }
+    }
+}
+
+static void lowerMove(ExecInstruction& ins)
+{
+    const bool reg = (ins.flags & IF_REG1) != 0;
+
+    if (ins.flags & IF_INSP)
+        ins.op = reg ? MOP_MOV_PR : MOP_MOV_PI;
+    else if (ins.flags & IF_BTEB)
+        ins.op = reg ? MOP_MOV_RR8 : MOP_MOV_RI8;
+    else if (ins.flags & IF_BTEW)
+        ins.op = reg ? MOP_MOV_RR16 : MOP_MOV_RI16;
+    else if (ins.flags & IF_BTEL)
+        ins.op = reg ? MOP_MOV_RR32 : MOP_MOV_RI32;
+    else
+        ins.op = reg ? MOP_MOV_RR : MOP_MOV_RI;
+}
+
+static void lowerCompare(ExecInstruction& ins)
+{
+    const bool ra = (ins.flags & IF_REG0) != 0;
+    const bool rb = (ins.flags & IF_REG1) != 0;
+
+    if (ra && rb)
+        ins.op = MOP_CMP_RR;
+    else if (ra)
+        ins.op = MOP_CMP_RI;
+    else if (rb)
+        ins.op = MOP_CMP_IR;
+}
+
+static void lowerCall(ExecInstruction& ins)
+{
+    // A symbol is either bound at load time or
+    // bound when the call is first executed.
+    if (ins.flags & IF_SYMU)
+        ins.op = MOP_CALL_SYM;
+    else if (ins.flags & IF_ADDR)
+        ins.op = MOP_CALL_ADR;
+}
+
+uint8_t GetVerifiedOp(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_ADRP:
+        return MOP_ADRP_V;
+    case OP_STR:
+        return MOP_STR_V;
+    case OP_LDR:
+        return MOP_LDR_V;
+    case OP_LDRS:
+        return MOP_LDRS_V;
+    case OP_STRS:
+        return MOP_STRS_V;
+    case OP_STP:
+        return MOP_STP_V;
+    case OP_LDP:
+        return MOP_LDP_V;
+    default:
+        return op;
+    }
+}
+
+void LowerInstructions(const ExecInstructions& src,
+                       ExecInstructions&       dest,
+                       size_t                  dataSize)
+{
+    dest.resize(0);
+    dest.reserve(src.size());
+
+    ExecInstructions::const_iterator it = src.begin(), end = src.end();
+    while (it != end)
+    {
+        const ExecInstruction& source = (*it++);
+
+        ExecInstruction ins = source;
+        switch (ins.op)
+        {
+        case OP_MOV:
+            lowerMove(ins);
+            break;
+        case OP_GTO:
+            lowerCall(ins);
+            break;
+        case OP_CMP:
+            lowerCompare(ins);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_SHR:
+        case OP_SHL:
+            lowerMath(ins);
+            break;
+        case OP_PRG:
+            ins.op = (ins.flags & IF_REG0) ? MOP_PRG_R : MOP_PRG_I;
+            break;
+        default:
+            break;
+        }
+
+        // Only what is left of the checked ops, a div that was not
+        // given a specialized form for instance, has a variant.
+        if (ins.op == source.op && GetVerifiedOp(ins.op) != ins.op && VerifyInstruction(source, dataSize))
+            ins.op = GetVerifiedOp(ins.op);
+        dest.push_back(ins);
+    }
+}
+
+static bool findBranchTargets(const ExecInstructions&      code,
+                              const std::vector<uint64_t>& entries,
+                              std::vector<bool>&           targets)
+{
+    targets.assign(code.size() + 1, false);
+
+    std::vector<uint64_t>::const_iterator eit;
+    for (eit = entries.begin(); eit != entries.end(); ++eit)
+    {
+        if (*eit < code.size())
+            targets[(size_t)*eit] = true;
+    }
+
+    ExecInstructions::const_iterator it = code.begin(), end = code.end();
+    while (it != end)
+    {
+        const ExecInstruction& ins = (*it++);
+
+        uint64_t dest = code.size();
+        if (ins.flags & IF_INSP)
+        {
+            // mov pc, r(n) can land anywhere.
+            if (ins.flags & IF_REG1)
+                return false;
+            dest = ins.argv[1];
+        }
+        else if (ins.flags & IF_ADDR)
+            dest = ins.argv[0];
+
+        if (dest < code.size())
+            targets[(size_t)dest] = true;
+    }
+    return true;
+}
+
+static bool isConditionalBranch(const ExecInstruction& ins)
+{
+    return ins.op >= OP_JEQ && ins.op <= OP_JGE && (ins.flags & IF_ADDR) != 0;
+}
+
+static bool fuseCompareBranch(ExecInstruction&       cmp,
+                              const ExecInstruction& br,
+                              uint8_t                baseRR,
+                              uint8_t                baseRI)
+{
+    uint8_t cond = br.op - OP_JEQ;
+    if (cmp.op == MOP_CMP_RR)
+        cmp.op = baseRR + cond;
+    else if (cmp.op == MOP_CMP_RI)
+        cmp.op = baseRI + cond;
+    else
+        return false;
+
+    cmp.argv[2] = br.argv[0];
+    return true;
+}
+
+static bool fuseMoveCall(ExecInstruction& mov, const ExecInstruction& call)
+{
+    const bool imm = mov.op == MOP_MOV_RI;
+    if (mov.op != MOP_MOV_RR && !imm)
+        return false;
+
+    if (call.op == MOP_CALL_SYM)
+    {
+        mov.op      = imm ? MOP_MOV_RI_CALL_SYM : MOP_MOV_RR_CALL_SYM;
+        mov.argv[2] = call.argv[0];
+        mov.call    = call.call;
+        mov.abi     = call.abi;
+    }
+    else if (call.op == MOP_CALL_ADR)
+    {
+        mov.op      = imm ? MOP_MOV_RI_CALL_ADR : MOP_MOV_RR_CALL_ADR;
+        mov.argv[2] = call.argv[0];
+    }
+    else
+        return false;
+    return true;
+}
+
+void FuseInstructions(ExecInstructions& code, const std::vector<uint64_t>& entries, FusionStats& stats)
+{
+    stats = {};
+
+    std::vector<bool> targets;
+    if (!findBranchTargets(code, entries, targets))
+        return;
+
+    size_t i, n = code.size();
+    for (i = 0; i < n; ++i)
+    {
+        ExecInstruction& a = code[i];
+
+        // inc r(n); cmp r(n), src; b* ADDR
+        if (a.op == OP_INC && i + 2 < n && !targets[i + 1] && !targets[i + 2])
+        {
+            ExecInstruction        cmp = code[i + 1];
+            const ExecInstruction& br  = code[i + 2];
+
+            if (isConditionalBranch(br) && cmp.argv[0] == a.argv[0])
+            {
+                if (fuseCompareBranch(cmp, br, MOP_INC_CMP_JEQ_RR, MOP_INC_CMP_JEQ_RI))
+                {
+                    a.op      = cmp.op;
+                    a.argv[1] = cmp.argv[1];
+                    a.argv[2] = cmp.argv[2];
+                    stats.incCompareBranch++;
+                    i += 2;
+                    continue;
+                }
+            }
+        }
+
+        if (i + 1 >= n || targets[i + 1])
+            continue;
+
+        const ExecInstruction& b = code[i + 1];
+
+        // cmp r(n), src; b* ADDR
+        if (isConditionalBranch(b))
+        {
+            if (fuseCompareBranch(a, b, MOP_CMP_JEQ_RR, MOP_CMP_JEQ_RI))
+            {
+                stats.compareBranch++;
+                i += 1;
+            }
+        }
+        // mov r(n), src; bl SYM|ADDR
+        else if (fuseMoveCall(a, b))
+        {
+            stats.moveCall++;
+            i += 1;
+        }
+    }
+}
@@ -0,0 +1,159 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Lowering_h_
+#define _Lowering_h_
+
+#include "Declarations.h"
+
+enum MicroOpcode
+{
+    // Internal op codes that are produced at load time.
+    // They are never written to a file, so they start
+    // where the file op codes leave off. Each variant
+    // has its operand kinds fixed so the handler does
+    // not need to test the instruction flags.
+    //
+    // R = register, I = immediate value
+    MOP_BEG = OP_MAX,  // unused padding
+    MOP_MOV_RR,    // r(n) = r(n)
+    MOP_MOV_RR8,   // r(n).b = r(n)
+    MOP_MOV_RR16,  // r(n).w = r(n)
+    MOP_MOV_RR32,  // r(n).l = r(n)
+    MOP_MOV_RI,    // r(n) = V
+    MOP_MOV_RI8,   // r(n).b = V
+    MOP_MOV_RI16,  // r(n).w = V
+    MOP_MOV_RI32,  // r(n).l = V
+    MOP_MOV_PR,    // pc = r(n)
+    MOP_MOV_PI,    // pc = V
+    MOP_CALL_SYM,  // bl SYM
+    MOP_CALL_ADR,  // bl ADDR
+    MOP_CMP_RR,    // cmp r(n), r(n)
+    MOP_CMP_RI,    // cmp r(n), V
+    MOP_CMP_IR,    // cmp V, r(n)
+    MOP_ADD_RRR,
+    MOP_ADD_RRI,
+    MOP_ADD_RIR,
+    MOP_ADD_RR,
+    MOP_ADD_RI,
+    MOP_SUB_RRR,
+    MOP_SUB_RRI,
+    MOP_SUB_RIR,
+    MOP_SUB_RR,
+    MOP_SUB_RI,
+    MOP_MUL_RRR,
+    MOP_MUL_RRI,
+    MOP_MUL_RIR,
+    MOP_MUL_RR,
+    MOP_MUL_RI,
+    MOP_DIV_RRR,
+    MOP_DIV_RRI,  // only produced when V != 0
+    MOP_DIV_RIR,
+    MOP_DIV_RR,
+    MOP_DIV_RI,  // only produced when V != 0
+    MOP_SHR_RRR,
+    MOP_SHR_RRI,
+    MOP_SHR_RIR,
+    MOP_SHR_RR,
+    MOP_SHR_RI,
+    MOP_SHL_RRR,
+    MOP_SHL_RRI,
+    MOP_SHL_RIR,
+    MOP_SHL_RR,
+    MOP_SHL_RI,
+    MOP_PRG_R,  // prg r(n)
+    MOP_PRG_I,  // prg V
+    // ---- fused op codes ----
+    // The branch conditions are kept in the same
+    // order as OP_JEQ through OP_JGE.
+    MOP_CMP_JEQ_RR,  // cmp r(n), r(n); beq ADDR
+    MOP_CMP_JNE_RR,
+    MOP_CMP_JLT_RR,
+    MOP_CMP_JGT_RR,
+    MOP_CMP_JLE_RR,
+    MOP_CMP_JGE_RR,
+    MOP_CMP_JEQ_RI,  // cmp r(n), V; beq ADDR
+    MOP_CMP_JNE_RI,
+    MOP_CMP_JLT_RI,
+    MOP_CMP_JGT_RI,
+    MOP_CMP_JLE_RI,
+    MOP_CMP_JGE_RI,
+    MOP_INC_CMP_JEQ_RR,  // inc r(n); cmp r(n), r(n); beq ADDR
+    MOP_INC_CMP_JNE_RR,
+    MOP_INC_CMP_JLT_RR,
+    MOP_INC_CMP_JGT_RR,
+    MOP_INC_CMP_JLE_RR,
+    MOP_INC_CMP_JGE_RR,
+    MOP_INC_CMP_JEQ_RI,  // inc r(n); cmp r(n), V; beq ADDR
+    MOP_INC_CMP_JNE_RI,
+    MOP_INC_CMP_JLT_RI,
+    MOP_INC_CMP_JGT_RI,
+    MOP_INC_CMP_JLE_RI,
+    MOP_INC_CMP_JGE_RI,
+    MOP_MOV_RR_CALL_SYM,  // mov r(n), r(n); bl SYM
+    MOP_MOV_RI_CALL_SYM,  // mov r(n), V; bl SYM
+    MOP_MOV_RR_CALL_ADR,  // mov r(n), r(n); bl ADDR
+    MOP_MOV_RI_CALL_ADR,  // mov r(n), V; bl ADDR
+    // ---- verified op codes ----
+    // The file op code, for an instruction that passed
+    // VerifyInstruction. The handler skips the tests it
+    // proved. A div is always lowered, so it has none.
+    MOP_ADRP_V,
+    MOP_STR_V,
+    MOP_LDR_V,
+    MOP_LDRS_V,
+    MOP_STRS_V,
+    MOP_STP_V,
+    MOP_LDP_V,
+    MOP_MAX,
+};
+
+struct FusionStats
+{
+    size_t compareBranch;
+    size_t incCompareBranch;
+    size_t moveCall;
+};
+
+// Rewrites each instruction in src into the most specific
+// op code available. The input is expected to have already
+// passed Program::testInstruction. Instructions that have
+// no specialized form are copied unchanged, unless they pass
+// VerifyInstruction against a data table of dataSize bytes.
+extern void LowerInstructions(const ExecInstructions& src,
+                              ExecInstructions&       dest,
+                              size_t                  dataSize);
+
+// Returns the MOP_*_V op code for op, or op when it has none.
+extern uint8_t GetVerifiedOp(uint8_t op);
+
+// Replaces common sequences of lowered instructions with a single
+// fused instruction. The fused op code is stored in the first slot
+// and the remaining slots are left in place, so no branch target
+// needs to be remapped. The handler skips over the remaining slots.
+// A sequence is not fused if anything can branch into the middle
+// of it. The entry points, main and the exports, are treated
+// as branch targets.
+extern void FuseInstructions(ExecInstructions&            code,
+                             const std::vector<uint64_t>& entries,
+                             FusionStats&                 stats);
+
+#endif  //_Lowering_h_
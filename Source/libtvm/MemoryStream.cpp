@@ -116,11 +116,23 @@ size_t MemoryStream::findAllocLen(size_t nr)
 
         over += m_capacity;
         over += 256;
+
+        // Doubling keeps a stream that is written a
+        // few bytes at a time linear in its size.
+        if (over < m_capacity * 2)
+            over = m_capacity * 2;
         return over;
     }
     return 0;
 }
 
+size_t MemoryStream::writeBytes(const void* src, size_t len)
+{
+    if (len == 0)
+        return 0;
+    return write(src, len, false);
+}
+
 size_t MemoryStream::writeString(const char* src, size_t len)
 {
     return write(src, len, true);
@@ -31,6 +31,7 @@ public:
     ~MemoryStream();
 
     void   clear(void);
+    size_t writeBytes(const void* src, size_t len);
     size_t writeString(const char* src, size_t len);
     size_t write8(uint8_t val);
     size_t write16(uint16_t val);
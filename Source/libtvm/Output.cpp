@@ -0,0 +1,182 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Output.h"
+#include <string.h>
+
+static size_t formatUnsigned(char* dest, uint64_t v)
+{
+    char   tmp[20];
+    size_t n = 0, i;
+    do
+    {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+
+    for (i = 0; i < n; ++i)
+        dest[i] = tmp[n - 1 - i];
+    return n;
+}
+
+static size_t formatHex(char* dest, uint64_t v)
+{
+    static const char Digits[] = "0123456789ABCDEF";
+
+    char   tmp[16];
+    size_t n = 0, i;
+    do
+    {
+        tmp[n++] = Digits[v & 0xF];
+        v >>= 4;
+    } while (v != 0);
+
+    for (i = 0; i < n; ++i)
+        dest[i] = tmp[n - 1 - i];
+    return n;
+}
+
+OutputBuffer::OutputBuffer() :
+    m_size(0),
+    m_buffered(true),
+    m_stream(stdout)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::setBuffered(bool buffered)
+{
+    m_buffered = buffered;
+    done();
+}
+
+void OutputBuffer::setStream(FILE* stream)
+{
+    flush();
+    m_stream = stream != nullptr ? stream : stdout;
+}
+
+void OutputBuffer::append(const char* buf, size_t len)
+{
+    if (m_size + len > OUTPUT_BUFFER_SIZE)
+    {
+        sync();
+        if (len > OUTPUT_BUFFER_SIZE)
+        {
+            fwrite(buf, 1, len, m_stream);
+            return;
+        }
+    }
+    memcpy(m_buffer + m_size, buf, len);
+    m_size += len;
+}
+
+void OutputBuffer::appendPadded(const char* buf, size_t len, size_t width, bool left)
+{
+    size_t pad = width > len ? width - len : 0;
+    if (left)
+        append(buf, len);
+    while (pad-- > 0)
+        append(' ');
+    if (!left)
+        append(buf, len);
+}
+
+void OutputBuffer::write(const char* buf, size_t len)
+{
+    if (buf != nullptr)
+        append(buf, len);
+    done();
+}
+
+void OutputBuffer::printInteger(int64_t v)
+{
+    char   buf[24];
+    size_t n = 0;
+
+    uint64_t u = (uint64_t)v;
+    if (v < 0)
+    {
+        buf[n++] = '-';
+        u        = 0 - u;
+    }
+    n += formatUnsigned(buf + n, u);
+    buf[n++] = '\n';
+
+    append(buf, n);
+    done();
+}
+
+void OutputBuffer::printRegisters(const Register* regi, size_t count)
+{
+    char   buf[24];
+    size_t i, n;
+
+    for (i = 0; i < count; ++i)
+    {
+        append(" x", 2);
+        n = formatUnsigned(buf, i);
+        appendPadded(buf, n, 4, true);
+        append(' ');
+
+        buf[0] = '0';
+        buf[1] = 'x';
+        n      = 2 + formatHex(buf + 2, regi[i].x);
+        appendPadded(buf, n, 17, false);
+        append(' ');
+
+        n = formatUnsigned(buf, regi[i].x);
+        appendPadded(buf, n, 22, false);
+        append('\n');
+    }
+    done();
+}
+
+void OutputBuffer::sync(void)
+{
+    if (m_size > 0)
+    {
+        fwrite(m_buffer, 1, m_size, m_stream);
+        m_size = 0;
+    }
+}
+
+void OutputBuffer::flush(void)
+{
+    sync();
+    fflush(m_stream);
+}
+
+void OutputBuffer::hostWrite(void* output, const char* buf, uint64_t len)
+{
+    if (output != nullptr)
+        ((OutputBuffer*)output)->write(buf, (size_t)len);
+}
+
+void OutputBuffer::hostFlush(void* output)
+{
+    if (output != nullptr)
+        ((OutputBuffer*)output)->flush();
+}
@@ -0,0 +1,97 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Output_h_
+#define _Output_h_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "Declarations.h"
+
+const size_t OUTPUT_BUFFER_SIZE = 8192;
+
+// Collects everything a program prints, from prg, prgi and the
+// host modules, and writes it to the stream, stdout by default,
+// when the buffer is full, when flush is called or when the program
+// stops. In unbuffered mode each write goes out immediately.
+class OutputBuffer
+{
+private:
+    char   m_buffer[OUTPUT_BUFFER_SIZE];
+    size_t m_size;
+    bool   m_buffered;
+    FILE*  m_stream;
+
+    inline void append(char ch)
+    {
+        if (m_size >= OUTPUT_BUFFER_SIZE)
+            sync();
+        m_buffer[m_size++] = ch;
+    }
+
+    void append(const char* buf, size_t len);
+    void appendPadded(const char* buf, size_t len, size_t width, bool left);
+
+    inline void done(void)
+    {
+        if (!m_buffered)
+            flush();
+    }
+
+public:
+    OutputBuffer();
+    ~OutputBuffer();
+
+    void setBuffered(bool buffered);
+
+    inline bool isBuffered(void) const
+    {
+        return m_buffered;
+    }
+
+    // Writes out what is buffered and sends the rest to stream.
+    void setStream(FILE* stream);
+
+    inline FILE* getStream(void) const
+    {
+        return m_stream;
+    }
+
+    void write(const char* buf, size_t len);
+
+    // Prints v in decimal followed by a new line.
+    void printInteger(int64_t v);
+
+    // Prints each register as hex and as an unsigned value.
+    void printRegisters(const Register* regi, size_t count);
+
+    // Hands the buffered output to the stream without flushing it.
+    // It keeps the order with anything else written through stdio.
+    void sync(void);
+
+    void flush(void);
+
+    // Callbacks for tvmcontext_t, output is the OutputBuffer.
+    static void hostWrite(void* output, const char* buf, uint64_t len);
+    static void hostFlush(void* output);
+};
+
+#endif  //_Output_h_
@@ -0,0 +1,412 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Packed.h"
+#include <string.h>
+#include "Lowering.h"
+#include "MemoryStream.h"
+
+static uint32_t packTarget(uint64_t addr)
+{
+    // Anything past the end of the code stops execution,
+    // so a target that does not fit can be clamped.
+    return addr > UINT32_MAX ? UINT32_MAX : (uint32_t)addr;
+}
+
+static void packInstruction(const ExecInstruction& src, PackedInstruction& dest, PackedCode& code)
+{
+    const uint64_t* argv = src.argv;
+
+    dest.op = src.op;
+    if (src.op >= MOP_ADD_RRR && src.op <= MOP_SHL_RI)
+    {
+        switch ((src.op - MOP_ADD_RRR) % 5)
+        {
+        case 0:  // RRR
+            dest.a = (uint8_t)argv[0];
+            dest.b = (uint8_t)argv[1];
+            dest.c = (uint8_t)argv[2];
+            break;
+        case 1:  // RRI
+            dest.a   = (uint8_t)argv[0];
+            dest.b   = (uint8_t)argv[1];
+            dest.imm = argv[2];
+            break;
+        case 2:  // RIR
+            dest.a   = (uint8_t)argv[0];
+            dest.imm = argv[1];
+            dest.c   = (uint8_t)argv[2];
+            break;
+        case 3:  // RR
+            dest.a = (uint8_t)argv[0];
+            dest.b = (uint8_t)argv[1];
+            break;
+        default:  // RI
+            dest.a   = (uint8_t)argv[0];
+            dest.imm = argv[1];
+            break;
+        }
+        return;
+    }
+
+    if (src.op >= MOP_CMP_JEQ_RR && src.op <= MOP_INC_CMP_JGE_RI)
+    {
+        const int form = (src.op - MOP_CMP_JEQ_RR) / 6;
+
+        dest.a   = (uint8_t)argv[0];
+        dest.aux = packTarget(argv[2]);
+        if (form == 0 || form == 2)
+            dest.b = (uint8_t)argv[1];
+        else
+            dest.imm = argv[1];
+        return;
+    }
+
+    switch (src.op)
+    {
+    case OP_INC:
+    case OP_DEC:
+    case MOP_PRG_R:
+        dest.a = (uint8_t)argv[0];
+        break;
+    case OP_JMP:
+    case OP_JEQ:
+    case OP_JNE:
+    case OP_JLT:
+    case OP_JGT:
+    case OP_JLE:
+    case OP_JGE:
+    case MOP_CALL_ADR:
+        dest.aux = packTarget(argv[0]);
+        break;
+    case OP_CMP:
+        // cmp V, V, the only form with two immediate values
+        dest.imm = argv[0];
+        dest.aux = code.addWide(argv[1]);
+        break;
+    case OP_ADD:
+        // add r(n), r(n), ADDR reads through the address in r(n)
+        dest.a   = (uint8_t)argv[0];
+        dest.aux = src.flags;
+        if (src.flags & IF_REG1)
+            dest.b = (uint8_t)argv[1];
+        break;
+    case OP_ADRP:
+    case OP_STP:
+    case OP_LDP:
+    case OP_STR:
+    case OP_LDR:
+    case OP_LDRS:
+    case OP_STRS:
+    case MOP_ADRP_V:
+    case MOP_STP_V:
+    case MOP_LDP_V:
+    case MOP_STR_V:
+    case MOP_LDR_V:
+    case MOP_LDRS_V:
+    case MOP_STRS_V:
+        dest.a   = (uint8_t)argv[0];
+        dest.aux = (uint32_t)src.flags | ((uint32_t)src.index << 16);
+        dest.imm = argv[1];
+        if (src.flags & IF_REG1)
+            dest.b = (uint8_t)argv[1];
+        if (src.index < MAX_REG)
+            dest.c = (uint8_t)src.index;
+        break;
+    case MOP_MOV_RR:
+    case MOP_MOV_RR8:
+    case MOP_MOV_RR16:
+    case MOP_MOV_RR32:
+    case MOP_CMP_RR:
+        dest.a = (uint8_t)argv[0];
+        dest.b = (uint8_t)argv[1];
+        break;
+    case MOP_MOV_RI:
+    case MOP_MOV_RI8:
+    case MOP_MOV_RI16:
+    case MOP_MOV_RI32:
+    case MOP_CMP_RI:
+        dest.a   = (uint8_t)argv[0];
+        dest.imm = argv[1];
+        break;
+    case MOP_MOV_PR:
+        dest.b = (uint8_t)argv[1];
+        break;
+    case MOP_MOV_PI:
+        dest.imm = argv[1];
+        break;
+    case MOP_CMP_IR:
+        dest.imm = argv[0];
+        dest.b   = (uint8_t)argv[1];
+        break;
+    case MOP_PRG_I:
+        dest.imm = argv[0];
+        break;
+    case MOP_CALL_SYM:
+        dest.aux = (uint32_t)argv[0];
+        break;
+    case MOP_MOV_RR_CALL_SYM:
+        dest.a   = (uint8_t)argv[0];
+        dest.b   = (uint8_t)argv[1];
+        dest.aux = (uint32_t)argv[2];
+        break;
+    case MOP_MOV_RI_CALL_SYM:
+        dest.a   = (uint8_t)argv[0];
+        dest.imm = argv[1];
+        dest.aux = (uint32_t)argv[2];
+        break;
+    case MOP_MOV_RR_CALL_ADR:
+        dest.a   = (uint8_t)argv[0];
+        dest.b   = (uint8_t)argv[1];
+        dest.aux = packTarget(argv[2]);
+        break;
+    case MOP_MOV_RI_CALL_ADR:
+        dest.a   = (uint8_t)argv[0];
+        dest.imm = argv[1];
+        dest.aux = packTarget(argv[2]);
+        break;
+    default:
+        // ret, pri and the division by zero that
+        // was not lowered have no operands to read.
+        break;
+    }
+}
+
+void PackInstructions(const ExecInstructions& src, PackedCode& dest)
+{
+    dest.clear();
+
+    ExecInstructions::const_iterator it = src.begin();
+    while (it != src.end())
+    {
+        PackedInstruction ins = {};
+        packInstruction(*it++, ins, dest);
+        dest.push(ins);
+    }
+}
+
+PackedCode::PackedCode() :
+    m_attached({}),
+    m_attachedSize(0),
+    m_attachedWide(0),
+    m_isAttached(false)
+{
+}
+
+bool PackedCode::isValid(void) const
+{
+    const View v = view();
+
+    size_t i;
+    for (i = 0; i < size(); ++i)
+    {
+        if (v.op(i) >= MOP_MAX || v.a(i) >= MAX_REG || v.b(i) >= MAX_REG || v.c(i) >= MAX_REG)
+            return false;
+        if (v.op(i) == OP_CMP && v.aux(i) >= wideSize())
+            return false;
+    }
+    return true;
+}
+
+void PackedCode::clear(void)
+{
+#ifdef TVM_PACKED_SOA
+    m_op.clear();
+    m_a.clear();
+    m_b.clear();
+    m_c.clear();
+    m_aux.clear();
+    m_imm.clear();
+#else
+    m_ins.clear();
+#endif
+    m_wide.clear();
+
+    m_attached     = {};
+    m_attachedSize = 0;
+    m_attachedWide = 0;
+    m_isAttached   = false;
+}
+
+void PackedCode::push(const PackedInstruction& ins)
+{
+#ifdef TVM_PACKED_SOA
+    m_op.push_back(ins.op);
+    m_a.push_back(ins.a);
+    m_b.push_back(ins.b);
+    m_c.push_back(ins.c);
+    m_aux.push_back(ins.aux);
+    m_imm.push_back(ins.imm);
+#else
+    m_ins.push_back(ins);
+#endif
+}
+
+uint32_t PackedCode::addWide(uint64_t v)
+{
+    m_wide.push_back(v);
+    return (uint32_t)(m_wide.size() - 1);
+}
+
+PackedCode::View PackedCode::view(void) const
+{
+    if (m_isAttached)
+        return m_attached;
+
+#ifdef TVM_PACKED_SOA
+    View v = {
+        m_op.data(),
+        m_a.data(),
+        m_b.data(),
+        m_c.data(),
+        m_aux.data(),
+        m_imm.data(),
+        m_wide.data(),
+    };
+#else
+    View v = {m_ins.data(), m_wide.data()};
+#endif
+    return v;
+}
+
+static size_t Align8(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t)7;
+}
+
+static void WriteArray(MemoryStream& dest, const void* src, size_t bytes)
+{
+    dest.writeBytes(src, bytes);
+    dest.fill(Align8(bytes) - bytes, 0);
+}
+
+// Returns the array that starts at offset in src and moves offset past
+// it and its padding, or null when that would go past the end of src.
+static const void* TakeArray(const uint8_t* src, size_t len, size_t& offset, uint64_t bytes)
+{
+    if (bytes > len || Align8((size_t)bytes) > len - offset)
+        return nullptr;
+
+    const void* ptr = src + offset;
+    offset += Align8((size_t)bytes);
+    return ptr;
+}
+
+void PackedCode::write(MemoryStream& dest) const
+{
+    const View   v = view();
+    const size_t n = size();
+    const size_t w = wideSize();
+
+    dest.write64((uint64_t)n);
+    dest.write64((uint64_t)w);
+#ifdef TVM_PACKED_SOA
+    WriteArray(dest, v.m_op, n);
+    WriteArray(dest, v.m_a, n);
+    WriteArray(dest, v.m_b, n);
+    WriteArray(dest, v.m_c, n);
+    WriteArray(dest, v.m_aux, n * sizeof(uint32_t));
+    WriteArray(dest, v.m_imm, n * sizeof(uint64_t));
+#else
+    WriteArray(dest, v.m_ins, n * sizeof(PackedInstruction));
+#endif
+    WriteArray(dest, v.m_wide, w * sizeof(uint64_t));
+}
+
+size_t PackedCode::storedSize(void) const
+{
+    const size_t n = size();
+
+    size_t bytes = 2 * sizeof(uint64_t) + Align8(wideSize() * sizeof(uint64_t));
+#ifdef TVM_PACKED_SOA
+    bytes += 4 * Align8(n) + Align8(n * sizeof(uint32_t)) + n * sizeof(uint64_t);
+#else
+    bytes += n * sizeof(PackedInstruction);
+#endif
+    return bytes;
+}
+
+size_t PackedCode::attach(const uint8_t* src, size_t len)
+{
+    uint64_t n = 0, w = 0;
+    if (len < 2 * sizeof(uint64_t) || ((size_t)src & 7) != 0)
+        return 0;
+
+    memcpy(&n, src, sizeof(uint64_t));
+    memcpy(&w, src + sizeof(uint64_t), sizeof(uint64_t));
+    if (n > len || w > len)
+        return 0;
+
+    size_t offset = 2 * sizeof(uint64_t);
+    View   v      = {};
+
+#ifdef TVM_PACKED_SOA
+    v.m_op  = (const uint8_t*)TakeArray(src, len, offset, n);
+    v.m_a   = (const uint8_t*)TakeArray(src, len, offset, n);
+    v.m_b   = (const uint8_t*)TakeArray(src, len, offset, n);
+    v.m_c   = (const uint8_t*)TakeArray(src, len, offset, n);
+    v.m_aux = (const uint32_t*)TakeArray(src, len, offset, n * sizeof(uint32_t));
+    v.m_imm = (const uint64_t*)TakeArray(src, len, offset, n * sizeof(uint64_t));
+    if (!v.m_op || !v.m_a || !v.m_b || !v.m_c || !v.m_aux || !v.m_imm)
+        return 0;
+#else
+    v.m_ins = (const PackedInstruction*)TakeArray(src, len, offset, n * sizeof(PackedInstruction));
+    if (!v.m_ins)
+        return 0;
+#endif
+    v.m_wide = (const uint64_t*)TakeArray(src, len, offset, w * sizeof(uint64_t));
+    if (!v.m_wide)
+        return 0;
+
+    clear();
+    m_attached     = v;
+    m_attachedSize = (size_t)n;
+    m_attachedWide = (size_t)w;
+    m_isAttached   = true;
+    return offset;
+}
+
+size_t PackedCode::size(void) const
+{
+    if (m_isAttached)
+        return m_attachedSize;
+#ifdef TVM_PACKED_SOA
+    return m_op.size();
+#else
+    return m_ins.size();
+#endif
+}
+
+size_t PackedCode::wideSize(void) const
+{
+    return m_isAttached ? m_attachedWide : m_wide.size();
+}
+
+size_t PackedCode::footprint(void) const
+{
+    size_t bytes = wideSize() * sizeof(uint64_t);
+#ifdef TVM_PACKED_SOA
+    bytes += size() * (4 * sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t));
+#else
+    bytes += size() * sizeof(PackedInstruction);
+#endif
+    return bytes;
+}
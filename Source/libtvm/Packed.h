@@ -0,0 +1,199 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Packed_h_
+#define _Packed_h_
+
+#include <vector>
+#include "Declarations.h"
+
+class MemoryStream;
+
+// The packed form of a lowered instruction, everything the threaded
+// engine reads to execute it. Register operands are stored as byte
+// indices and the one immediate value an instruction usually has
+// goes in imm. aux holds a branch target, the string table index of
+// a host call, the instruction flags and index of a memory access,
+// or an index into the wide table when there is a second immediate.
+struct PackedInstruction
+{
+    uint8_t  op;
+    uint8_t  a;    // r(n) for argv[0]
+    uint8_t  b;    // r(n) for argv[1]
+    uint8_t  c;    // r(n) for argv[2]
+    uint32_t aux;  // ADDR, SYM, flags | index << 16 or wide table index
+    uint64_t imm;  // V
+};
+
+class PackedCode
+{
+public:
+#ifdef TVM_PACKED_SOA
+    // Structure of arrays, each field is its own stream.
+    struct View
+    {
+        const uint8_t*  m_op;
+        const uint8_t*  m_a;
+        const uint8_t*  m_b;
+        const uint8_t*  m_c;
+        const uint32_t* m_aux;
+        const uint64_t* m_imm;
+        const uint64_t* m_wide;
+
+        inline uint8_t op(size_t i) const
+        {
+            return m_op[i];
+        }
+
+        inline uint8_t a(size_t i) const
+        {
+            return m_a[i];
+        }
+
+        inline uint8_t b(size_t i) const
+        {
+            return m_b[i];
+        }
+
+        inline uint8_t c(size_t i) const
+        {
+            return m_c[i];
+        }
+
+        inline uint32_t aux(size_t i) const
+        {
+            return m_aux[i];
+        }
+
+        inline uint64_t imm(size_t i) const
+        {
+            return m_imm[i];
+        }
+
+        inline uint64_t wide(size_t i) const
+        {
+            return m_wide[i];
+        }
+    };
+#else
+    struct View
+    {
+        const PackedInstruction* m_ins;
+        const uint64_t*          m_wide;
+
+        inline uint8_t op(size_t i) const
+        {
+            return m_ins[i].op;
+        }
+
+        inline uint8_t a(size_t i) const
+        {
+            return m_ins[i].a;
+        }
+
+        inline uint8_t b(size_t i) const
+        {
+            return m_ins[i].b;
+        }
+
+        inline uint8_t c(size_t i) const
+        {
+            return m_ins[i].c;
+        }
+
+        inline uint32_t aux(size_t i) const
+        {
+            return m_ins[i].aux;
+        }
+
+        inline uint64_t imm(size_t i) const
+        {
+            return m_ins[i].imm;
+        }
+
+        inline uint64_t wide(size_t i) const
+        {
+            return m_wide[i];
+        }
+    };
+#endif
+
+private:
+#ifdef TVM_PACKED_SOA
+    std::vector<uint8_t>  m_op;
+    std::vector<uint8_t>  m_a;
+    std::vector<uint8_t>  m_b;
+    std::vector<uint8_t>  m_c;
+    std::vector<uint32_t> m_aux;
+    std::vector<uint64_t> m_imm;
+#else
+    std::vector<PackedInstruction> m_ins;
+#endif
+    std::vector<uint64_t> m_wide;
+
+    // Set by attach, the code is then read from memory it does not own.
+    View   m_attached;
+    size_t m_attachedSize;
+    size_t m_attachedWide;
+    bool   m_isAttached;
+
+public:
+    PackedCode();
+
+    void clear(void);
+
+    void push(const PackedInstruction& ins);
+
+    // Adds a value that does not fit in the record
+    // to the wide table and returns its index.
+    uint32_t addWide(uint64_t v);
+
+    View view(void) const;
+
+    // True when every op code is in the dispatch table, every
+    // register operand is inside the register file and every
+    // wide table index is inside the table.
+    bool isValid(void) const;
+
+    // Writes the number of instructions and wide table values, then
+    // each array padded to a multiple of 8 bytes, so that attach can
+    // run them where they are. storedSize is the number of bytes.
+    void   write(MemoryStream& dest) const;
+    size_t storedSize(void) const;
+
+    // Runs the code write stored at src without copying it. src has
+    // to be 8 byte aligned and outlive this. Returns the number of
+    // bytes used, or 0 when the arrays would not fit in len.
+    size_t attach(const uint8_t* src, size_t len);
+
+    size_t size(void) const;
+
+    size_t wideSize(void) const;
+
+    // The number of bytes used by the instruction
+    // stream and the wide table.
+    size_t footprint(void) const;
+};
+
+// Converts lowered and fused instructions into the packed form.
+extern void PackInstructions(const ExecInstructions& src, PackedCode& dest);
+
+#endif  //_Packed_h_
@@ -20,6 +20,7 @@
 -------------------------------------------------------------------------------
 */
 #include "Parser.h"
+#include <algorithm>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
@@ -716,6 +717,22 @@ uint8_t Parser::eatWhiteSpace(uint8_t ch)
 
 int32_t Parser::handleSection(const Token& tok)
 {
+    if (tok.sectype == SEC_GLOBAL)
+    {
+        // The label is checked once every label is known.
+        Token name;
+        scan(name);
+        if (name.type != TOK_IDENTIFIER || name.value.empty())
+        {
+            error("expected a label name after .%s\n", tok.value.c_str());
+            return PS_ERROR;
+        }
+
+        if (std::find(m_exports.begin(), m_exports.end(), name.value) == m_exports.end())
+            m_exports.push_back(name.value);
+        return PS_OK;
+    }
+
     m_section = tok.sectype;
     if (m_section == PS_UNDEFINED)
     {
@@ -945,6 +962,10 @@ int32_t Parser::getSection(const str_t& val)
         return SEC_QUAD;
     else if (val == "zero")
         return SEC_ZERO;
+    else if (val == "global")
+        return SEC_GLOBAL;
+    else if (val == "globl")
+        return SEC_GLOBAL;
     return PS_UNDEFINED;
 }
 
@@ -38,6 +38,7 @@ private:
     str_t        m_fname;
     bool         m_disableErrorFormat;
     DataLookup   m_dataDecl;
+    strvec_t     m_exports;
 
 public:
     Parser();
@@ -63,6 +64,12 @@ public:
         return m_dataDecl;
     }
 
+    // The labels named by .global in the order they were declared
+    const strvec_t& getExports(void)
+    {
+        return m_exports;
+    }
+
     void disableErrorFormat(bool v)
     {
         m_disableErrorFormat = v;
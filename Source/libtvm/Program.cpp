@@ -20,111 +20,284 @@
 -------------------------------------------------------------------------------
 */
 #include "Program.h"
+#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 #include <cassert>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
 #include <stack>
 #include <vector>
 #include "BlockReader.h"
+#include "Builtin.h"
 #include "Declarations.h"
 #include "SharedLib.h"
 #include "SymbolUtils.h"
+#include "Verifier.h"
 
 using namespace std;
 
-const size_t MaxRegisterSize = sizeof(Register) * (MAX_REG - 1);
+
+static int ReadInput(void* input)
+{
+    return fgetc((FILE*)input);
+}
+
+// True for the packed op codes whose aux is
+// the string table index of a host call.
+static bool IsHostCall(uint8_t op)
+{
+    return op == MOP_CALL_SYM || op == MOP_MOV_RR_CALL_SYM || op == MOP_MOV_RI_CALL_SYM;
+}
+
+ProgramImage::ProgramImage(const str_t& path) :
+    header({}),
+    startinst(0),
+    hash(0),
+    size(0),
+    modpath(path),
+    fusion({}),
+    lazyBind(false),
+    hashed(false),
+    verified(false),
+    cached(false),
+    shared(false)
+{
+}
+
+ProgramImage::~ProgramImage()
+{
+    DynamicLib::iterator it = dynlib.begin();
+    while (it != dynlib.end())
+        UnloadSharedLibrary(*it++);
+}
 
 Program::Program(const str_t& modpath) :
-    m_header({}),
+    m_image(std::make_shared<ProgramImage>(modpath)),
     m_flags(0),
+    m_compare(),
     m_return(0),
     m_curinst(0),
-    m_startinst(0),
-    m_strtab(),
-    m_strtablist(),
     m_callStack(),
-    m_modpath(modpath),
-    m_dynlib(),
-    m_symbols(),
     m_dataTable(),
     m_stack(),
-    m_exit(false)
+    m_exit(false),
+    m_lazyFlags(false),
+    m_lazyBind(false),
+    m_imageCache(true),
+    m_operations(OPCodeTable),
+    m_engine(CreateDefaultEngine()),
+    m_host({})
 {
     memset(m_regi, 0, sizeof(Registers));
+    m_host.context.regi   = (tvmregister_t)m_host.window;
+    m_host.context.output = &m_output;
+    m_host.context.write  = OutputBuffer::hostWrite;
+    m_host.context.flush  = OutputBuffer::hostFlush;
+    m_host.context.input  = stdin;
+    m_host.context.read   = ReadInput;
     m_stack.reserve(256);
     m_callStack.reserve(256);
 }
 
 Program::~Program()
 {
-    DynamicLib::iterator it = m_dynlib.begin();
-    while (it != m_dynlib.end())
-        UnloadSharedLibrary(*it++);
+    delete m_engine;
 }
 
 int Program::load(const char* fname)
 {
     if (!fname)
     {
-        printf("invalid file path name\n");
+        reportError("invalid file path name");
         return PS_ERROR;
     }
 
+    // A shared image is never loaded into again.
+    if (m_image->shared || m_image->code.size() != 0)
+        m_image = std::make_shared<ProgramImage>(m_image->modpath);
+    m_image->lazyBind = m_lazyBind;
+
     BlockReader reader = BlockReader(fname);
     if (reader.eof())
     {
-        printf("failed to load '%s'\n", fname);
+        reportError("failed to load '%s'", fname);
         return PS_ERROR;
     }
 
-    reader.read(&m_header, sizeof(TVMHeader));
-    if (m_header.code[0] != 'T' || m_header.code[1] != 'V')
+    reader.read(&m_image->header, sizeof(TVMHeader));
+    if (m_image->header.code[0] != 'T' || m_image->header.code[1] != 'V')
     {
-        printf("invalid file type identifier\n");
+        reportError("invalid file type identifier");
         return PS_ERROR;
     }
 
-    if (m_header.str != 0)
+    if (m_image->header.flags & HF_EXPORTS)
     {
-        if (loadStringTable(reader) != PS_OK)
+        if (loadExports(reader) != PS_OK)
         {
-            printf("failed to read the string table\n");
+            reportError("failed to read the export table");
             return PS_ERROR;
         }
     }
 
-    if (m_header.dat != 0)
+    // The cache only replaces what is derived from the code.
+    if (m_image->header.dat != 0)
     {
         if (loadDataTable(reader) != PS_OK)
         {
-            printf("failed to read the data table\n");
+            reportError("failed to read the data table");
             return PS_ERROR;
         }
     }
 
-    if (m_header.sym != 0)
+    // Snapshots and the cache are only valid for the same image. The
+    // hash is only needed here by the cache, see getImageHash.
+    m_image->path = fname;
+    m_image->size = reader.size();
+
+    str_t cachePath;
+    if (m_imageCache && IsImageCacheEnabled())
+    {
+        const uint64_t hash = HashBytes(reader.ptr(), reader.size(), TVM_HASH_SEED);
+        m_image->hash       = hash;
+        m_image->hashed     = true;
+
+        cachePath = GetImageCachePath(hash);
+
+        // The modules have to be the ones the file was bound against.
+        CachedImage cached = {};
+        if (ReadImageCache(cachePath, hash, reader.size(), m_engine->runsSource(), cached) == PS_OK &&
+            cached.moduleStamp == stampModules(cached.modules))
+        {
+            if (loadCached(cached) != PS_OK)
+                return PS_ERROR;
+
+            m_image->cached = true;
+            m_image->data.snapshot();
+            return instantiate();
+        }
+    }
+
+    if (m_image->header.str != 0)
+    {
+        if (loadStringTable(reader) != PS_OK)
+        {
+            reportError("failed to read the string table");
+            return PS_ERROR;
+        }
+    }
+
+    // Sized once, so binding a call while the threaded engine
+    // holds a reference to its entry never moves it.
+    m_image->symbols.resize(m_image->strtablist.size(), HostCall{nullptr, TVM_ABI_REGISTERS});
+    m_image->providers.resize(m_image->strtablist.size(), -1);
+
+    if (m_image->header.sym != 0)
     {
         if (loadSymbolTable(reader) != PS_OK)
         {
-            printf("failed to read the symbol table\n");
+            reportError("failed to read the symbol table");
             return PS_ERROR;
         }
     }
 
-    if (loadCode(reader) != PS_OK)
+    ExecInstructions lowered;
+    if (loadCode(reader, lowered) != PS_OK)
     {
-        printf("failed to read the file's instruction table\n");
+        reportError("failed to read the file's instruction table");
         return PS_ERROR;
     }
-    return PS_OK;
+
+    PackInstructions(lowered, m_image->code);
+    if (!cachePath.empty())
+        storeCached(cachePath, m_image->hash, reader.size());
+
+    m_image->data.snapshot();
+    releaseSource();
+    return instantiate();
+}
+
+int Program::load(const ProgramImagePtr& image)
+{
+    if (!image || !image->shared)
+    {
+        reportError("only a shared image can be loaded");
+        return PS_ERROR;
+    }
+
+    m_image = image;
+    return instantiate();
+}
+
+void Program::releaseSource(void)
+{
+    // An engine that only runs the packed code has no use for the
+    // source instructions. The debugger keeps its own copy.
+    if (!m_engine->runsSource())
+        ExecInstructions().swap(m_image->ins);
+}
+
+int Program::instantiate(void)
+{
+    if (m_engine->runsSource() && m_image->ins.size() != m_image->code.size())
+    {
+        reportError("the image was loaded without the instructions the '%s' engine runs",
+                    m_engine->getName());
+        return PS_ERROR;
+    }
+
+    // The image is only read from here on, everything
+    // a run changes belongs to this program.
+    m_lazyFlags  = (m_image->header.flags & HF_LAZY_FLAGS) != 0;
+    if (m_lazyFlags)
+        m_operations = m_image->verified ? LazyVerifiedOPCodeTable : LazyOPCodeTable;
+    else
+        m_operations = m_image->verified ? VerifiedOPCodeTable : OPCodeTable;
+    m_dataTable.share(m_image->data);
+
+    rewind(m_image->startinst);
+    return m_engine->prepare(*this);
+}
+
+const ProgramImagePtr& Program::share(void)
+{
+    ProgramImage& img = *m_image;
+    if (img.shared)
+        return m_image;
+
+    // Binding is the only thing that writes to a loaded image. Once
+    // every module is open a call that is still unbound can never be
+    // bound, so bindSymbol only reads from then on.
+    size_t i;
+    for (i = 0; i < img.modules.size(); ++i)
+        loadModule(i);
+
+    // The packed code always has every call, the
+    // source instructions only if the engine runs them.
+    const PackedCode::View code = img.code.view();
+    for (i = 0; i < img.code.size(); ++i)
+    {
+        if (IsHostCall(code.op(i)))
+            bindSymbol(code.aux(i));
+    }
+
+    for (ExecInstruction& ins : img.ins)
+    {
+        if ((ins.flags & IF_SYMU) && ins.call == nullptr)
+        {
+            const HostCall& hc = img.symbols[(size_t)ins.argv[0]];
+            ins.call           = hc.call;
+            ins.abi            = hc.abi;
+        }
+    }
+
+    getImageHash();
+    img.shared = true;
+    return m_image;
 }
 
 int Program::loadStringTable(BlockReader& reader)
 {
-    reader.moveTo(m_header.str);
+    reader.moveTo(m_image->header.str);
     TVMSection strTab;
     reader.read(&strTab, sizeof(TVMSection));
 
@@ -141,7 +314,7 @@ int Program::loadStringTable(BlockReader& reader)
             str.push_back(ch);
         else if (ch != 0)
         {
-            printf("unknown character '%c' was found in the string table\n", ch);
+            reportError("unknown character '%c' was found in the string table", ch);
             st = PS_ERROR;
             i  = strTab.size;
         }
@@ -149,17 +322,17 @@ int Program::loadStringTable(BlockReader& reader)
         {
             if (!str.empty())
             {
-                if (m_strtab.find(str) != m_strtab.end())
+                if (m_image->strtab.find(str) != m_image->strtab.end())
                 {
-                    printf("duplicate string '%s' was found in the string table\n",
-                           str.c_str());
+                    reportError("duplicate string '%s' was found in the string table",
+                                str.c_str());
                     st = PS_ERROR;
                     i  = strTab.size;
                 }
                 else
                 {
-                    m_strtab[str] = tot++;
-                    m_strtablist.push_back(str);
+                    m_image->strtab[str] = tot++;
+                    m_image->strtablist.push_back(str);
                     str.resize(0);
                 }
             }
@@ -179,7 +352,7 @@ int Program::loadStringTable(BlockReader& reader)
 
 int Program::loadSymbolTable(BlockReader& reader)
 {
-    reader.moveTo(m_header.sym);
+    reader.moveTo(m_image->header.sym);
     TVMSection symtab;
     reader.read(&symtab, sizeof(TVMSection));
 
@@ -197,7 +370,7 @@ int Program::loadSymbolTable(BlockReader& reader)
             str.push_back(ch);
         else if (ch != 0)
         {
-            printf("unknown character '%c' was found in the string table\n", ch);
+            reportError("unknown character '%c' was found in the string table", ch);
             st = PS_ERROR;
             i  = symtab.size;
         }
@@ -205,19 +378,11 @@ int Program::loadSymbolTable(BlockReader& reader)
         {
             if (!str.empty())
             {
-                LibHandle lib = nullptr;
-                if (IsModulePresent(str, m_modpath))
+                // With lazy binding a module is only
+                // opened when a call needs one of its symbols.
+                addModule(str);
+                if (!m_image->lazyBind && loadModule(m_image->modules.size() - 1) != PS_OK)
                 {
-                    lib = LoadSharedLibrary(str, m_modpath);
-                    if (lib != nullptr)
-                        m_dynlib.push_back(lib);
-                }
-
-                if (!lib)
-                {
-                    printf("failed to locate the file '%s' in the module directory '%s'\n",
-                           str.c_str(),
-                           m_modpath.c_str());
                     st = PS_ERROR;
                     i  = symtab.size;
                 }
@@ -237,21 +402,130 @@ int Program::loadSymbolTable(BlockReader& reader)
     return st;
 }
 
+void Program::addModule(const str_t& name)
+{
+    m_image->modules.push_back(name);
+    m_image->dynlib.push_back(nullptr);
+    m_image->dynabi.push_back(0);
+}
+
+int Program::loadModule(size_t idx)
+{
+    if (idx >= m_image->modules.size())
+        return PS_ERROR;
+
+    // 0 until the module is opened, -1 once it failed to open.
+    if (m_image->dynabi[idx] != 0)
+        return m_image->dynabi[idx] > 0 ? PS_OK : PS_ERROR;
+
+    const str_t& name = m_image->modules[idx];
+
+    // A builtin module never touches the file system.
+    const BuiltinModule* builtin = FindBuiltinModule(name);
+    if (builtin != nullptr)
+    {
+        m_image->dynabi[idx] = builtin->abi ? builtin->abi() : TVM_ABI_REGISTERS;
+        bindModule(builtin->init(), (uint8_t)m_image->dynabi[idx], idx);
+        return PS_OK;
+    }
+
+    LibHandle lib = nullptr;
+    if (IsModulePresent(name, m_image->modpath))
+        lib = LoadSharedLibrary(name, m_image->modpath);
+
+    if (!lib)
+    {
+        reportError("failed to locate the file '%s' in the module directory '%s'",
+                    name.c_str(),
+                    m_image->modpath.c_str());
+        m_image->dynabi[idx] = -1;
+        return PS_ERROR;
+    }
+
+    LibSymbol abi = GetSymbolAddress(lib, name + "_abi");
+    m_image->dynlib[idx] = lib;
+    m_image->dynabi[idx] = abi ? ((tvmabi_t)abi)() : TVM_ABI_REGISTERS;
+
+    LibSymbol init = GetSymbolAddress(lib, name + "_init");
+    if (init != nullptr)
+        bindModule(((ModuleInit)init)(), (uint8_t)m_image->dynabi[idx], idx);
+    return PS_OK;
+}
+
+void Program::bindModule(const SymbolTable* avail, uint8_t abi, size_t idx)
+{
+    // Resolves each entry of the module's symbol table that the
+    // string table references, so call sites only index m_image->symbols.
+    // The first module that defines a name keeps it.
+    if (avail == nullptr)
+        return;
+
+    m_image->symbols.resize(m_image->strtablist.size(), HostCall{nullptr, TVM_ABI_REGISTERS});
+    m_image->providers.resize(m_image->strtablist.size(), -1);
+
+    int i;
+    for (i = 0; avail[i].name != nullptr; ++i)
+    {
+        LabelMap::iterator it = m_image->strtab.find(avail[i].name);
+        if (it == m_image->strtab.end() || it->second >= m_image->symbols.size())
+            continue;
+
+        HostCall& hc = m_image->symbols[(size_t)it->second];
+        if (hc.call == nullptr)
+        {
+            hc.call = avail[i].callback;
+            hc.abi  = abi;
+
+            m_image->providers[(size_t)it->second] = (int)idx;
+        }
+    }
+}
+
 int Program::loadDataTable(BlockReader& reader)
 {
-    reader.moveTo(m_header.dat);
+    reader.moveTo(m_image->header.dat);
     TVMSection dat;
     reader.read(&dat, sizeof(TVMSection));
 
     if (dat.size <= 0)
         return PS_OK;
 
-    m_dataTable.reserve((size_t)dat.size + (size_t)dat.align);
-    reader.read(m_dataTable.ptr(), m_dataTable.capacity());
+    m_image->data.reserve((size_t)dat.size + (size_t)dat.align);
+    reader.read(m_image->data.ptr(), m_image->data.capacity());
     return PS_OK;
 }
 
-int Program::loadCode(BlockReader& reader)
+int Program::loadExports(BlockReader& reader)
+{
+    // The export table follows the code section.
+    reader.moveTo(sizeof(TVMHeader));
+    TVMSection code;
+    reader.read(&code, sizeof(TVMSection));
+    reader.offset((int64_t)code.size + code.align);
+
+    TVMSection exp;
+    reader.read(&exp, sizeof(TVMSection));
+
+    size_t br = 0;
+    while (br < exp.size && !reader.eof())
+    {
+        uint32_t addr = 0;
+        br += reader.read(&addr, sizeof(uint32_t));
+
+        str_t name;
+        char  ch;
+        while ((ch = (char)reader.next()) != 0)
+            name.push_back(ch);
+        br += name.size() + 1;
+
+        if (name.empty())
+            return PS_ERROR;
+        m_image->exports[name] = addr;
+    }
+    return br == exp.size ? PS_OK : PS_ERROR;
+}
+
+int Program::loadCode(BlockReader& reader, ExecInstructions& lowered)
 {
     reader.moveTo(sizeof(TVMHeader));
     TVMSection code;
@@ -260,136 +534,572 @@ int Program::loadCode(BlockReader& reader)
     if (code.size <= 0)
         return PS_OK;
 
-    uint8_t  v8, i;
-    uint16_t v16, sizes = 0;
-    uint32_t v32;
-    size_t   br = 0;
-
-    while (br < code.size && !reader.eof())
+    size_t br = 0;
+    if (m_image->header.version == TVM_VERSION_1)
     {
-        ExecInstruction exec = {};
+        uint8_t  v8, i;
+        uint16_t v16, sizes = 0;
+        uint32_t v32;
 
-        br += reader.read(&exec.op, 2);
-        br += reader.read(&exec.flags, 2);
-        br += reader.read(&sizes, 2);
+        while (br < code.size && !reader.eof())
+        {
+            ExecInstruction exec = {};
 
-        if (exec.flags & IF_RIDX)
-            br += reader.read(&exec.index, 1);
+            br += reader.read(&exec.op, 2);
+            br += reader.read(&exec.flags, 2);
+            br += reader.read(&sizes, 2);
 
-        for (i = 0; i < exec.argc && i < INS_ARG; ++i)
-        {
-            if (sizes & SizeFlags[i][0])
-            {
-                br += reader.read(&v8, 1);
-                exec.argv[i] = (uint64_t)v8;
-            }
-            else if (sizes & SizeFlags[i][1])
-            {
-                br += reader.read(&v16, 2);
-                exec.argv[i] = (uint64_t)v16;
-            }
-            else if (sizes & SizeFlags[i][2])
+            if (exec.flags & IF_RIDX)
+                br += reader.read(&exec.index, 1);
+
+            for (i = 0; i < exec.argc && i < INS_ARG; ++i)
             {
-                br += reader.read(&v32, 4);
-                exec.argv[i] = (uint64_t)v32;
+                if (sizes & SizeFlags[i][0])
+                {
+                    br += reader.read(&v8, 1);
+                    exec.argv[i] = (uint64_t)v8;
+                }
+                else if (sizes & SizeFlags[i][1])
+                {
+                    br += reader.read(&v16, 2);
+                    exec.argv[i] = (uint64_t)v16;
+                }
+                else if (sizes & SizeFlags[i][2])
+                {
+                    br += reader.read(&v32, 4);
+                    exec.argv[i] = (uint64_t)v32;
+                }
+                else
+                {
+                    br += reader.read(&exec.argv[i], 8);
+                }
             }
-            else
+
+            if (addInstruction(exec) != PS_OK)
+                return PS_ERROR;
+        }
+    }
+    else
+    {
+        reportError("unsupported file version %d", (int)m_image->header.version);
+        return PS_ERROR;
+    }
+
+    if (br != code.size)
+    {
+        reportError("misaligned instructions");
+        return PS_ERROR;
+    }
+
+    m_image->verified = VerifyInstructions(m_image->ins, m_image->data.capacity());
+
+    // The table engine and the debugger work from m_image->ins,
+    // the threaded engine executes the packed lowered copy.
+    LowerInstructions(m_image->ins, lowered, m_image->data.capacity());
+
+    m_image->startinst = 0;
+    if (code.entry < m_image->ins.size())
+        m_image->startinst = code.entry;
+
+    std::vector<uint64_t> entries;
+    getEntryPoints(entries);
+    FuseInstructions(lowered, entries, m_image->fusion);
+    return PS_OK;
+}
+
+int Program::loadCached(CachedImage& cached)
+{
+    // The data table is read from the image as usual, everything
+    // derived from the code comes from the cache. The code is not
+    // tested again, ReadImageCache only accepts what this build wrote.
+    m_image->strtablist.swap(cached.strings);
+    uint64_t i;
+    for (i = 0; i < m_image->strtablist.size(); ++i)
+        m_image->strtab[m_image->strtablist[i]] = i;
+    m_image->symbols.resize(m_image->strtablist.size(), HostCall{nullptr, TVM_ABI_REGISTERS});
+
+    for (const str_t& name : cached.modules)
+    {
+        addModule(name);
+        if (!m_image->lazyBind && loadModule(m_image->modules.size() - 1) != PS_OK)
+        {
+            reportError("failed to read the symbol table");
+            return PS_ERROR;
+        }
+    }
+    m_image->providers.swap(cached.providers);
+
+    if (!m_image->lazyBind)
+    {
+        for (uint32_t call : cached.calls)
+        {
+            if (!bindSymbol(call))
             {
-                br += reader.read(&exec.argv[i], 8);
+                reportError("failed to locate symbol");
+                return PS_ERROR;
             }
         }
+    }
+
+    // Only there when the engine runs it.
+    m_image->ins.swap(cached.source);
+    for (ExecInstruction& ins : m_image->ins)
+    {
+        if ((ins.flags & IF_SYMU) && !m_image->lazyBind)
+        {
+            const HostCall& hc = m_image->symbols[(size_t)ins.argv[0]];
+            ins.call           = hc.call;
+            ins.abi            = hc.abi;
+        }
+    }
+
+    m_image->verified  = cached.verified;
+    m_image->startinst = cached.entry;
+    m_image->fusion    = cached.fusion;
+    m_image->cacheFile = std::move(cached.file);
+
+    std::swap(m_image->code, cached.code);
+    return PS_OK;
+}
+
+void Program::storeCached(const str_t& path, uint64_t hash, size_t size)
+{
+    CachedImage cached = {};
+    cached.moduleStamp = stampModules(m_image->modules);
+    cached.entry       = m_image->startinst;
+    cached.fusion      = m_image->fusion;
+    cached.verified    = m_image->verified;
+    cached.modules     = m_image->modules;
+    cached.providers   = m_image->providers;
+    cached.providers.resize(m_image->strtablist.size(), -1);
+
+    std::vector<bool>      named(m_image->strtablist.size(), false);
+    const PackedCode::View code = m_image->code.view();
+
+    size_t i;
+    for (i = 0; i < m_image->code.size(); ++i)
+    {
+        if (IsHostCall(code.op(i)) && !named[code.aux(i)])
+        {
+            named[code.aux(i)] = true;
+            cached.calls.push_back(code.aux(i));
+        }
+    }
+
+    // Borrowed rather than copied. The source only goes with
+    // it when the engine that loaded the image runs it.
+    cached.strings.swap(m_image->strtablist);
+    std::swap(cached.code, m_image->code);
+    if (m_engine->runsSource())
+        cached.source.swap(m_image->ins);
+
+    // A cache that cannot be written only costs the next load time.
+    WriteImageCache(path, hash, size, cached);
+
+    cached.strings.swap(m_image->strtablist);
+    std::swap(cached.code, m_image->code);
+    if (m_engine->runsSource())
+        cached.source.swap(m_image->ins);
+}
+
+uint64_t Program::stampModules(const strvec_t& modules) const
+{
+    uint64_t stamp = TVM_HASH_SEED;
+    for (const str_t& name : modules)
+    {
+        uint64_t mod = 1;
+        if (FindBuiltinModule(name) == nullptr)
+            mod = GetModuleStamp(name, m_image->modpath);
+        stamp = HashBytes(name.c_str(), name.size(), stamp);
+        stamp = HashBytes(&mod, sizeof(uint64_t), stamp);
+    }
+    return stamp;
+}
+
+bool Program::bindSymbol(size_t idx)
+{
+    m_image->symbols.resize(m_image->strtablist.size(), HostCall{nullptr, TVM_ABI_REGISTERS});
+    m_image->providers.resize(m_image->strtablist.size(), -1);
+
+    HostCall& hc = m_image->symbols[idx];
+    if (hc.call != nullptr)
+        return true;
+
+    // A cached image knows which module provided the symbol last time.
+    int provider = m_image->providers[idx];
+    if (provider >= 0 && loadModule((size_t)provider) == PS_OK && hc.call != nullptr)
+        return true;
+
+    // Otherwise open the modules that have not been needed yet until
+    // one of them has it. Modules without a symbol table are searched
+    // for the exported '__' name. A module that fails to open is
+    // reported once and skipped.
+    str_t  look = "__" + m_image->strtablist[idx];
+    size_t i;
+
+    for (i = 0; i < m_image->modules.size(); ++i)
+    {
+        if (loadModule(i) != PS_OK)
+            continue;
+        if (hc.call != nullptr)
+            return true;
+
+        LibSymbol sym = GetSymbolAddress(m_image->dynlib[i], look.c_str());
+        if (sym != nullptr)
+        {
+            hc.call                 = (Symbol)sym;
+            hc.abi                  = (uint8_t)m_image->dynabi[i];
+            m_image->providers[idx] = (int)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+int Program::addInstruction(ExecInstruction& exec)
+{
+    if (exec.flags & IF_SYMU)
+    {
+        if (findDynamic(exec) != PS_OK)
+        {
+            reportError("failed to locate symbol");
+            return PS_ERROR;
+        }
+    }
+
+    if (!testInstruction(exec))
+        return PS_ERROR;
+
+    m_image->ins.push_back(exec);
+    return PS_OK;
+}
+
+int Program::findDynamic(ExecInstruction& ins)
+{
+    size_t idx = (size_t)ins.argv[0];
+    if (idx >= m_image->strtablist.size())
+        return PS_ERROR;
+
+    // The call is bound when it is first executed.
+    if (m_image->lazyBind)
+        return PS_OK;
+
+    if (!bindSymbol(idx))
+        return PS_ERROR;
+
+    ins.call = m_image->symbols[idx].call;
+    ins.abi  = m_image->symbols[idx].abi;
+    return PS_OK;
+}
+
+bool Program::bindCall(size_t idx, const ExecInstruction* inst)
+{
+    if (!bindSymbol(idx))
+    {
+        reportError("failed to locate the symbol '%s'", m_image->strtablist[idx].c_str());
+        forceExit(-1);
+        return false;
+    }
+
+    // Quicken the call so the next execution goes straight to
+    // the function. A shared image was bound by share instead.
+    const HostCall& hc = m_image->symbols[idx];
+    if (m_image->shared)
+        return true;
+
+    if (inst >= m_image->ins.data() && inst < m_image->ins.data() + m_image->ins.size())
+    {
+        ExecInstruction& ins = m_image->ins[(size_t)(inst - m_image->ins.data())];
+        ins.call             = hc.call;
+        ins.abi              = hc.abi;
+    }
+    return true;
+}
+
+int Program::launch(void)
+{
+    if (m_image->code.size() == 0)
+        return PS_OK;
+
+    m_callStack.push(m_curinst);
+    return resume();
+}
+
+int Program::resume(void)
+{
+    if (m_image->code.size() == 0)
+        return PS_OK;
+
+    m_engine->execute(*this);
+
+    if (m_return == -1)
+        reportError("an error occurred");
+    m_output.flush();
+
+    return m_return;
+}
+
+int Program::runTo(uint64_t addr)
+{
+    if (addr >= m_image->code.size())
+    {
+        printf("invalid address %llu\n", (unsigned long long)addr);
+        return PS_ERROR;
+    }
+
+    m_callStack.push(m_curinst);
+    m_engine->runTo(*this, addr);
+
+    m_output.flush();
+    if (m_curinst != addr)
+    {
+        printf("the program ended before reaching address %llu\n", (unsigned long long)addr);
+        return PS_ERROR;
+    }
+    return PS_OK;
+}
+
+int Program::saveState(const str_t& path)
+{
+    VMSnapshot state = {};
+    state.imageHash  = getImageHash();
+    state.curinst    = m_curinst;
+    state.flags      = m_flags;
+    state.ret        = m_return;
+    state.compare[0] = m_compare[0];
+    state.compare[1] = m_compare[1];
+    state.modules    = m_image->modules;
+    state.dataBase   = (uint64_t)(size_t)m_dataTable.ptr();
+    state.dataSize   = (uint64_t)m_dataTable.capacity();
+    memcpy(state.regi, m_regi, sizeof(Registers));
+
+    // peek counts from the top.
+    uint32_t i;
+    for (i = m_callStack.size(); i > 0; --i)
+        state.callStack.push_back(m_callStack.peek(i - 1));
+    for (i = m_stack.size(); i > 0; --i)
+        state.stack.push_back(m_stack.peek(i - 1));
+
+    for (int abi : m_image->dynabi)
+        state.opened.push_back(abi > 0 ? 1 : 0);
+
+    return WriteSnapshot(path, state, m_dataTable.ptr());
+}
+
+int Program::restoreState(const str_t& path)
+{
+    VMSnapshot state = {};
+    if (ReadSnapshot(path, state) != PS_OK)
+        return PS_ERROR;
+
+    if (state.imageHash != getImageHash() ||
+        state.dataSize != (uint64_t)m_dataTable.capacity() ||
+        state.modules != m_image->modules ||
+        state.curinst >= m_image->code.size() ||
+        state.callStack.empty())
+    {
+        printf("the snapshot '%s' was not taken from this program\n", path.c_str());
+        return PS_ERROR;
+    }
+
+    // Registers and stack slots are restored as they were saved, so
+    // any adrp result in them is only valid if the table is back at
+    // its old address. Compiled code points into the table as well.
+    if (state.dataSize > 0 && state.dataBase != (uint64_t)(size_t)m_dataTable.ptr())
+    {
+        if (!m_dataTable.moveTo(state.dataBase))
+        {
+            printf("the data table cannot be placed at its saved address 0x%llx\n",
+                   (unsigned long long)state.dataBase);
+            return PS_ERROR;
+        }
+        if (m_engine->prepare(*this) != PS_OK)
+            return PS_ERROR;
+    }
+
+    if (!m_dataTable.load(path.c_str(), state.dataOffset))
+    {
+        printf("failed to read the data table from '%s'\n", path.c_str());
+        return PS_ERROR;
+    }
+
+    size_t i;
+    for (i = 0; i < m_image->modules.size(); ++i)
+    {
+        if (state.opened[i] && loadModule(i) != PS_OK)
+            return PS_ERROR;
+    }
+
+    rewind(state.curinst);
+    m_flags      = state.flags;
+    m_return     = state.ret;
+    m_compare[0] = state.compare[0];
+    m_compare[1] = state.compare[1];
+
+    memcpy(m_regi, state.regi, sizeof(Registers));
+    for (uint64_t v : state.callStack)
+        m_callStack.push(v);
+    for (uint64_t v : state.stack)
+        m_stack.push(v);
+    return PS_OK;
+}
+
+uint64_t Program::getImageHash(void)
+{
+    // The file is read again the first time a snapshot needs the
+    // hash. One that has changed since it was loaded hashes to 0,
+    // which no snapshot matches.
+    ProgramImage& img = *m_image;
+    if (!img.hashed && !img.shared)
+    {
+        BlockReader reader = BlockReader(img.path.c_str());
+        if (!reader.eof() && reader.size() == img.size)
+            img.hash = HashBytes(reader.ptr(), reader.size(), TVM_HASH_SEED);
+        img.hashed = true;
+    }
+    return img.hash;
+}
+
+void Program::rewind(uint64_t addr)
+{
+    m_flags      = 0;
+    m_compare[0] = 0;
+    m_compare[1] = 0;
+    m_return     = 0;
+    m_curinst    = addr;
+    m_exit       = false;
+
+    m_host.context.status = 0;
+    m_callStack.resize(0);
+    m_stack.resize(0);
+
+    m_engine->rewind(*this, addr);
+}
+
+void Program::setInput(FILE* stream)
+{
+    setInput(ReadInput, stream != nullptr ? stream : stdin);
+}
+
+void Program::setInput(int (*read)(void* input), void* input)
+{
+    m_host.context.input = input;
+    m_host.context.read  = read;
+}
+
+void Program::reset(void)
+{
+    m_dataTable.restore();
+    m_output.flush();
+
+    memset(m_regi, 0, sizeof(Registers));
+    rewind(m_image->startinst);
+}
+
+void Program::getEntryPoints(std::vector<uint64_t>& dest) const
+{
+    // Exports are entered from the host like main.
+    dest.push_back(m_image->startinst);
 
-        if (exec.flags & IF_SYMU)
-        {
-            if (findDynamic(exec) != PS_OK)
-            {
-                printf("failed to locate symbol\n");
-                return PS_ERROR;
-            }
-        }
+    AddressLookup::const_iterator it;
+    for (it = m_image->exports.begin(); it != m_image->exports.end(); ++it)
+        dest.push_back(it->second);
+}
 
-        if (testInstruction(exec))
-            m_ins.push_back(exec);
-        else
-            return PS_ERROR;
-    }
+uint64_t Program::findExport(const str_t& name) const
+{
+    AddressLookup::const_iterator it = m_image->exports.find(name);
+    if (it != m_image->exports.end())
+        return it->second;
+    return -1;
+}
 
-    if (br != code.size)
+int Program::call(uint64_t addr)
+{
+    if (addr >= m_image->code.size())
     {
-        printf("misaligned instructions\n");
-        return PS_ERROR;
+        reportError("invalid call address %llu", (unsigned long long)addr);
+        return -1;
     }
 
-    m_curinst = 0;
-    if (code.entry < m_ins.size())
-        m_curinst = code.entry;
-    m_startinst = m_curinst;
-    return PS_OK;
+    rewind(addr);
+    return launch();
 }
 
-int Program::findDynamic(ExecInstruction& ins)
+int Program::setEngine(const str_t& name)
 {
-    if (ins.argv[0] < m_strtablist.size())
+    const EngineInfo* info = FindEngine(name);
+    if (!info)
     {
-        str_t name = m_strtablist.at((size_t)ins.argv[0]), look;
+        reportError("unknown execution engine '%s'", name.c_str());
+        return PS_ERROR;
+    }
 
-        // This needs to change to something better.
-        // It should be a predictable identifier to look up
-        // exported functions by the symbol itself rather
-        // than having to iterate over a table to find a named
-        // symbol
-        look = "__" + name;
+    if (!info->create)
+    {
+        reportError("the '%s' engine is not available in this build", name.c_str());
+        return PS_ERROR;
+    }
 
-        SymbolMap::iterator it = m_symbols.find(name);
-        if (it == m_symbols.end())
-        {
-            Symbol search = nullptr;
+    setEngine(info->create());
+    return PS_OK;
+}
 
-            DynamicLib::iterator it = m_dynlib.begin();
-            while (it != m_dynlib.end() && search == nullptr)
-            {
-                LibHandle lib = (*it++);
-                LibSymbol sym = GetSymbolAddress(lib, look.c_str());
+void Program::setEngine(Engine* engine)
+{
+    if (engine)
+    {
+        delete m_engine;
+        m_engine = engine;
+    }
+}
 
-                if (sym != nullptr)
-                {
-                    search          = (Symbol)sym;
-                    m_symbols[name] = search;
-                }
-            }
+size_t Program::getVerifiedCount(void) const
+{
+    const PackedCode::View code = m_image->code.view();
 
-            ins.call = search;
-        }
-        else
-            ins.call = it->second;
+    size_t i, count = 0;
+    for (i = 0; i < m_image->code.size(); ++i)
+    {
+        if (code.op(i) >= MOP_ADRP_V)
+            ++count;
     }
-
-    return ins.call != nullptr ? (int)PS_OK : (int)PS_ERROR;
+    return count;
 }
 
-int Program::launch(void)
+MemoryFootprint Program::getFootprint(void) const
 {
-    if (m_ins.empty())
-        return PS_OK;
+    MemoryFootprint mf = {};
+
+    mf.instructions = m_image->code.size();
+    mf.source       = m_image->ins.size() * sizeof(ExecInstruction);
+    mf.packed       = m_image->code.footprint();
+    mf.data         = m_dataTable.capacity();
+    mf.state        = sizeof(Program) + (m_stack.capacity() + m_callStack.capacity()) * sizeof(ArrayStack::Data);
+
+    strvec_t::const_iterator it = m_image->strtablist.begin();
+    while (it != m_image->strtablist.end())
+        mf.strings += (it++)->size() + 1;
+    return mf;
+}
 
-    size_t                 tinst   = m_ins.size();
-    const ExecInstruction* basePtr = m_ins.data();
-    m_callStack.push(m_curinst);
+const char* Program::getEngineName(void) const
+{
+    return m_engine->getName();
+}
 
-    while (m_curinst < tinst && !m_exit)
-    {
-        const ExecInstruction& inst = basePtr[m_curinst++];
-        if (inst.op > OP_BEG && inst.op < OP_MAX)
-        {
-            if (OPCodeTable[inst.op] != nullptr)
-                (this->*OPCodeTable[inst.op])(inst);
-        }
-    }
+void Program::reportError(const char* fmt, ...)
+{
+    // Keeps the message after the output that came before it.
+    m_output.sync();
 
-    if (m_return == -1)
-        printf("an error occurred\n");
+    FILE* stream = m_output.getStream();
 
-    return m_return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stream, fmt, args);
+    va_end(args);
+    fputc('\n', stream);
 }
 
 void Program::forceExit(int returnCode)
@@ -399,17 +1109,28 @@ void Program::forceExit(int returnCode)
     m_exit    = true;
 }
 
-Register* Program::clone(void)
+void Program::callHost(Symbol call, uint8_t abi)
 {
-    Register* reg = new Register[MAX_REG];
-    memcpy(reg, m_regi, MaxRegisterSize);
-    return reg;
-}
+    // The data table is looked up on each call
+    // since the debugger can replace it.
+    tvmcontext_t& ctx = m_host.context;
+    ctx.data          = m_dataTable.ptr();
+    ctx.dataSize      = m_dataTable.capacity();
+    ctx.status        = 0;
+
+    memcpy(m_host.window, m_regi, sizeof(Registers));
+    if (abi == TVM_ABI_CONTEXT)
+        ((tvmcall_t)call)(&ctx);
+    else
+    {
+        // A register ABI module writes through stdio.
+        m_output.sync();
+        call(ctx.regi);
+    }
+    memcpy(m_regi, m_host.window, sizeof(Registers));
 
-void Program::release(Register* reg)
-{
-    memcpy(m_regi, reg, MaxRegisterSize);
-    delete[] reg;
+    if (ctx.status != 0)
+        forceExit(ctx.status);
 }
 
 void Program::derefRegister(const uint64_t& x0, const uint32_t& flags, uint8_t* ptr)
@@ -494,15 +1215,11 @@ void Program::handle_OP_CALL(const ExecInstruction& inst)
     if (inst.flags & IF_SYMU)
     {
         if (inst.call != nullptr)
+            callHost(inst.call, inst.abi);
+        else if (m_image->lazyBind && bindCall((size_t)inst.argv[0], &inst))
         {
-            // This does not guard against corrupting the cl
-            // pointer, but it allows access to the registers
-            // without passing the address of m_regi
-            // which can then be used to access internal
-            // class members.
-            Register* cl = clone();
-            inst.call((tvmregister_t)cl);
-            release(cl);
+            const HostCall& hc = m_image->symbols[(size_t)inst.argv[0]];
+            callHost(hc.call, hc.abi);
         }
     }
     else if (inst.flags & IF_ADDR)
@@ -511,13 +1228,13 @@ void Program::handle_OP_CALL(const ExecInstruction& inst)
         m_curinst = inst.argv[0];
         if (m_callStack.size() > MAX_STK)
         {
-            printf("maximum number of branches exceeded.\n");
+            reportError("maximum number of branches exceeded.");
             forceExit(-1);
         }
     }
     else
     {
-        printf("unknown call flag\n");
+        reportError("unknown call flag");
         forceExit(-1);
     }
 }
@@ -622,6 +1339,59 @@ void Program::handle_OP_JGT(const ExecInstruction& inst)
     }
 }
 
+// With lazy flags the compare only records its operands and
+// the branch evaluates its condition from them.
+void Program::handle_OP_CMP_L(const ExecInstruction& inst)
+{
+    uint64_t a = inst.argv[0];
+    uint64_t b = inst.argv[1];
+
+    if (inst.flags & IF_REG0)
+        a = m_regi[a].x;
+
+    if (inst.flags & IF_REG1)
+        b = m_regi[b].x;
+
+    m_compare[0] = (int64_t)a;
+    m_compare[1] = (int64_t)b;
+}
+
+void Program::handle_OP_JEQ_L(const ExecInstruction& inst)
+{
+    if (m_compare[0] == m_compare[1])
+        m_curinst = inst.argv[0];
+}
+
+void Program::handle_OP_JNE_L(const ExecInstruction& inst)
+{
+    if (m_compare[0] != m_compare[1])
+        m_curinst = inst.argv[0];
+}
+
+void Program::handle_OP_JLE_L(const ExecInstruction& inst)
+{
+    if (m_compare[0] <= m_compare[1])
+        m_curinst = inst.argv[0];
+}
+
+void Program::handle_OP_JGE_L(const ExecInstruction& inst)
+{
+    if (m_compare[0] >= m_compare[1])
+        m_curinst = inst.argv[0];
+}
+
+void Program::handle_OP_JLT_L(const ExecInstruction& inst)
+{
+    if (m_compare[0] < m_compare[1])
+        m_curinst = inst.argv[0];
+}
+
+void Program::handle_OP_JGT_L(const ExecInstruction& inst)
+{
+    if (m_compare[0] > m_compare[1])
+        m_curinst = inst.argv[0];
+}
+
 void Program::handle_OP_ADD(const ExecInstruction& inst)
 {
     const uint64_t& x0 = inst.argv[0];
@@ -710,6 +1480,23 @@ void Program::handle_OP_MUL(const ExecInstruction& inst)
 }
 
 void Program::handle_OP_DIV(const ExecInstruction& inst)
+{
+    bool immediate;
+    if (inst.argc > 2)
+        immediate = (inst.flags & IF_REG2) == 0;
+    else
+        immediate = (inst.flags & IF_REG1) == 0;
+
+    if (immediate && inst.argv[inst.argc - 1] == 0)
+    {
+        reportError("divide by zero");
+        forceExit(-1);
+    }
+    else
+        handle_OP_DIV_V(inst);
+}
+
+void Program::handle_OP_DIV_V(const ExecInstruction& inst)
 {
     const uint64_t& x0 = inst.argv[0];
     if (inst.argc > 2)
@@ -726,7 +1513,7 @@ void Program::handle_OP_DIV(const ExecInstruction& inst)
             m_regi[x0].x = b / c;
         else
         {
-            printf("divide by zero\n");
+            reportError("divide by zero");
             forceExit(-1);
         }
     }
@@ -738,20 +1525,12 @@ void Program::handle_OP_DIV(const ExecInstruction& inst)
                 m_regi[x0].x /= m_regi[inst.argv[1]].x;
             else
             {
-                printf("divide by zero\n");
+                reportError("divide by zero");
                 forceExit(-1);
             }
         }
         else
-        {
-            if (inst.argv[1] != 0)
-                m_regi[x0].x /= inst.argv[1];
-            else
-            {
-                printf("divide by zero\n");
-                forceExit(-1);
-            }
-        }
+            m_regi[x0].x /= inst.argv[1];
     }
 }
 
@@ -808,90 +1587,101 @@ void Program::handle_OP_ADRP(const ExecInstruction& inst)
     if (inst.flags & IF_REG0 && inst.flags & IF_ADRD)
     {
         if (inst.argv[1] < m_dataTable.capacity())
-        {
-            uint8_t* base          = m_dataTable.ptr();
-            m_regi[inst.argv[0]].x = (size_t)(&base[inst.argv[1]]);
-        }
+            handle_OP_ADRP_V(inst);
     }
 }
 
+void Program::handle_OP_ADRP_V(const ExecInstruction& inst)
+{
+    uint8_t* base          = m_dataTable.ptr();
+    m_regi[inst.argv[0]].x = (size_t)(&base[inst.argv[1]]);
+}
+
 void Program::handle_OP_STP(const ExecInstruction& inst)
+{
+    if (inst.flags & IF_STKP && inst.argv[1] / 8 > MAX_STACK_REL)
+    {
+        // stp sp, > 256
+        reportError("Stack size exceeded");
+        forceExit(-1);
+    }
+    else
+        handle_OP_STP_V(inst);
+}
+
+void Program::handle_OP_STP_V(const ExecInstruction& inst)
 {
     if (inst.flags & IF_STKP)
     {
         uint64_t nrel = inst.argv[1] / 8;
-        if (nrel > 32)
+        if (m_stack.size() >= MAX_STK)
         {
-            // stp sp, > 256
-            printf("Stack size exceeded\n");
-            forceExit(-1);
+            reportError("stack overflow.");
+            forceExit(-2);
         }
         else
         {
-            if (m_stack.size() >= MAX_STK)
-            {
-                printf("stack overflow.\n");
-                forceExit(-2);
-            }
-            else
-            {
-                uint64_t i;
-                for (i = 0; i < nrel; ++i)
-                    m_stack.push(0);
-            }
+            uint64_t i;
+            for (i = 0; i < nrel; ++i)
+                m_stack.push(0);
         }
     }
 }
 
 void Program::handle_OP_LDP(const ExecInstruction& inst)
+{
+    if (inst.flags & IF_STKP && inst.argv[1] / 8 > MAX_STACK_REL)
+    {
+        // stp sp, > 256
+        reportError("stack size exceeded");
+        forceExit(-1);
+    }
+    else
+        handle_OP_LDP_V(inst);
+}
+
+void Program::handle_OP_LDP_V(const ExecInstruction& inst)
 {
     if (inst.flags & IF_STKP)
     {
         uint64_t nrel = inst.argv[1] / 8;
-        if (nrel > 32)
-        {
-            // stp sp, > 256
-            printf("stack size exceeded\n");
-            forceExit(-1);
-        }
-        else
-        {
-            uint64_t i;
-            for (i = 0; i < nrel && !m_stack.empty(); ++i)
-                m_stack.pop();
-        }
+        uint64_t i;
+        for (i = 0; i < nrel && !m_stack.empty(); ++i)
+            m_stack.pop();
     }
 }
 
 void Program::handle_OP_STR(const ExecInstruction& inst)
+{
+    if (inst.flags & IF_STKP && inst.argv[1] / 8 > MAX_STACK_REL)
+    {
+        reportError("Stack size exceeded");
+        forceExit(-1);
+    }
+    else
+        handle_OP_STR_V(inst);
+}
+
+void Program::handle_OP_STR_V(const ExecInstruction& inst)
 {
     if (inst.flags & IF_STKP)
     {
-        uint64_t nrel = inst.argv[1] / 8;
-        if (nrel > 32)
-        {
-            printf("Stack size exceeded\n");
-            forceExit(-1);
-        }
-        else
-        {
-            // o1 -> o2
-            uint32_t stk = m_stack.size();
-            uint32_t idx = (inst.index / 8);
-            uint32_t rem = (inst.index % 8);
+        // o1 -> o2
+        uint32_t stk = m_stack.size();
+        uint32_t idx = (inst.index / 8);
+        uint32_t rem = (inst.index % 8);
 
-            if (inst.flags & IF_REG0)
+        if (inst.flags & IF_REG0)
+        {
+            if (idx < stk)
             {
-                if (idx < stk)
+                uint64_t& dest = m_stack.peek(idx);
+
+                if (rem == 0)
+                    dest = m_regi[inst.argv[0]].x;
+                else
                 {
-                    uint64_t& dest = m_stack.peek(idx);
-
-                    if (rem == 0)
-                        dest = m_regi[inst.argv[0]].x;
-                    else
-                    {
-                        // place elsewhere in the register
-                    }
+                    // place elsewhere in the register
                 }
             }
         }
@@ -899,33 +1689,35 @@ void Program::handle_OP_STR(const ExecInstruction& inst)
 }
 
 void Program::handle_OP_LDR(const ExecInstruction& inst)
+{
+    if (inst.flags & IF_STKP && inst.argv[1] / 8 > MAX_STACK_REL)
+    {
+        reportError("Stack size exceeded");
+        forceExit(-1);
+    }
+    else
+        handle_OP_LDR_V(inst);
+}
+
+void Program::handle_OP_LDR_V(const ExecInstruction& inst)
 {
     if (inst.flags & IF_STKP)
     {
-        uint64_t nrel = inst.argv[1] / 8;
-        if (nrel > 32)
-        {
-            printf("Stack size exceeded\n");
-            forceExit(-1);
-        }
-        else
-        {
-            // o1 <- o2
-            size_t stk = m_stack.size();
-            size_t idx = (inst.index / 8);
-            size_t rem = (inst.index % 8);
+        // o1 <- o2
+        size_t stk = m_stack.size();
+        size_t idx = (inst.index / 8);
+        size_t rem = (inst.index % 8);
 
-            if (inst.flags & IF_REG0)
+        if (inst.flags & IF_REG0)
+        {
+            if (idx < stk)
             {
-                if (idx < stk)
+                const uint64_t& src = m_stack.peek(idx);
+                if (rem == 0)
+                    m_regi[inst.argv[0]].x = src;
+                else
                 {
-                    const uint64_t& src = m_stack.peek(idx);
-                    if (rem == 0)
-                        m_regi[inst.argv[0]].x = src;
-                    else
-                    {
-                        // place elsewhere in the register
-                    }
+                    // place elsewhere in the register
                 }
             }
         }
@@ -955,6 +1747,12 @@ void Program::handle_OP_LDR(const ExecInstruction& inst)
 }
 
 void Program::handle_OP_LDRS(const ExecInstruction& inst)
+{
+    if (inst.index < MAX_REG)
+        handle_OP_LDRS_V(inst);
+}
+
+void Program::handle_OP_LDRS_V(const ExecInstruction& inst)
 {
     if (inst.flags & IF_REG1)
     {
@@ -968,17 +1766,20 @@ void Program::handle_OP_LDRS(const ExecInstruction& inst)
 
         if (ptr)
         {
-            if (inst.index < MAX_REG)
-            {
-                size_t i = (size_t)m_regi[inst.index].x;
-                if (i < m_dataTable.capacity())
-                    dreg.x = ptr[i];
-            }
+            size_t i = (size_t)m_regi[inst.index].x;
+            if (i < m_dataTable.capacity())
+                dreg.x = ptr[i];
         }
     }
 }
 
 void Program::handle_OP_STRS(const ExecInstruction& inst)
+{
+    if (inst.index < MAX_REG)
+        handle_OP_STRS_V(inst);
+}
+
+void Program::handle_OP_STRS_V(const ExecInstruction& inst)
 {
     if (inst.flags & IF_REG1)
     {
@@ -990,12 +1791,9 @@ void Program::handle_OP_STRS(const ExecInstruction& inst)
         uint8_t* ptr  = (uint8_t*)sptr;
         if (ptr)
         {
-            if (inst.index < MAX_REG)
-            {
-                size_t i = (size_t)m_regi[inst.index].x;
-                if (i < m_dataTable.capacity())
-                    ptr[i] = (uint8_t)dreg.x;
-            }
+            size_t i = (size_t)m_regi[inst.index].x;
+            if (i < m_dataTable.capacity())
+                ptr[i] = (uint8_t)dreg.x;
         }
     }
 }
@@ -1003,32 +1801,14 @@ void Program::handle_OP_STRS(const ExecInstruction& inst)
 void Program::handle_OP_PRG(const ExecInstruction& inst)
 {
     if (inst.flags & IF_REG0)
-    {
-        cout << (int64_t)m_regi[inst.argv[0]].x << std::endl;
-    }
+        m_output.printInteger((int64_t)m_regi[inst.argv[0]].x);
     else
-    {
-        cout << (int64_t)inst.argv[0] << std::endl;
-    }
+        m_output.printInteger((int64_t)inst.argv[0]);
 }
 
 void Program::handle_OP_PRGI(const ExecInstruction& inst)
 {
-    int i;
-
-    stringstream ss;
-    for (i = 0; i < MAX_REG; ++i)
-    {
-        ss << "0x" << setfill('0') << uppercase << hex << m_regi[i].x;
-        cout << ' ' << 'x' << left << setw(4) << i << ' ';
-        cout << right << setw(17) << ss.str();
-        cout << ' ';
-        cout << dec;
-        cout << setw(22);
-        cout << m_regi[i].x;
-        cout << endl;
-        ss.str("");
-    }
+    m_output.printRegisters(m_regi, MAX_REG);
 }
 
 bool Program::testInstruction(const ExecInstruction& exec)
@@ -1036,7 +1816,7 @@ bool Program::testInstruction(const ExecInstruction& exec)
     bool pass = exec.op > OP_BEG && exec.op < OP_MAX;
     if (!pass)
     {
-        printf("instruction boundary exceeded\n");
+        reportError("instruction boundary exceeded");
         return false;
     }
 
@@ -1085,7 +1865,7 @@ bool Program::testInstruction(const ExecInstruction& exec)
 
     if (!pass)
     {
-        printf("invalid argument count\n");
+        reportError("invalid argument count");
         return false;
     }
 
@@ -1121,7 +1901,7 @@ bool Program::testInstruction(const ExecInstruction& exec)
     case OP_CMP:
         if (exec.flags & IF_REG0)
             pass = exec.argv[0] < MAX_REG;
-        if (exec.flags & IF_REG1)
+        if (pass && exec.flags & IF_REG1)
             pass = exec.argv[1] < MAX_REG;
         break;
     case OP_ADRP:
@@ -1159,7 +1939,7 @@ bool Program::testInstruction(const ExecInstruction& exec)
             if (pass)
             {
                 if (exec.flags & IF_ADRD)
-                    pass = exec.argv[2] < m_dataTable.capacity();
+                    pass = exec.argv[2] < m_image->data.capacity();
                 else if (exec.flags & IF_REG2)
                     pass = exec.argv[2] < MAX_REG;
             }
@@ -1171,12 +1951,46 @@ bool Program::testInstruction(const ExecInstruction& exec)
     }
     if (!pass)
     {
-        printf("invalid instruction\n");
+        reportError("invalid instruction");
         return false;
     }
     return true;
 }
 
+// Used when VerifyInstructions has proven the tests that these
+// handlers skip.
+const Program::Operation Program::VerifiedOPCodeTable[] = {
+    nullptr,
+    &Program::handle_OP_RET,
+    &Program::handle_OP_MOV,
+    &Program::handle_OP_CALL,
+    &Program::handle_OP_INC,
+    &Program::handle_OP_DEC,
+    &Program::handle_OP_CMP,
+    &Program::handle_OP_JMP,
+    &Program::handle_OP_JEQ,
+    &Program::handle_OP_JNE,
+    &Program::handle_OP_JLT,
+    &Program::handle_OP_JGT,
+    &Program::handle_OP_JLE,
+    &Program::handle_OP_JGE,
+    &Program::handle_OP_ADD,
+    &Program::handle_OP_SUB,
+    &Program::handle_OP_MUL,
+    &Program::handle_OP_DIV_V,
+    &Program::handle_OP_SHR,
+    &Program::handle_OP_SHL,
+    &Program::handle_OP_ADRP_V,
+    &Program::handle_OP_STR_V,
+    &Program::handle_OP_LDR_V,
+    &Program::handle_OP_LDRS_V,
+    &Program::handle_OP_STRS_V,
+    &Program::handle_OP_STP_V,
+    &Program::handle_OP_LDP_V,
+    &Program::handle_OP_PRG,
+    &Program::handle_OP_PRGI,
+};
+
 const Program::Operation Program::OPCodeTable[] = {
     nullptr,
     &Program::handle_OP_RET,
@@ -1208,3 +2022,70 @@ const Program::Operation Program::OPCodeTable[] = {
     &Program::handle_OP_PRG,
     &Program::handle_OP_PRGI,
 };
+
+// Images compiled with lazy flags only record the compare operands.
+const Program::Operation Program::LazyOPCodeTable[] = {
+    nullptr,
+    &Program::handle_OP_RET,
+    &Program::handle_OP_MOV,
+    &Program::handle_OP_CALL,
+    &Program::handle_OP_INC,
+    &Program::handle_OP_DEC,
+    &Program::handle_OP_CMP_L,
+    &Program::handle_OP_JMP,
+    &Program::handle_OP_JEQ_L,
+    &Program::handle_OP_JNE_L,
+    &Program::handle_OP_JLT_L,
+    &Program::handle_OP_JGT_L,
+    &Program::handle_OP_JLE_L,
+    &Program::handle_OP_JGE_L,
+    &Program::handle_OP_ADD,
+    &Program::handle_OP_SUB,
+    &Program::handle_OP_MUL,
+    &Program::handle_OP_DIV,
+    &Program::handle_OP_SHR,
+    &Program::handle_OP_SHL,
+    &Program::handle_OP_ADRP,
+    &Program::handle_OP_STR,
+    &Program::handle_OP_LDR,
+    &Program::handle_OP_LDRS,
+    &Program::handle_OP_STRS,
+    &Program::handle_OP_STP,
+    &Program::handle_OP_LDP,
+    &Program::handle_OP_PRG,
+    &Program::handle_OP_PRGI,
+};
+
+// The verified table for images compiled with lazy flags.
+const Program::Operation Program::LazyVerifiedOPCodeTable[] = {
+    nullptr,
+    &Program::handle_OP_RET,
+    &Program::handle_OP_MOV,
+    &Program::handle_OP_CALL,
+    &Program::handle_OP_INC,
+    &Program::handle_OP_DEC,
+    &Program::handle_OP_CMP_L,
+    &Program::handle_OP_JMP,
+    &Program::handle_OP_JEQ_L,
+    &Program::handle_OP_JNE_L,
+    &Program::handle_OP_JLT_L,
+    &Program::handle_OP_JGT_L,
+    &Program::handle_OP_JLE_L,
+    &Program::handle_OP_JGE_L,
+    &Program::handle_OP_ADD,
+    &Program::handle_OP_SUB,
+    &Program::handle_OP_MUL,
+    &Program::handle_OP_DIV_V,
+    &Program::handle_OP_SHR,
+    &Program::handle_OP_SHL,
+    &Program::handle_OP_ADRP_V,
+    &Program::handle_OP_STR_V,
+    &Program::handle_OP_LDR_V,
+    &Program::handle_OP_LDRS_V,
+    &Program::handle_OP_STRS_V,
+    &Program::handle_OP_STP_V,
+    &Program::handle_OP_LDP_V,
+    &Program::handle_OP_PRG,
+    &Program::handle_OP_PRGI,
+};
+
@@ -23,41 +23,120 @@
 #define _Program_h_
 
 #include <stdint.h>
+#include <memory>
 #include <stack>
 #include <unordered_map>
 #include <vector>
 #include "BlockReader.h"
+#include "DataTable.h"
 #include "Declarations.h"
+#include "Engine.h"
+#include "ImageCache.h"
+#include "Lowering.h"
 #include "MemoryStream.h"
+#include "Output.h"
+#include "Packed.h"
+#include "Snapshot.h"
+#include "SymbolUtils.h"
+
+// Preallocated state that is handed to host functions. The registers
+// are copied into the window around each call, so a host function
+// never sees the address of the program's own register file.
+struct HostArena
+{
+    Registers    window;
+    tvmcontext_t context;
+};
+
+struct MemoryFootprint
+{
+    size_t instructions;  // number of instructions
+    size_t source;        // bytes used by the ExecInstruction list, when the engine runs it
+    size_t packed;        // bytes used by the packed code and wide table
+    size_t data;          // bytes used by the data table
+    size_t strings;       // bytes used by the string table
+    size_t state;         // bytes owned by the program rather than its image
+};
+
+// What load produces: the code, the string and symbol tables, the
+// modules that were opened and the data table as the file left it.
+// Once Program::share has returned it nothing writes to it, and any
+// number of programs on any number of threads can run it at once,
+// each with its own registers, stacks and copy of the data table.
+struct ProgramImage
+{
+    TVMHeader        header;
+    ExecInstructions ins;   // what the table, jit and trace engines and the debugger run
+    PackedCode       code;  // what the threaded engine runs, always present
+    uint64_t         startinst;
+    uint64_t         hash;  // of the file, once hashed is set
+    str_t            path;
+    size_t           size;
+    LabelMap         strtab;
+    strvec_t         strtablist;
+    str_t            modpath;
+    DynamicLib       dynlib;
+    strvec_t         modules;
+    std::vector<int> dynabi;
+    std::vector<int> providers;
+    SymbolIndex      symbols;
+    AddressLookup    exports;
+    DataTable        data;
+    FusionStats      fusion;
+    CacheFile        cacheFile;  // the cache entry code is read from, if any
+    bool             lazyBind;
+    bool             hashed;
+    bool             verified;
+    bool             cached;
+    bool             shared;
+
+    ProgramImage(const str_t& modpath);
+    ~ProgramImage();
+};
+
+typedef std::shared_ptr<ProgramImage> ProgramImagePtr;
 
 class Program
 {
+    friend class Engine;
+
 public:
     typedef void (Program::*Operation)(const ExecInstruction& inst);
     typedef Operation InstructionTable[OP_MAX - OP_BEG];
 
 protected:
-    ExecInstructions m_ins;
-    TVMHeader        m_header;
+    ProgramImagePtr  m_image;
     Registers        m_regi;
     uint32_t         m_flags;
+    int64_t          m_compare[2];
     int32_t          m_return;
     uint64_t         m_curinst;
-    uint64_t         m_startinst;
-    LabelMap         m_strtab;
-    strvec_t         m_strtablist;
     ArrayStack       m_callStack;
-    str_t            m_modpath;
-    DynamicLib       m_dynlib;
-    SymbolMap        m_symbols;
-    MemoryStream     m_dataTable;
+    DataTable        m_dataTable;
     ArrayStack       m_stack;
     bool             m_exit;
+    bool             m_lazyFlags;  // from the image's header
+    bool             m_lazyBind;
+    bool             m_imageCache;
+    const Operation* m_operations;
+    Engine*          m_engine;
+    HostArena        m_host;
+    OutputBuffer     m_output;
 
     const static InstructionTable OPCodeTable;
+    const static InstructionTable VerifiedOPCodeTable;
+    const static InstructionTable LazyOPCodeTable;
+    const static InstructionTable LazyVerifiedOPCodeTable;
     const static size_t           OPCodeTableSize;
 
-    int findDynamic(ExecInstruction& ins);
+    int  findDynamic(ExecInstruction& ins);
+    void addModule(const str_t& name);
+    int  loadModule(size_t idx);
+    void bindModule(const SymbolTable* avail, uint8_t abi, size_t idx);
+    bool bindSymbol(size_t idx);
+    bool bindCall(size_t idx, const ExecInstruction* inst);
+
+    uint64_t stampModules(const strvec_t& modules) const;
 
     void handle_OP_RET(const ExecInstruction& inst);
     void handle_OP_MOV(const ExecInstruction& inst);
@@ -72,6 +151,16 @@ protected:
     void handle_OP_JGE(const ExecInstruction& inst);
     void handle_OP_JLT(const ExecInstruction& inst);
     void handle_OP_JGT(const ExecInstruction& inst);
+
+    // Variants for images compiled with lazy flags
+    void handle_OP_CMP_L(const ExecInstruction& inst);
+    void handle_OP_JEQ_L(const ExecInstruction& inst);
+    void handle_OP_JNE_L(const ExecInstruction& inst);
+    void handle_OP_JLE_L(const ExecInstruction& inst);
+    void handle_OP_JGE_L(const ExecInstruction& inst);
+    void handle_OP_JLT_L(const ExecInstruction& inst);
+    void handle_OP_JGT_L(const ExecInstruction& inst);
+
     void handle_OP_ADD(const ExecInstruction& inst);
     void handle_OP_SUB(const ExecInstruction& inst);
     void handle_OP_MUL(const ExecInstruction& inst);
@@ -88,6 +177,16 @@ protected:
     void handle_OP_PRG(const ExecInstruction& inst);
     void handle_OP_PRGI(const ExecInstruction& inst);
 
+    // Variants without the tests VerifyInstructions proves at load time
+    void handle_OP_DIV_V(const ExecInstruction& inst);
+    void handle_OP_ADRP_V(const ExecInstruction& inst);
+    void handle_OP_STP_V(const ExecInstruction& inst);
+    void handle_OP_LDP_V(const ExecInstruction& inst);
+    void handle_OP_STR_V(const ExecInstruction& inst);
+    void handle_OP_LDR_V(const ExecInstruction& inst);
+    void handle_OP_LDRS_V(const ExecInstruction& inst);
+    void handle_OP_STRS_V(const ExecInstruction& inst);
+
     void derefRegister(
         const uint64_t& x0,
         const uint32_t& flags,
@@ -99,22 +198,280 @@ protected:
         const uint64_t& val);
 
     void forceExit(int returnCode);
+    void rewind(uint64_t addr);
+    void getEntryPoints(std::vector<uint64_t>& dest) const;
+    void reportError(const char* fmt, ...);
 
     int  loadStringTable(BlockReader& reader);
     int  loadSymbolTable(BlockReader& reader);
     int  loadDataTable(BlockReader& reader);
-    int  loadCode(BlockReader& reader);
+    int  loadExports(BlockReader& reader);
+    int  loadCode(BlockReader& reader, ExecInstructions& lowered);
+    int  loadCached(CachedImage& cached);
+    void storeCached(const str_t& path, uint64_t hash, size_t size);
+    int  addInstruction(ExecInstruction& exec);
     bool testInstruction(const ExecInstruction& exec);
+    void releaseSource(void);
+    int  instantiate(void);
+
+    uint64_t getImageHash(void);
+
+    void callHost(Symbol call, uint8_t abi);
 
-    Register* clone(void);
-    void      release(Register*);
+    inline void step(const ExecInstruction& inst)
+    {
+        if (m_operations[inst.op] != nullptr)
+            (this->*m_operations[inst.op])(inst);
+    }
+
+    // The PF_* flags, derived from the compare operands with lazy flags.
+    inline uint32_t getFlags(void) const
+    {
+        if (!m_lazyFlags)
+            return m_flags;
+        if (m_compare[0] == m_compare[1])
+            return PF_Z;
+        return m_compare[0] < m_compare[1] ? PF_L : PF_G;
+    }
 
 public:
     Program(const str_t& modpath);
     ~Program();
 
     int load(const char* fname);
+
+    // Runs an image returned by share. The instructions, tables and
+    // modules are not copied, the data table is mapped copy on write
+    // from the image's where possible. The engine is prepared for this
+    // program alone, so each can use a different one.
+    int load(const ProgramImagePtr& image);
+
+    // Opens every module, binds every call that can be bound and
+    // returns the image, so that other programs can load it. The
+    // program keeps running it as before. With lazy binding, a call
+    // that could not be bound still reports the error when it is
+    // reached.
+    const ProgramImagePtr& share(void);
+
+    // With buffered set to false everything the program prints is
+    // written out immediately. Otherwise it is written when the buffer
+    // fills, when a host module asks for it and when launch returns.
+    inline void setBuffered(bool buffered)
+    {
+        m_output.setBuffered(buffered);
+    }
+
+    // Sends everything the program prints, run time errors and the
+    // reason a load or bind failed to stream instead of stdout. The
+    // stream is not closed by Program.
+    inline void setOutput(FILE* stream)
+    {
+        m_output.setStream(stream);
+    }
+
+    // Reads the program's input from stream instead of stdin.
+    void setInput(FILE* stream);
+
+    // Reads the program's input by calling read with input, which
+    // returns the next byte or -1 at the end.
+    void setInput(int (*read)(void* input), void* input);
+
+    // Defers opening modules and resolving host calls until
+    // each call is first executed. It has to be set before load.
+    inline void setLazyBinding(bool lazy)
+    {
+        m_lazyBind = lazy;
+    }
+
+    // Reuses the verified and packed code of an image that was loaded
+    // before, keyed by a hash of its contents. It is on unless this is
+    // called with false or $TVM_NO_CACHE is set, and has to be set
+    // before load. See GetImageCachePath for the location.
+    inline void setImageCache(bool cache)
+    {
+        m_imageCache = cache;
+    }
     int launch(void);
+
+    // Continues from the current instruction with the call stack as
+    // it is, after runTo or restoreState. Returns w0 like launch.
+    int resume(void);
+
+    // Interprets main until the instruction at addr is the next one
+    // to execute. Returns PS_ERROR when the program ends first.
+    int runTo(uint64_t addr);
+
+    // Writes the registers, flags, stacks, data table and opened
+    // modules to path. See Snapshot.h for the layout.
+    int saveState(const str_t& path);
+
+    // Replaces the machine state with one saveState wrote for the same
+    // image, so resume continues where it stopped. The data table is
+    // mapped from the file where possible. It is moved back to the
+    // address it had when the state was saved, so registers and stack
+    // slots need no relocation, and restoring fails when that address
+    // is in use. reset still returns to the state after load.
+    int restoreState(const str_t& path);
+
+    // Returns the machine to the state load left it in, so the same
+    // image can be launched again without reading it. The data table
+    // is restored from the snapshot taken at the end of load, host
+    // calls stay bound and compiled code is kept.
+    void reset(void);
+
+    // Returns the address of a label the file exported with .global,
+    // or -1 when there is no such export.
+    uint64_t findExport(const str_t& name) const;
+
+    // Runs the code at addr until it returns, with the registers as
+    // they are, so the caller can set arguments before the call and
+    // read results after it. The data table is not restored, see
+    // reset. Returns w0 like launch.
+    int call(uint64_t addr);
+
+    // Selects one of the engines listed by GetEngineInfo.
+    int setEngine(const str_t& name);
+
+    // Takes ownership of engine. It has to be set before load.
+    void setEngine(Engine* engine);
+
+    const char* getEngineName(void) const;
+
+    MemoryFootprint getFootprint(void) const;
+
+    // The register file as it was left by the last launch
+    inline const Register* getRegisters(void) const
+    {
+        return m_regi;
+    }
+
+    // Sets x(reg), the arguments of a call.
+    inline void setRegister(uint8_t reg, uint64_t v)
+    {
+        if (reg < MAX_REG)
+            m_regi[reg].x = v;
+    }
+
+    // Where the data table was loaded, adrp addresses are inside it
+    inline const uint8_t* getDataTable(void) const
+    {
+        return m_dataTable.ptr();
+    }
+
+    inline size_t getDataTableSize(void) const
+    {
+        return m_dataTable.capacity();
+    }
+
+    // True when every instruction passed VerifyInstructions
+    inline bool isVerified(void) const
+    {
+        return m_image->verified;
+    }
+
+    // The number of instructions the threaded engine runs with a
+    // handler that skips the tests VerifyInstruction proved.
+    size_t getVerifiedCount(void) const;
+
+    // True when load used the image cache
+    inline bool isCached(void) const
+    {
+        return m_image->cached;
+    }
+
+    inline const FusionStats& getFusionStats(void) const
+    {
+        return m_image->fusion;
+    }
+
+    // Returns null unless the program was launched with the jit engine.
+    inline const JitCompiler* getJit(void) const
+    {
+        return m_engine->getJit();
+    }
+
+    // Returns null unless the program was launched with the trace engine.
+    inline const Tracer* getTracer(void) const
+    {
+        return m_engine->getTracer();
+    }
 };
 
+// Defined here rather than in Engine.cpp so that
+// the engines' loops inline them.
+inline const ProgramImage& Engine::getImage(const Program& prog)
+{
+    return *prog.m_image;
+}
+
+inline const ExecInstructions& Engine::getInstructions(const Program& prog)
+{
+    return prog.m_image->ins;
+}
+
+inline DataTable& Engine::getDataTable(Program& prog)
+{
+    return prog.m_dataTable;
+}
+
+inline Registers& Engine::getRegisters(Program& prog)
+{
+    return prog.m_regi;
+}
+
+inline ArrayStack& Engine::getCallStack(Program& prog)
+{
+    return prog.m_callStack;
+}
+
+inline ArrayStack& Engine::getStack(Program& prog)
+{
+    return prog.m_stack;
+}
+
+inline OutputBuffer& Engine::getOutput(Program& prog)
+{
+    return prog.m_output;
+}
+
+inline uint32_t& Engine::getFlags(Program& prog)
+{
+    return prog.m_flags;
+}
+
+inline int64_t* Engine::getCompare(Program& prog)
+{
+    return prog.m_compare;
+}
+
+inline bool Engine::hasLazyFlags(const Program& prog)
+{
+    return prog.m_lazyFlags;
+}
+
+inline int32_t& Engine::getReturn(Program& prog)
+{
+    return prog.m_return;
+}
+
+inline uint64_t& Engine::getCurrent(Program& prog)
+{
+    return prog.m_curinst;
+}
+
+inline bool Engine::hasExited(const Program& prog)
+{
+    return prog.m_exit;
+}
+
+inline void Engine::stop(Program& prog)
+{
+    prog.m_exit = true;
+}
+
+inline void Engine::step(Program& prog, const ExecInstruction& inst)
+{
+    prog.step(inst);
+}
+
 #endif  //_Program_h_
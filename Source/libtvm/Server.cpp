@@ -0,0 +1,725 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Server.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "MemoryStream.h"
+#include "Program.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+const uint32_t RequestMagic  = 0x514D5654;  // TVMQ
+const uint32_t ResponseMagic = 0x524D5654;  // TVMR
+const uint32_t InputMagic    = 0x494D5654;  // TVMI, the server wants input
+const uint32_t DataMagic     = 0x444D5654;  // TVMD, input, empty at the end
+
+const size_t InputChunk = 4096;
+
+// Reads the fields of a message in the order they were written.
+class MessageReader
+{
+private:
+    const str_t& m_data;
+    size_t       m_loc;
+    bool         m_ok;
+
+public:
+    MessageReader(const str_t& data) :
+        m_data(data),
+        m_loc(0),
+        m_ok(true)
+    {
+    }
+
+    void read(void* dest, size_t nr)
+    {
+        if (m_loc + nr > m_data.size())
+        {
+            m_ok = false;
+            memset(dest, 0, nr);
+            return;
+        }
+        memcpy(dest, m_data.data() + m_loc, nr);
+        m_loc += nr;
+    }
+
+    uint32_t read32(void)
+    {
+        uint32_t v;
+        read(&v, 4);
+        return v;
+    }
+
+    uint64_t read64(void)
+    {
+        uint64_t v;
+        read(&v, 8);
+        return v;
+    }
+
+    str_t readString(void)
+    {
+        uint64_t len = read64();
+        if (!m_ok || m_loc + len + 1 > m_data.size())
+        {
+            m_ok = false;
+            return str_t();
+        }
+
+        str_t str = m_data.substr(m_loc, (size_t)len);
+        m_loc += (size_t)len + 1;
+        return str;
+    }
+
+    inline bool ok(void) const
+    {
+        return m_ok && m_loc == m_data.size();
+    }
+};
+
+// Strings may hold any byte, they are written with their
+// length and followed by a zero like MemoryStream::writeString.
+static void WriteString(MemoryStream& dest, const str_t& str)
+{
+    dest.write64((uint64_t)str.size());
+    dest.writeString(str.data(), str.size());
+}
+
+#ifndef _WIN32
+
+static bool WriteAll(int fd, const void* src, size_t len)
+{
+    const char* ptr = (const char*)src;
+    while (len > 0)
+    {
+        ssize_t bw = write(fd, ptr, len);
+        if (bw <= 0)
+            return false;
+        ptr += bw;
+        len -= (size_t)bw;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void* dest, size_t len)
+{
+    char* ptr = (char*)dest;
+    while (len > 0)
+    {
+        ssize_t br = read(fd, ptr, len);
+        if (br <= 0)
+            return false;
+        ptr += br;
+        len -= (size_t)br;
+    }
+    return true;
+}
+
+// A message is its magic number, the version, the size of the
+// body and the body.
+static bool SendMessage(int fd, uint32_t magic, const void* body, size_t size)
+{
+    uint32_t head[2] = {magic, TVM_SERVER_VERSION};
+    uint64_t len     = (uint64_t)size;
+
+    return WriteAll(fd, head, sizeof(head)) &&
+           WriteAll(fd, &len, 8) &&
+           WriteAll(fd, body, size);
+}
+
+static bool ReceiveMessage(int fd, uint32_t& magic, str_t& body)
+{
+    uint32_t head[2] = {};
+    uint64_t size    = 0;
+    if (!ReadAll(fd, head, sizeof(head)) || !ReadAll(fd, &size, 8))
+        return false;
+    if (head[1] != TVM_SERVER_VERSION || size > TVM_SERVER_MAX_MESSAGE)
+        return false;
+
+    magic = head[0];
+    body.resize((size_t)size);
+    return size == 0 || ReadAll(fd, &body[0], (size_t)size);
+}
+
+// The program's input on the server, the request's input followed
+// by what the client sends when it is asked.
+struct InputChannel
+{
+    int          fd;
+    bool         stream;
+    const str_t* input;
+    str_t        buffer;
+    size_t       pos;
+    bool         initial;
+
+    static int read(void* ptr)
+    {
+        InputChannel* in = (InputChannel*)ptr;
+        while (in->pos >= in->buffer.size())
+        {
+            if (in->initial)
+            {
+                in->initial = false;
+                in->buffer  = *in->input;
+                in->pos     = 0;
+                continue;
+            }
+
+            uint32_t magic = 0;
+            uint64_t want  = InputChunk;
+            if (!in->stream ||
+                !SendMessage(in->fd, InputMagic, &want, 8) ||
+                !ReceiveMessage(in->fd, magic, in->buffer) ||
+                magic != DataMagic ||
+                in->buffer.empty())
+            {
+                in->stream = false;
+                return -1;
+            }
+            in->pos = 0;
+        }
+        return (uint8_t)in->buffer[in->pos++];
+    }
+};
+
+static bool MakeAddress(const str_t& path, sockaddr_un& addr)
+{
+    memset(&addr, 0, sizeof(sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        return false;
+
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+#endif
+
+Server::Server(const str_t& modpath, size_t workers, size_t cacheSize) :
+    m_modpath(modpath),
+    m_socket(-1),
+    m_workers(workers),
+    m_cacheSize(cacheSize),
+    m_imageCache(true),
+    m_stop(false)
+{
+    if (m_workers == 0)
+        m_workers = std::thread::hardware_concurrency();
+    if (m_workers == 0)
+        m_workers = 1;
+}
+
+Server::~Server()
+{
+    stop();
+
+#ifndef _WIN32
+    if (m_socket != -1)
+    {
+        close(m_socket);
+        unlink(m_path.c_str());
+    }
+#endif
+
+    for (Image& image : m_images)
+        delete image.prog;
+}
+
+Program* Server::acquire(const ServerRequest& req, const str_t& key, ServerResponse& resp)
+{
+    // Without lazy binding every program in the list has shared its
+    // image, so one that is busy can still hand it to another program.
+    // Sharing binds every call, so lazy programs keep their own image.
+    ProgramImagePtr image;
+    {
+        std::lock_guard<std::mutex> lock(m_imageLock);
+
+        Images::iterator it;
+        for (it = m_images.begin(); it != m_images.end(); ++it)
+        {
+            if (it->key != key)
+                continue;
+
+            if (!it->busy)
+            {
+                it->busy = true;
+                m_images.splice(m_images.begin(), m_images, it);
+
+                resp.cached = true;
+                return it->prog;
+            }
+            if (!image && !req.lazy)
+                image = it->prog->share();
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Program* prog = new Program(m_modpath);
+    prog->setLazyBinding(req.lazy);
+    prog->setImageCache(m_imageCache);
+
+    // The reason a load fails is sent back instead of being printed
+    // on the server's stdout.
+    char*  err    = nullptr;
+    size_t errLen = 0;
+    FILE*  errors = open_memstream(&err, &errLen);
+    prog->setOutput(errors);
+
+    int st = PS_OK;
+    if (!req.engine.empty())
+        st = prog->setEngine(req.engine);
+    if (st == PS_OK)
+        st = image ? prog->load(image) : prog->load(req.path.c_str());
+
+    prog->setOutput(nullptr);
+    if (errors)
+        fclose(errors);
+    if (st != PS_OK && err)
+        resp.output.assign(err, errLen);
+    free(err);
+
+    if (st != PS_OK)
+    {
+        delete prog;
+        return nullptr;
+    }
+
+    resp.cached = image != nullptr;
+    if (!req.lazy)
+        prog->share();
+
+    resp.loadTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+    std::lock_guard<std::mutex> lock(m_imageLock);
+
+    // Copies of an older version of the file are no longer wanted,
+    // and the least recently used programs go once the list is full.
+    Images::iterator it = m_images.begin();
+    while (it != m_images.end())
+    {
+        if (!it->busy && it->path == req.path && it->key != key)
+        {
+            delete it->prog;
+            it = m_images.erase(it);
+        }
+        else
+            ++it;
+    }
+
+    m_images.push_front(Image{req.path, key, prog, true});
+
+    Images::iterator last = m_images.end();
+    while (m_images.size() > m_cacheSize && last != m_images.begin())
+    {
+        --last;
+        if (!last->busy)
+        {
+            delete last->prog;
+            last = m_images.erase(last);
+        }
+    }
+    return prog;
+}
+
+void Server::release(Program* prog)
+{
+    std::lock_guard<std::mutex> lock(m_imageLock);
+    for (Image& image : m_images)
+    {
+        if (image.prog == prog)
+            image.busy = false;
+    }
+}
+
+#ifndef _WIN32
+
+str_t GetServerPath(void)
+{
+    const char* env = getenv("TVM_SOCKET");
+    if (env != nullptr && *env != 0)
+        return env;
+
+    env = getenv("XDG_RUNTIME_DIR");
+    if (env != nullptr && *env != 0)
+        return str_t(env) + "/toyvm.sock";
+
+    char name[64];
+    snprintf(name, 64, "/tmp/toyvm-%u.sock", (unsigned)getuid());
+    return name;
+}
+
+int ConnectServer(const str_t& path)
+{
+    sockaddr_un addr;
+    if (!MakeAddress(path, addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    if (connect(fd, (sockaddr*)&addr, sizeof(sockaddr_un)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int SendRequest(int fd, const ServerRequest& req, ServerResponse& resp)
+{
+    MemoryStream body;
+    WriteString(body, req.path);
+    WriteString(body, req.engine);
+    body.write32(req.lazy ? 1 : 0);
+    body.write32(req.stream ? 1 : 0);
+    body.write32(req.regmask);
+
+    int i;
+    for (i = 0; i < MAX_REG; ++i)
+        body.write64(req.regi[i].x);
+    WriteString(body, req.input);
+
+    str_t    reply;
+    uint32_t magic = 0;
+    bool     ok    = SendMessage(fd, RequestMagic, body.ptr(), body.size());
+
+    // Input is read as the program asks for it.
+    while (ok && (ok = ReceiveMessage(fd, magic, reply)) && magic == InputMagic)
+    {
+        uint64_t want = 0;
+        if (reply.size() == 8)
+            memcpy(&want, reply.data(), 8);
+
+        char    buf[InputChunk];
+        ssize_t br = read(STDIN_FILENO, buf, (size_t)(want < InputChunk ? want : InputChunk));
+        ok         = SendMessage(fd, DataMagic, buf, br > 0 ? (size_t)br : 0);
+    }
+    close(fd);
+    ok = ok && magic == ResponseMagic;
+
+    if (ok)
+    {
+        MessageReader reader(reply);
+        resp.status   = (int32_t)reader.read32();
+        resp.exitCode = (int32_t)reader.read32();
+        resp.cached   = reader.read32() != 0;
+        resp.loadTime = reader.read64();
+        resp.runTime  = reader.read64();
+        resp.engine   = reader.readString();
+        resp.output   = reader.readString();
+        ok            = reader.ok();
+    }
+
+    if (!ok)
+    {
+        printf("the server did not answer the request\n");
+        return PS_ERROR;
+    }
+    return PS_OK;
+}
+
+int Server::open(const str_t& path)
+{
+    sockaddr_un addr;
+    if (!MakeAddress(path, addr))
+    {
+        printf("the socket path '%s' is not valid\n", path.c_str());
+        return PS_ERROR;
+    }
+
+    // A socket nothing answers on was left by a server that is gone.
+    int other = ConnectServer(path);
+    if (other != -1)
+    {
+        close(other);
+        printf("a server is already listening on '%s'\n", path.c_str());
+        return PS_ERROR;
+    }
+    unlink(path.c_str());
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket == -1 ||
+        bind(m_socket, (sockaddr*)&addr, sizeof(sockaddr_un)) != 0 ||
+        listen(m_socket, 64) != 0)
+    {
+        printf("failed to listen on '%s'\n", path.c_str());
+        if (m_socket != -1)
+            close(m_socket);
+        m_socket = -1;
+        return PS_ERROR;
+    }
+
+    // Requests name any file the server can read.
+    chmod(path.c_str(), 0600);
+    m_path = path;
+    return PS_OK;
+}
+
+void Server::serve(void)
+{
+    if (m_socket == -1)
+        return;
+
+    // A client that goes away must not stop the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t i;
+    for (i = 0; i < m_workers; ++i)
+        m_threads.push_back(std::thread(&Server::work, this));
+
+    for (;;)
+    {
+        int fd = accept(m_socket, nullptr, nullptr);
+        if (fd == -1)
+        {
+            std::lock_guard<std::mutex> lock(m_pendingLock);
+            if (m_stop)
+                break;
+            continue;
+        }
+
+        // An idle client must not hold a worker forever.
+        timeval timeout = {TVM_SERVER_TIMEOUT, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeval));
+
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        m_pending.push_back(fd);
+        m_pendingReady.notify_one();
+    }
+
+    m_pendingReady.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+    m_threads.clear();
+}
+
+void Server::stop(void)
+{
+    std::lock_guard<std::mutex> lock(m_pendingLock);
+    m_stop = true;
+    m_pendingReady.notify_all();
+
+    // Wakes accept in serve.
+    if (m_socket != -1)
+        shutdown(m_socket, SHUT_RDWR);
+}
+
+void Server::work(void)
+{
+    for (;;)
+    {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(m_pendingLock);
+            while (m_pending.empty() && !m_stop)
+                m_pendingReady.wait(lock);
+
+            if (m_pending.empty())
+                return;
+
+            fd = m_pending.front();
+            m_pending.pop_front();
+        }
+        handle(fd);
+    }
+}
+
+void Server::handle(int fd)
+{
+    str_t    request;
+    uint32_t magic = 0;
+    if (!ReceiveMessage(fd, magic, request) || magic != RequestMagic)
+    {
+        close(fd);
+        return;
+    }
+
+    ServerRequest  req  = {};
+    ServerResponse resp = {};
+
+    MessageReader reader(request);
+    req.path    = reader.readString();
+    req.engine  = reader.readString();
+    req.lazy    = reader.read32() != 0;
+    req.stream  = reader.read32() != 0;
+    req.regmask = reader.read32();
+
+    int i;
+    for (i = 0; i < MAX_REG; ++i)
+        req.regi[i].x = reader.read64();
+    req.input = reader.readString();
+
+    if (reader.ok())
+        execute(req, resp, fd);
+    else
+    {
+        resp.status = PS_ERROR;
+        resp.output = "invalid request\n";
+    }
+
+    MemoryStream body;
+    body.write32((uint32_t)resp.status);
+    body.write32((uint32_t)resp.exitCode);
+    body.write32(resp.cached ? 1 : 0);
+    body.write64(resp.loadTime);
+    body.write64(resp.runTime);
+    WriteString(body, resp.engine);
+    WriteString(body, resp.output);
+
+    SendMessage(fd, ResponseMagic, body.ptr(), body.size());
+    close(fd);
+}
+
+void Server::execute(const ServerRequest& req, ServerResponse& resp, int fd)
+{
+    resp.status = PS_ERROR;
+
+    struct stat st;
+    if (stat(req.path.c_str(), &st) != 0)
+    {
+        resp.output = "failed to load '" + req.path + "'\n";
+        return;
+    }
+
+    char stamp[64];
+    snprintf(stamp,
+             64,
+             "|%lld|%lld|%d|",
+             (long long)st.st_mtime,
+             (long long)st.st_size,
+             req.lazy ? 1 : 0);
+    str_t key = req.path + stamp + req.engine;
+
+    Program* prog = acquire(req, key, resp);
+    if (!prog)
+    {
+        if (resp.output.empty())
+            resp.output = "failed to load '" + req.path + "'\n";
+        return;
+    }
+
+    InputChannel input = {fd, req.stream && fd != -1, &req.input, str_t(), 0, true};
+
+    char*  out    = nullptr;
+    size_t outLen = 0;
+    FILE*  output = open_memstream(&out, &outLen);
+    if (output)
+    {
+        prog->setOutput(output);
+        prog->setInput(InputChannel::read, &input);
+
+        for (uint8_t r = 0; r < MAX_REG; ++r)
+        {
+            if (req.regmask & (1u << r))
+                prog->setRegister(r, req.regi[r].x);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        resp.exitCode = prog->launch();
+        resp.runTime  = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+        resp.status = PS_OK;
+        resp.engine = prog->getEngineName();
+
+        // The next request starts from the loaded state.
+        prog->reset();
+        prog->setOutput(nullptr);
+        prog->setInput(nullptr);
+    }
+    else
+        resp.output = "failed to create the program's output\n";
+
+    if (output)
+    {
+        fclose(output);
+
+        // Only a response sent to a client has to fit in a message.
+        if (fd != -1 && outLen > TVM_SERVER_MAX_OUTPUT)
+            outLen = (size_t)TVM_SERVER_MAX_OUTPUT;
+        resp.output.append(out, outLen);
+    }
+    free(out);
+
+    release(prog);
+}
+
+#else
+
+str_t GetServerPath(void)
+{
+    return str_t();
+}
+
+int ConnectServer(const str_t&)
+{
+    return -1;
+}
+
+int SendRequest(int, const ServerRequest&, ServerResponse&)
+{
+    return PS_ERROR;
+}
+
+int Server::open(const str_t&)
+{
+    printf("the server is not available on this platform\n");
+    return PS_ERROR;
+}
+
+void Server::serve(void)
+{
+}
+
+void Server::stop(void)
+{
+}
+
+void Server::work(void)
+{
+}
+
+void Server::handle(int)
+{
+}
+
+void Server::execute(const ServerRequest&, ServerResponse& resp, int)
+{
+    resp.status = PS_ERROR;
+    resp.output = "the server is not available on this platform\n";
+}
+
+#endif
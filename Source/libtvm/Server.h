@@ -0,0 +1,151 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Server_h_
+#define _Server_h_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Declarations.h"
+
+class Program;
+
+const uint32_t TVM_SERVER_VERSION = 1;
+
+// Messages larger than this are refused, and a connection is closed
+// when the peer sends nothing for TVM_SERVER_TIMEOUT seconds, that
+// includes a client asked for the program's input. Output past
+// TVM_SERVER_MAX_OUTPUT is dropped so the response still fits.
+const uint64_t TVM_SERVER_MAX_MESSAGE = 64 * 1024 * 1024;
+const uint64_t TVM_SERVER_MAX_OUTPUT  = TVM_SERVER_MAX_MESSAGE - 64 * 1024;
+const int      TVM_SERVER_TIMEOUT     = 60;
+
+// One run of an image. regmask has bit n set for each x(n) in regi
+// that is set before main is launched. The program reads input
+// first. With stream set the server then asks the client for more
+// each time the program reads past it, and SendRequest answers from
+// stdin, so nothing is read that the program does not ask for.
+struct ServerRequest
+{
+    str_t     path;
+    str_t     engine;  // empty for the default engine
+    bool      lazy;    // see Program::setLazyBinding
+    bool      stream;
+    uint32_t  regmask;
+    Registers regi;
+    str_t     input;
+};
+
+// status is PS_ERROR when the image could not be loaded, output then
+// holds the reason. The times are in nanoseconds, load is zero when
+// the image was already loaded.
+struct ServerResponse
+{
+    int32_t  status;
+    int32_t  exitCode;
+    bool     cached;
+    uint64_t loadTime;
+    uint64_t runTime;
+    str_t    engine;
+    str_t    output;
+};
+
+// Runs images for clients connecting to a UNIX socket. Requests are
+// handed to a pool of worker threads. Loaded programs are kept in a
+// least recently used list keyed by the image's path, modification
+// time and size, the engine and the binding mode, and are reset after
+// each run. A program runs one request at a time, concurrent requests
+// for the same image get another program that shares its image, see
+// Program::share. Requests with lazy binding load another copy
+// instead, since sharing would bind every call up front.
+class Server
+{
+private:
+    struct Image
+    {
+        str_t    path;
+        str_t    key;
+        Program* prog;
+        bool     busy;
+    };
+
+    typedef std::list<Image> Images;
+
+    str_t                    m_modpath;
+    str_t                    m_path;
+    int                      m_socket;
+    size_t                   m_workers;
+    size_t                   m_cacheSize;
+    bool                     m_imageCache;
+    bool                     m_stop;
+    Images                   m_images;
+    std::mutex               m_imageLock;
+    std::deque<int>          m_pending;
+    std::mutex               m_pendingLock;
+    std::condition_variable  m_pendingReady;
+    std::vector<std::thread> m_threads;
+
+    Program* acquire(const ServerRequest& req, const str_t& key, ServerResponse& resp);
+    void     release(Program* prog);
+    void     work(void);
+    void     handle(int fd);
+
+public:
+    // workers of zero uses one thread per core. cacheSize is the
+    // number of programs kept loaded while they are not running.
+    Server(const str_t& modpath, size_t workers, size_t cacheSize);
+    ~Server();
+
+    // Loads images through the image cache, see Program::setImageCache.
+    inline void setImageCache(bool cache)
+    {
+        m_imageCache = cache;
+    }
+
+    // Listens on path, replacing a socket that was left behind.
+    int open(const str_t& path);
+
+    // Serves requests until stop is called.
+    void serve(void);
+
+    void stop(void);
+
+    // Runs a request in the calling thread, the way a worker does.
+    // With req.stream set more input is asked for on fd.
+    void execute(const ServerRequest& req, ServerResponse& resp, int fd = -1);
+};
+
+// $TVM_SOCKET, $XDG_RUNTIME_DIR/toyvm.sock or /tmp/toyvm-<uid>.sock
+extern str_t GetServerPath(void);
+
+// Returns a connected socket, or -1 when no server is listening.
+extern int ConnectServer(const str_t& path);
+
+// Sends req over fd, waits for the response and closes fd.
+// Input the server asks for is read from stdin.
+extern int SendRequest(int fd, const ServerRequest& req, ServerResponse& resp);
+
+#endif  //_Server_h_
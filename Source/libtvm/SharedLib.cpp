@@ -98,3 +98,22 @@ SYM_API SYM_LOCAL void prog_set_register64(tvmregister_t regi, uint8_t reg, uint
         ctx[reg].x    = v;
     }
 }
+
+SYM_API SYM_LOCAL void prog_write(tvmcontext_t *ctx, const char *buf, uint64_t len)
+{
+    if (ctx && ctx->write)
+        ctx->write(ctx->output, buf, len);
+}
+
+SYM_API SYM_LOCAL void prog_flush(tvmcontext_t *ctx)
+{
+    if (ctx && ctx->flush)
+        ctx->flush(ctx->output);
+}
+
+SYM_API SYM_LOCAL int prog_read(tvmcontext_t *ctx)
+{
+    if (ctx && ctx->read)
+        return ctx->read(ctx->input);
+    return -1;
+}
@@ -36,6 +36,32 @@
 
 typedef struct _register* tvmregister_t;
 
+// Version 2 of the host interface. Each program owns one context,
+// so calling a host function does not allocate. A module opts in by
+// exporting '<module>_abi' returning TVM_ABI_CONTEXT, in which case
+// every function in its symbol table is a tvmcall_t. Modules without
+// it are called with a tvmregister_t as before.
+#define TVM_ABI_REGISTERS 1
+#define TVM_ABI_CONTEXT 2
+
+typedef struct tvmcontext
+{
+    tvmregister_t regi;      // register window, valid during the call
+    uint8_t*      data;      // start of the program's data table
+    uint64_t      dataSize;  // size of the data table in bytes
+    int32_t       status;    // non zero stops the program with this return code
+    void*         output;    // the program's output buffer
+
+    void (*write)(void* output, const char* buf, uint64_t len);
+    void (*flush)(void* output);
+
+    void* input;  // the program's input, stdin unless the host changed it
+    int (*read)(void* input);
+} tvmcontext_t;
+
+typedef void (*tvmcall_t)(tvmcontext_t* ctx);
+typedef int (*tvmabi_t)(void);
+
 SYM_API SYM_LOCAL uint8_t  prog_get_register8(tvmregister_t regi, uint8_t reg);
 SYM_API SYM_LOCAL uint16_t prog_get_register16(tvmregister_t regi, uint8_t reg);
 SYM_API SYM_LOCAL uint32_t prog_get_register32(tvmregister_t regi, uint8_t reg);
@@ -45,4 +71,13 @@ SYM_API SYM_LOCAL void     prog_set_register16(tvmregister_t regi, uint8_t reg,
 SYM_API SYM_LOCAL void     prog_set_register32(tvmregister_t regi, uint8_t reg, uint32_t v);
 SYM_API SYM_LOCAL void     prog_set_register64(tvmregister_t regi, uint8_t reg, uint64_t v);
 
+// Output written with prog_write shares the program's buffer with prg
+// and prgi. A module that reads input or writes through stdio itself
+// should call prog_flush first.
+SYM_API SYM_LOCAL void prog_write(tvmcontext_t* ctx, const char* buf, uint64_t len);
+SYM_API SYM_LOCAL void prog_flush(tvmcontext_t* ctx);
+
+// Reads the next byte of the program's input, or returns -1 at the end.
+SYM_API SYM_LOCAL int prog_read(tvmcontext_t* ctx);
+
 #endif  //_SharedLib_h_
@@ -0,0 +1,200 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Snapshot.h"
+#include <stdio.h>
+#include <string.h>
+#include "BlockReader.h"
+#include "MemoryStream.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define tvm_getpid() _getpid()
+#else
+#include <unistd.h>
+#define tvm_getpid() getpid()
+#endif
+
+const uint32_t SnapshotMagic = 0x534D5654;  // TVMS
+
+static uint64_t AlignSnapshot(uint64_t size)
+{
+    return (size + TVM_SNAPSHOT_ALIGN - 1) & ~(TVM_SNAPSHOT_ALIGN - 1);
+}
+
+static void WriteValues(MemoryStream& dest, const std::vector<uint64_t>& src)
+{
+    dest.write32((uint32_t)src.size());
+    for (uint64_t v : src)
+        dest.write64(v);
+}
+
+static bool ReadValues(BlockReader& reader, std::vector<uint64_t>& dest)
+{
+    uint32_t n = 0;
+    reader.read(&n, 4);
+    if (n > MAX_STK || reader.tell() + (size_t)n * 8 > reader.size())
+        return false;
+
+    dest.resize(n);
+    if (n > 0)
+        reader.read(dest.data(), (size_t)n * 8);
+    return true;
+}
+
+int WriteSnapshot(const str_t& path, const VMSnapshot& src, const uint8_t* data)
+{
+    MemoryStream dest;
+    dest.write32(SnapshotMagic);
+    dest.write32(TVM_SNAPSHOT_VERSION);
+    dest.write64(src.imageHash);
+    dest.write64(src.curinst);
+    dest.write32(src.flags);
+    dest.write32((uint32_t)src.ret);
+    dest.write64((uint64_t)src.compare[0]);
+    dest.write64((uint64_t)src.compare[1]);
+
+    int i;
+    for (i = 0; i < MAX_REG; ++i)
+        dest.write64(src.regi[i].x);
+
+    WriteValues(dest, src.callStack);
+    WriteValues(dest, src.stack);
+
+    dest.write32((uint32_t)src.modules.size());
+    for (size_t m = 0; m < src.modules.size(); ++m)
+    {
+        dest.write32((uint32_t)src.modules[m].size());
+        dest.writeString(src.modules[m].c_str(), src.modules[m].size());
+        dest.write8(m < src.opened.size() && src.opened[m] ? 1 : 0);
+    }
+
+    // The offset is written before the padding that reaches it.
+    dest.write64(src.dataBase);
+    dest.write64(src.dataSize);
+    uint64_t offset = AlignSnapshot(dest.size() + 8);
+    dest.write64(offset);
+    dest.fill((size_t)(offset - dest.size()), 0);
+
+    // A file that is mapped by another process has to be replaced
+    // rather than rewritten, or its clean pages would change under it.
+    char pid[32];
+    snprintf(pid, 32, ".%d", (int)tvm_getpid());
+    str_t temp = path + pid;
+
+    FILE* fp = fopen(temp.c_str(), "wb");
+    if (!fp)
+    {
+        printf("failed to open '%s' for writing\n", temp.c_str());
+        return PS_ERROR;
+    }
+
+    // The padding covers the data table's last page on any page size.
+    size_t padding = (size_t)(AlignSnapshot(src.dataSize + 1) - src.dataSize);
+
+    bool ok = fwrite(dest.ptr(), 1, dest.size(), fp) == dest.size();
+    if (ok && src.dataSize > 0)
+        ok = fwrite(data, 1, (size_t)src.dataSize, fp) == (size_t)src.dataSize;
+    if (ok)
+    {
+        dest.clear();
+        dest.fill(padding, 0);
+        ok = fwrite(dest.ptr(), 1, dest.size(), fp) == dest.size();
+    }
+    fclose(fp);
+
+#ifdef _WIN32
+    if (ok)
+        remove(path.c_str());
+#endif
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        remove(temp.c_str());
+        printf("failed to write the snapshot '%s'\n", path.c_str());
+        return PS_ERROR;
+    }
+    return PS_OK;
+}
+
+int ReadSnapshot(const str_t& path, VMSnapshot& dest)
+{
+    BlockReader reader(path.c_str());
+    if (reader.eof())
+        return PS_ERROR;
+
+    uint32_t magic = 0, version = 0, ret = 0;
+    uint64_t compare[2] = {};
+
+    reader.read(&magic, 4);
+    reader.read(&version, 4);
+    if (magic != SnapshotMagic || version != TVM_SNAPSHOT_VERSION)
+    {
+        printf("'%s' is not a snapshot written by this version\n", path.c_str());
+        return PS_ERROR;
+    }
+
+    reader.read(&dest.imageHash, 8);
+    reader.read(&dest.curinst, 8);
+    reader.read(&dest.flags, 4);
+    reader.read(&ret, 4);
+    reader.read(compare, sizeof(compare));
+
+    dest.ret        = (int32_t)ret;
+    dest.compare[0] = (int64_t)compare[0];
+    dest.compare[1] = (int64_t)compare[1];
+
+    int i;
+    for (i = 0; i < MAX_REG; ++i)
+        reader.read(&dest.regi[i].x, 8);
+
+    bool ok = ReadValues(reader, dest.callStack) && ReadValues(reader, dest.stack);
+
+    uint32_t n = 0, len;
+    reader.read(&n, 4);
+    for (uint32_t m = 0; ok && m < n; ++m)
+    {
+        len = 0;
+        reader.read(&len, 4);
+        if (reader.tell() + len + 2 > reader.size())
+        {
+            ok = false;
+            break;
+        }
+
+        dest.modules.push_back(str_t((const char*)reader.ptr() + reader.tell(), len));
+        reader.offset((int64_t)len + 1);
+        dest.opened.push_back(reader.next() != 0 ? 1 : 0);
+    }
+
+    reader.read(&dest.dataBase, 8);
+    reader.read(&dest.dataSize, 8);
+    reader.read(&dest.dataOffset, 8);
+
+    if (!ok ||
+        reader.eof() ||
+        dest.dataOffset % TVM_SNAPSHOT_ALIGN != 0 ||
+        dest.dataOffset + AlignSnapshot(dest.dataSize + 1) != (uint64_t)reader.size())
+    {
+        printf("the snapshot '%s' is damaged\n", path.c_str());
+        return PS_ERROR;
+    }
+    return PS_OK;
+}
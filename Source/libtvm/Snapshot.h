@@ -0,0 +1,62 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Snapshot_h_
+#define _Snapshot_h_
+
+#include <stdint.h>
+#include <vector>
+#include "Declarations.h"
+
+const uint32_t TVM_SNAPSHOT_VERSION = 1;
+
+// The data table starts on a multiple of this in the file, so it can
+// be mapped on any page size up to 64K.
+const uint64_t TVM_SNAPSHOT_ALIGN = 0x10000;
+
+// The machine state Program::saveState writes. Stacks are stored
+// bottom first. opened holds 1 for each module that was opened.
+struct VMSnapshot
+{
+    uint64_t              imageHash;
+    uint64_t              curinst;
+    uint32_t              flags;
+    int32_t               ret;
+    int64_t               compare[2];
+    Registers             regi;
+    std::vector<uint64_t> callStack;
+    std::vector<uint64_t> stack;
+    strvec_t              modules;
+    std::vector<int>      opened;
+    uint64_t              dataBase;    // where the data table was
+    uint64_t              dataSize;    // its capacity
+    uint64_t              dataOffset;  // where it is in the file
+};
+
+// Writes src followed by src.dataSize bytes of data, padded to
+// TVM_SNAPSHOT_ALIGN on both sides. src.dataOffset is not used.
+extern int WriteSnapshot(const str_t& path, const VMSnapshot& src, const uint8_t* data);
+
+// Reads everything but the data table, which is left at
+// dest.dataOffset for DataTable::load.
+extern int ReadSnapshot(const str_t& path, VMSnapshot& dest);
+
+#endif  //_Snapshot_h_
@@ -151,6 +151,19 @@ bool IsModulePresent(const str_t& modname, const str_t& moddir)
     return stat(absPath.c_str(), &_st) == 0;
 }
 
+uint64_t GetModuleStamp(const str_t& modname, const str_t& moddir)
+{
+    // Changes whenever the module is rebuilt or replaced,
+    // zero when the module cannot be found.
+    str_t absPath;
+    MakeModulePath(absPath, modname, moddir);
+
+    struct stat _st;
+    if (stat(absPath.c_str(), &_st) != 0)
+        return 0;
+    return ((uint64_t)_st.st_mtime << 32) ^ (uint64_t)_st.st_size;
+}
+
 void MakeModulePath(str_t& absPath, const str_t& modname, const str_t& moddir)
 {
     // Maintain control of the loaded module by allowing only absolute
@@ -0,0 +1,708 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "ThreadedEngine.h"
+#include <string.h>
+#include "Program.h"
+#include "Verifier.h"
+
+#ifdef TVM_COMPUTED_GOTO
+
+static inline uint32_t compareFlags(int64_t r)
+{
+    if (r == 0)
+        return PF_Z;
+    return r < 0 ? PF_L : PF_G;
+}
+
+// Every handler ends by jumping directly to the next handler.
+// The op code range and the handler are not tested here because
+// testInstruction has already rejected anything outside of
+// (OP_BEG, OP_MAX), and the lowered op codes are all in the table.
+// forceExit sets the current instruction to -1 so the bounds test
+// also covers the exit flag.
+#define DISPATCH()                                     \
+    if (CURRENT >= tinst || (STOP && CURRENT == stop)) \
+        return;                                        \
+    pc = (size_t)CURRENT++;                            \
+    goto* table[code.op(pc)]
+
+// Ends a jump. With LOOPS set, a jump back to a loop header that
+// is marked in headers returns with CURRENT at the header.
+#define BRANCHED()                                       \
+    if (LOOPS && CURRENT <= pc && headers[CURRENT] != 0) \
+        return;                                          \
+    DISPATCH()
+
+// The machine state is reached through prog on each access rather
+// than through local references. Every access is then a member of
+// the same object, so the compiler can tell that writing a register
+// does not change the current instruction or the flags.
+#define REGS getRegisters(prog)
+#define PFLAGS getFlags(prog)
+#define COMPARE getCompare(prog)
+#define RETURN getReturn(prog)
+#define CURRENT getCurrent(prog)
+#define CALLS getCallStack(prog)
+#define STACK getStack(prog)
+#define DATA getDataTable(prog)
+#define OUTPUT getOutput(prog)
+
+#define R0 REGS[code.a(pc)].x
+#define R1 REGS[code.b(pc)].x
+#define R2 REGS[code.c(pc)].x
+#define IMM code.imm(pc)
+#define ADDR code.aux(pc)
+#define WIDE code.wide(ADDR)
+
+// The flags and index of a memory access
+#define FLAGS (ADDR & 0xFFFF)
+#define INDEX (ADDR >> 16)
+
+// A fused compare and branch leaves the flags as they would be after
+// executing the cmp and b* pair separately. With the flags coming
+// straight from the compare, every taken branch except bne clears
+// the only bit that was set.
+#define FUSED_BRANCH(NAME, COND, TAKEN) \
+    L_MOP_CMP_##NAME##_RR:              \
+    r = (int64_t)R0 - (int64_t)R1;      \
+    CURRENT += 1;                       \
+    goto T_##NAME;                      \
+    L_MOP_CMP_##NAME##_RI:              \
+    r = (int64_t)R0 - (int64_t)IMM;     \
+    CURRENT += 1;                       \
+    goto T_##NAME;                      \
+    L_MOP_INC_CMP_##NAME##_RR:          \
+    R0 += 1;                            \
+    r = (int64_t)R0 - (int64_t)R1;      \
+    CURRENT += 2;                       \
+    goto T_##NAME;                      \
+    L_MOP_INC_CMP_##NAME##_RI:          \
+    R0 += 1;                            \
+    r = (int64_t)R0 - (int64_t)IMM;     \
+    CURRENT += 2;                       \
+    T_##NAME:                           \
+    if (r COND 0)                       \
+    {                                   \
+        PFLAGS  = TAKEN;                \
+        CURRENT = ADDR;                 \
+    }                                   \
+    else                                \
+        PFLAGS = compareFlags(r);       \
+    BRANCHED()
+
+// With lazy flags the compare only records its operands and
+// the branch evaluates its condition from them. Nothing is
+// cleared when the branch is taken.
+#define LAZY_BRANCH(NAME, COND)     \
+    Z_MOP_CMP_##NAME##_RR:          \
+    COMPARE[0] = (int64_t)R0;       \
+    COMPARE[1] = (int64_t)R1;       \
+    CURRENT += 1;                   \
+    goto Z_OP_##NAME;               \
+    Z_MOP_CMP_##NAME##_RI:          \
+    COMPARE[0] = (int64_t)R0;       \
+    COMPARE[1] = (int64_t)IMM;      \
+    CURRENT += 1;                   \
+    goto Z_OP_##NAME;               \
+    Z_MOP_INC_CMP_##NAME##_RR:      \
+    R0 += 1;                        \
+    COMPARE[0] = (int64_t)R0;       \
+    COMPARE[1] = (int64_t)R1;       \
+    CURRENT += 2;                   \
+    goto Z_OP_##NAME;               \
+    Z_MOP_INC_CMP_##NAME##_RI:      \
+    R0 += 1;                        \
+    COMPARE[0] = (int64_t)R0;       \
+    COMPARE[1] = (int64_t)IMM;      \
+    CURRENT += 2;                   \
+    Z_OP_##NAME:                    \
+    if (COMPARE[0] COND COMPARE[1]) \
+        CURRENT = ADDR;             \
+    BRANCHED()
+
+#define LAZY_ENTRIES(NAME)                                        \
+    table[OP_##NAME]               = &&Z_OP_##NAME;               \
+    table[MOP_CMP_##NAME##_RR]     = &&Z_MOP_CMP_##NAME##_RR;     \
+    table[MOP_CMP_##NAME##_RI]     = &&Z_MOP_CMP_##NAME##_RI;     \
+    table[MOP_INC_CMP_##NAME##_RR] = &&Z_MOP_INC_CMP_##NAME##_RR; \
+    table[MOP_INC_CMP_##NAME##_RI] = &&Z_MOP_INC_CMP_##NAME##_RI
+
+#define MATH_HANDLERS(NAME, OP) \
+    L_MOP_##NAME##_RRR:         \
+    R0 = R1 OP R2;              \
+    DISPATCH();                 \
+    L_MOP_##NAME##_RRI:         \
+    R0 = R1 OP IMM;             \
+    DISPATCH();                 \
+    L_MOP_##NAME##_RIR:         \
+    R0 = IMM OP R2;             \
+    DISPATCH();                 \
+    L_MOP_##NAME##_RR:          \
+    R0 = R0 OP R1;              \
+    DISPATCH();                 \
+    L_MOP_##NAME##_RI:          \
+    R0 = R0 OP IMM;             \
+    DISPATCH()
+
+template <bool STOP, bool LOOPS>
+void ThreadedEngine::run(Program& prog, uint64_t stop, const uint8_t* headers)
+{
+    static const void* const DispatchTable[MOP_MAX] = {
+        &&L_OP_BEG,
+        &&L_OP_RET,
+        &&L_OP_BEG,  // OP_MOV, always lowered
+        &&L_OP_BEG,  // OP_GTO, always lowered
+        &&L_OP_INC,
+        &&L_OP_DEC,
+        &&L_OP_CMP,
+        &&L_OP_JMP,
+        &&L_OP_JEQ,
+        &&L_OP_JNE,
+        &&L_OP_JLT,
+        &&L_OP_JGT,
+        &&L_OP_JLE,
+        &&L_OP_JGE,
+        &&L_OP_ADD,
+        &&L_OP_BEG,  // OP_SUB, always lowered
+        &&L_OP_BEG,  // OP_MUL, always lowered
+        &&L_OP_DIV,
+        &&L_OP_BEG,  // OP_SHR, always lowered
+        &&L_OP_BEG,  // OP_SHL, always lowered
+        &&L_OP_ADRP,
+        &&L_OP_STR,
+        &&L_OP_LDR,
+        &&L_OP_LDRS,
+        &&L_OP_STRS,
+        &&L_OP_STP,
+        &&L_OP_LDP,
+        &&L_OP_BEG,  // OP_PRG, always lowered
+        &&L_OP_PRI,
+        &&L_OP_BEG,  // MOP_BEG
+        &&L_MOP_MOV_RR,
+        &&L_MOP_MOV_RR8,
+        &&L_MOP_MOV_RR16,
+        &&L_MOP_MOV_RR32,
+        &&L_MOP_MOV_RI,
+        &&L_MOP_MOV_RI8,
+        &&L_MOP_MOV_RI16,
+        &&L_MOP_MOV_RI32,
+        &&L_MOP_MOV_PR,
+        &&L_MOP_MOV_PI,
+        &&L_MOP_CALL_SYM,
+        &&L_MOP_CALL_ADR,
+        &&L_MOP_CMP_RR,
+        &&L_MOP_CMP_RI,
+        &&L_MOP_CMP_IR,
+        &&L_MOP_ADD_RRR,
+        &&L_MOP_ADD_RRI,
+        &&L_MOP_ADD_RIR,
+        &&L_MOP_ADD_RR,
+        &&L_MOP_ADD_RI,
+        &&L_MOP_SUB_RRR,
+        &&L_MOP_SUB_RRI,
+        &&L_MOP_SUB_RIR,
+        &&L_MOP_SUB_RR,
+        &&L_MOP_SUB_RI,
+        &&L_MOP_MUL_RRR,
+        &&L_MOP_MUL_RRI,
+        &&L_MOP_MUL_RIR,
+        &&L_MOP_MUL_RR,
+        &&L_MOP_MUL_RI,
+        &&L_MOP_DIV_RRR,
+        &&L_MOP_DIV_RRI,
+        &&L_MOP_DIV_RIR,
+        &&L_MOP_DIV_RR,
+        &&L_MOP_DIV_RI,
+        &&L_MOP_SHR_RRR,
+        &&L_MOP_SHR_RRI,
+        &&L_MOP_SHR_RIR,
+        &&L_MOP_SHR_RR,
+        &&L_MOP_SHR_RI,
+        &&L_MOP_SHL_RRR,
+        &&L_MOP_SHL_RRI,
+        &&L_MOP_SHL_RIR,
+        &&L_MOP_SHL_RR,
+        &&L_MOP_SHL_RI,
+        &&L_MOP_PRG_R,
+        &&L_MOP_PRG_I,
+        &&L_MOP_CMP_JEQ_RR,
+        &&L_MOP_CMP_JNE_RR,
+        &&L_MOP_CMP_JLT_RR,
+        &&L_MOP_CMP_JGT_RR,
+        &&L_MOP_CMP_JLE_RR,
+        &&L_MOP_CMP_JGE_RR,
+        &&L_MOP_CMP_JEQ_RI,
+        &&L_MOP_CMP_JNE_RI,
+        &&L_MOP_CMP_JLT_RI,
+        &&L_MOP_CMP_JGT_RI,
+        &&L_MOP_CMP_JLE_RI,
+        &&L_MOP_CMP_JGE_RI,
+        &&L_MOP_INC_CMP_JEQ_RR,
+        &&L_MOP_INC_CMP_JNE_RR,
+        &&L_MOP_INC_CMP_JLT_RR,
+        &&L_MOP_INC_CMP_JGT_RR,
+        &&L_MOP_INC_CMP_JLE_RR,
+        &&L_MOP_INC_CMP_JGE_RR,
+        &&L_MOP_INC_CMP_JEQ_RI,
+        &&L_MOP_INC_CMP_JNE_RI,
+        &&L_MOP_INC_CMP_JLT_RI,
+        &&L_MOP_INC_CMP_JGT_RI,
+        &&L_MOP_INC_CMP_JLE_RI,
+        &&L_MOP_INC_CMP_JGE_RI,
+        &&L_MOP_MOV_RR_CALL_SYM,
+        &&L_MOP_MOV_RI_CALL_SYM,
+        &&L_MOP_MOV_RR_CALL_ADR,
+        &&L_MOP_MOV_RI_CALL_ADR,
+        &&V_OP_ADRP,
+        &&V_OP_STR,
+        &&V_OP_LDR,
+        &&V_OP_LDRS,
+        &&V_OP_STRS,
+        &&V_OP_STP,
+        &&V_OP_LDP,
+    };
+
+    // Everything is read from the packed code, see PackInstructions.
+    const ProgramImage&    image = getImage(prog);
+    const size_t           tinst = image.code.size();
+    const PackedCode::View code  = image.code.view();
+    size_t                 pc;
+    int64_t                r;
+    const void*            table[MOP_MAX];
+
+    if (hasExited(prog))
+        return;
+
+    memcpy(table, DispatchTable, sizeof(DispatchTable));
+    if (hasLazyFlags(prog))
+    {
+        table[OP_CMP]     = &&Z_OP_CMP;
+        table[MOP_CMP_RR] = &&Z_MOP_CMP_RR;
+        table[MOP_CMP_RI] = &&Z_MOP_CMP_RI;
+        table[MOP_CMP_IR] = &&Z_MOP_CMP_IR;
+        LAZY_ENTRIES(JEQ);
+        LAZY_ENTRIES(JNE);
+        LAZY_ENTRIES(JLT);
+        LAZY_ENTRIES(JGT);
+        LAZY_ENTRIES(JLE);
+        LAZY_ENTRIES(JGE);
+    }
+
+    DISPATCH();
+
+L_OP_BEG:
+    DISPATCH();
+L_OP_RET:
+    if (!CALLS.empty())
+    {
+        CURRENT = CALLS.top();
+        CALLS.pop();
+    }
+    RETURN = (int32_t)REGS[0].w[0];
+    if (CALLS.empty())
+        forceExit(prog, RETURN);
+    DISPATCH();
+L_OP_INC:
+    R0 += 1;
+    DISPATCH();
+L_OP_DEC:
+    R0 -= 1;
+    DISPATCH();
+L_OP_CMP:
+    PFLAGS = compareFlags((int64_t)IMM - (int64_t)WIDE);
+    DISPATCH();
+L_OP_JMP:
+    CURRENT = ADDR;
+    BRANCHED();
+L_OP_JEQ:
+    if (PFLAGS & PF_Z)
+    {
+        PFLAGS &= ~PF_Z;
+        CURRENT = ADDR;
+    }
+    BRANCHED();
+L_OP_JNE:
+    if ((PFLAGS & PF_Z) == 0)
+        CURRENT = ADDR;
+    BRANCHED();
+L_OP_JLT:
+    if (PFLAGS & PF_L)
+    {
+        PFLAGS &= ~PF_L;
+        CURRENT = ADDR;
+    }
+    BRANCHED();
+L_OP_JGT:
+    if (PFLAGS & PF_G)
+    {
+        PFLAGS &= ~PF_G;
+        CURRENT = ADDR;
+    }
+    BRANCHED();
+L_OP_JLE:
+    if (PFLAGS & PF_Z)
+    {
+        PFLAGS &= ~PF_Z;
+        CURRENT = ADDR;
+    }
+    else if (PFLAGS & PF_L)
+    {
+        PFLAGS &= ~PF_L;
+        CURRENT = ADDR;
+    }
+    BRANCHED();
+L_OP_JGE:
+    if (PFLAGS & PF_Z)
+    {
+        PFLAGS &= ~PF_Z;
+        CURRENT = ADDR;
+    }
+    else if (PFLAGS & PF_G)
+    {
+        PFLAGS &= ~PF_G;
+        CURRENT = ADDR;
+    }
+    BRANCHED();
+L_OP_ADD:
+    // Only add r(n), r(n), ADDR is left, see lowerMath.
+    if (FLAGS & IF_REG1)
+        derefRegister(prog, code.a(pc), FLAGS, (uint8_t*)(size_t)R1);
+    DISPATCH();
+L_OP_DIV:
+    // Only a division by an immediate zero is left.
+    reportError(prog, "divide by zero");
+    forceExit(prog, -1);
+    DISPATCH();
+L_OP_ADRP:
+    if (IMM >= DATA.capacity())
+        DISPATCH();
+V_OP_ADRP:
+    R0 = (size_t)(DATA.ptr() + IMM);
+    DISPATCH();
+L_OP_STR:
+    if ((FLAGS & IF_STKP) && IMM / 8 > MAX_STACK_REL)
+    {
+        reportError(prog, "Stack size exceeded");
+        forceExit(prog, -1);
+        DISPATCH();
+    }
+V_OP_STR:
+    if ((FLAGS & IF_STKP) && (FLAGS & IF_REG0))
+    {
+        if (INDEX / 8 < STACK.size() && INDEX % 8 == 0)
+            STACK.peek(INDEX / 8) = R0;
+    }
+    DISPATCH();
+L_OP_LDR:
+    if ((FLAGS & IF_STKP) && IMM / 8 > MAX_STACK_REL)
+    {
+        reportError(prog, "Stack size exceeded");
+        forceExit(prog, -1);
+        DISPATCH();
+    }
+V_OP_LDR:
+    if (FLAGS & IF_STKP)
+    {
+        if ((FLAGS & IF_REG0) && INDEX / 8 < STACK.size() && INDEX % 8 == 0)
+            R0 = STACK.peek(INDEX / 8);
+    }
+    else if (FLAGS & IF_REG1)
+    {
+        Register&       dest = REGS[code.a(pc)];
+        const Register& src  = REGS[code.b(pc)];
+        if (FLAGS & IF_BTEB)
+        {
+            if (INDEX < 8)
+                dest.b[INDEX] = src.b[INDEX];
+        }
+        else if (FLAGS & IF_BTEW)
+        {
+            if (INDEX < 4)
+                dest.w[INDEX] = src.w[INDEX];
+        }
+        else if (FLAGS & IF_BTEL)
+        {
+            if (INDEX < 2)
+                dest.l[INDEX] = src.l[INDEX];
+        }
+        else
+            dest.x = src.x;
+    }
+    DISPATCH();
+L_OP_LDRS:
+    if (INDEX >= MAX_REG)
+        DISPATCH();
+V_OP_LDRS:
+    if ((FLAGS & IF_REG1) && R1 != 0 && R2 < DATA.capacity())
+        R0 = ((const uint8_t*)(size_t)R1)[R2];
+    DISPATCH();
+L_OP_STRS:
+    if (INDEX >= MAX_REG)
+        DISPATCH();
+V_OP_STRS:
+    if ((FLAGS & IF_REG1) && R1 != 0 && R2 < DATA.capacity())
+        ((uint8_t*)(size_t)R1)[R2] = (uint8_t)R0;
+    DISPATCH();
+L_OP_STP:
+    if ((FLAGS & IF_STKP) && IMM / 8 > MAX_STACK_REL)
+    {
+        reportError(prog, "Stack size exceeded");
+        forceExit(prog, -1);
+        DISPATCH();
+    }
+V_OP_STP:
+    if (FLAGS & IF_STKP)
+    {
+        if (STACK.size() >= MAX_STK)
+        {
+            reportError(prog, "STACK overflow.");
+            forceExit(prog, -2);
+        }
+        else
+        {
+            for (r = 0; r < (int64_t)(IMM / 8); ++r)
+                STACK.push(0);
+        }
+    }
+    DISPATCH();
+L_OP_LDP:
+    if ((FLAGS & IF_STKP) && IMM / 8 > MAX_STACK_REL)
+    {
+        reportError(prog, "STACK size exceeded");
+        forceExit(prog, -1);
+        DISPATCH();
+    }
+V_OP_LDP:
+    if (FLAGS & IF_STKP)
+    {
+        for (r = 0; r < (int64_t)(IMM / 8) && !STACK.empty(); ++r)
+            STACK.pop();
+    }
+    DISPATCH();
+L_OP_PRI:
+    OUTPUT.printRegisters(REGS, MAX_REG);
+    DISPATCH();
+
+    // ---- lowered op codes ----
+L_MOP_MOV_RR:
+    R0 = R1;
+    DISPATCH();
+L_MOP_MOV_RR8:
+    REGS[code.a(pc)].b[0] = (uint8_t)R1;
+    DISPATCH();
+L_MOP_MOV_RR16:
+    REGS[code.a(pc)].w[0] = (uint16_t)R1;
+    DISPATCH();
+L_MOP_MOV_RR32:
+    REGS[code.a(pc)].l[0] = (uint32_t)R1;
+    DISPATCH();
+L_MOP_MOV_RI:
+    R0 = IMM;
+    DISPATCH();
+L_MOP_MOV_RI8:
+    REGS[code.a(pc)].b[0] = (uint8_t)IMM;
+    DISPATCH();
+L_MOP_MOV_RI16:
+    REGS[code.a(pc)].w[0] = (uint16_t)IMM;
+    DISPATCH();
+L_MOP_MOV_RI32:
+    REGS[code.a(pc)].l[0] = (uint32_t)IMM;
+    DISPATCH();
+L_MOP_MOV_PR:
+    CURRENT = R1;
+    DISPATCH();
+L_MOP_MOV_PI:
+    CURRENT = IMM;
+    BRANCHED();
+L_MOP_CALL_SYM:
+    callSymbol(prog, ADDR);
+    DISPATCH();
+L_MOP_CALL_ADR:
+    CALLS.push(CURRENT);
+    CURRENT = ADDR;
+    if (CALLS.size() > MAX_STK)
+    {
+        reportError(prog, "maximum number of branches exceeded.");
+        forceExit(prog, -1);
+    }
+    DISPATCH();
+L_MOP_CMP_RR:
+    PFLAGS = compareFlags((int64_t)R0 - (int64_t)R1);
+    DISPATCH();
+L_MOP_CMP_RI:
+    PFLAGS = compareFlags((int64_t)R0 - (int64_t)IMM);
+    DISPATCH();
+L_MOP_CMP_IR:
+    PFLAGS = compareFlags((int64_t)IMM - (int64_t)R1);
+    DISPATCH();
+Z_MOP_CMP_RR:
+    COMPARE[0] = (int64_t)R0;
+    COMPARE[1] = (int64_t)R1;
+    DISPATCH();
+Z_MOP_CMP_RI:
+    COMPARE[0] = (int64_t)R0;
+    COMPARE[1] = (int64_t)IMM;
+    DISPATCH();
+Z_MOP_CMP_IR:
+    COMPARE[0] = (int64_t)IMM;
+    COMPARE[1] = (int64_t)R1;
+    DISPATCH();
+Z_OP_CMP:
+    COMPARE[0] = (int64_t)IMM;
+    COMPARE[1] = (int64_t)WIDE;
+    DISPATCH();
+
+    MATH_HANDLERS(ADD, +);
+    MATH_HANDLERS(SUB, -);
+    MATH_HANDLERS(MUL, *);
+    MATH_HANDLERS(SHR, >>);
+    MATH_HANDLERS(SHL, <<);
+
+L_MOP_DIV_RRR:
+    if (R2 != 0)
+        R0 = R1 / R2;
+    else
+    {
+        reportError(prog, "divide by zero");
+        forceExit(prog, -1);
+    }
+    DISPATCH();
+L_MOP_DIV_RRI:
+    R0 = R1 / IMM;
+    DISPATCH();
+L_MOP_DIV_RIR:
+    if (R2 != 0)
+        R0 = IMM / R2;
+    else
+    {
+        reportError(prog, "divide by zero");
+        forceExit(prog, -1);
+    }
+    DISPATCH();
+L_MOP_DIV_RR:
+    if (R1 != 0)
+        R0 /= R1;
+    else
+    {
+        reportError(prog, "divide by zero");
+        forceExit(prog, -1);
+    }
+    DISPATCH();
+L_MOP_DIV_RI:
+    R0 /= IMM;
+    DISPATCH();
+L_MOP_PRG_R:
+    OUTPUT.printInteger((int64_t)R0);
+    DISPATCH();
+L_MOP_PRG_I:
+    OUTPUT.printInteger((int64_t)IMM);
+    DISPATCH();
+
+    // ---- fused op codes ----
+    FUSED_BRANCH(JEQ, ==, 0);
+    FUSED_BRANCH(JNE, !=, compareFlags(r));
+    FUSED_BRANCH(JLT, <, 0);
+    FUSED_BRANCH(JGT, >, 0);
+    FUSED_BRANCH(JLE, <=, 0);
+    FUSED_BRANCH(JGE, >=, 0);
+
+    LAZY_BRANCH(JEQ, ==);
+    LAZY_BRANCH(JNE, !=);
+    LAZY_BRANCH(JLT, <);
+    LAZY_BRANCH(JGT, >);
+    LAZY_BRANCH(JLE, <=);
+    LAZY_BRANCH(JGE, >=);
+
+L_MOP_MOV_RR_CALL_SYM:
+    R0 = R1;
+    goto T_CALL_SYM;
+L_MOP_MOV_RI_CALL_SYM:
+    R0 = IMM;
+T_CALL_SYM:
+    CURRENT += 1;
+    callSymbol(prog, ADDR);
+    DISPATCH();
+L_MOP_MOV_RR_CALL_ADR:
+    R0 = R1;
+    goto T_CALL_ADR;
+L_MOP_MOV_RI_CALL_ADR:
+    R0 = IMM;
+T_CALL_ADR:
+    CALLS.push(CURRENT + 1);
+    CURRENT = ADDR;
+    if (CALLS.size() > MAX_STK)
+    {
+        reportError(prog, "maximum number of branches exceeded.");
+        forceExit(prog, -1);
+    }
+    DISPATCH();
+}
+
+template void ThreadedEngine::run<false, false>(Program& prog, uint64_t stop, const uint8_t* headers);
+template void ThreadedEngine::run<true, false>(Program& prog, uint64_t stop, const uint8_t* headers);
+template void ThreadedEngine::run<false, true>(Program& prog, uint64_t stop, const uint8_t* headers);
+
+#undef MATH_HANDLERS
+#undef LAZY_ENTRIES
+#undef LAZY_BRANCH
+#undef FUSED_BRANCH
+#undef INDEX
+#undef FLAGS
+#undef WIDE
+#undef ADDR
+#undef IMM
+#undef R2
+#undef R1
+#undef R0
+#undef OUTPUT
+#undef DATA
+#undef STACK
+#undef CALLS
+#undef CURRENT
+#undef RETURN
+#undef COMPARE
+#undef PFLAGS
+#undef REGS
+#undef BRANCHED
+#undef DISPATCH
+
+const char* ThreadedEngine::getName(void) const
+{
+    return "threaded";
+}
+
+void ThreadedEngine::execute(Program& prog)
+{
+    run<false, false>(prog, 0, nullptr);
+}
+
+void ThreadedEngine::runTo(Program& prog, uint64_t addr)
+{
+    run<true, false>(prog, addr, nullptr);
+}
+
+bool ThreadedEngine::runsSource(void) const
+{
+    return false;
+}
+
+#endif  // TVM_COMPUTED_GOTO
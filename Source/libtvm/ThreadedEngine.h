@@ -0,0 +1,55 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _ThreadedEngine_h_
+#define _ThreadedEngine_h_
+
+#include "Engine.h"
+
+#ifdef TVM_COMPUTED_GOTO
+
+// Dispatches straight from one handler to the next through a table
+// of label addresses, and runs the packed code rather than the
+// source instructions. See PackInstructions.
+class ThreadedEngine : public Engine
+{
+protected:
+    // With STOP set it returns once stop is the next instruction.
+    // With LOOPS set it also returns when a jump goes back to an
+    // instruction whose byte in headers is set, see TraceEngine.
+    template <bool STOP, bool LOOPS>
+    void run(Program& prog, uint64_t stop, const uint8_t* headers);
+
+public:
+    const char* getName(void) const;
+
+    void execute(Program& prog);
+
+    // A fused instruction is run as a whole, so addr has to be
+    // where one starts, a label for instance.
+    void runTo(Program& prog, uint64_t addr);
+
+    bool runsSource(void) const;
+};
+
+#endif  // TVM_COMPUTED_GOTO
+
+#endif  //_ThreadedEngine_h_
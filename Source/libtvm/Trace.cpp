@@ -0,0 +1,677 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Trace.h"
+
+#ifdef TVM_JIT
+#include <sys/mman.h>
+#include "Assembler.h"
+
+typedef Assembler::Label Label;
+
+enum FlagState
+{
+    FS_MEMORY = 0,  // *flags is current
+    FS_ZERO,        // a taken branch cleared the flags
+    FS_COMPARE,     // the flags come from the result in REG_CMP
+};
+
+// Register usage in the generated code
+const int REG_RT  = R12;  // JitRuntime*
+const int REG_CMP = R15;  // result of the last cmp
+
+// The VM registers live in host registers for the whole trace.
+// They are only written back at an exit or before calling into
+// the interpreter.
+const int HostRegister[MAX_REG] = {
+    RBX,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R13,
+    R14,
+};
+
+#define HR(x) HostRegister[(size_t)(x)]
+
+struct PendingExit
+{
+    Label     label;
+    int       state;
+    TraceExit exit;
+};
+
+class TraceBuilder
+{
+private:
+    const ExecInstructions&  m_ins;
+    const Tracer::Steps&     m_steps;
+    Assembler                m_asm;
+    std::vector<PendingExit> m_exits;
+    std::vector<uint64_t>    m_frames;
+    Label                    m_epilogue;
+    int                      m_state;
+    size_t                   m_depth;
+    bool                     m_lazyFlags;
+    bool                     m_flagsLive;
+
+    Label exitTo(uint64_t next, int state)
+    {
+        PendingExit pe;
+        pe.label       = m_asm.label();
+        pe.state       = state;
+        pe.exit.next   = next;
+        pe.exit.frames = m_frames;
+        m_exits.push_back(pe);
+        return pe.label;
+    }
+
+    void loadRegisters(void)
+    {
+        m_asm.load64(RAX, REG_RT, RT_OFFSET(regs));
+        for (int i = 0; i < MAX_REG; ++i)
+            m_asm.load64(HR(i), RAX, REG_OFFSET(i));
+    }
+
+    void storeRegisters(void)
+    {
+        m_asm.load64(RAX, REG_RT, RT_OFFSET(regs));
+        for (int i = 0; i < MAX_REG; ++i)
+            m_asm.store64(RAX, REG_OFFSET(i), HR(i));
+    }
+
+    void storeFlags(int state)
+    {
+        if (state == FS_ZERO)
+        {
+            m_asm.load64(RAX, REG_RT, RT_OFFSET(flags));
+            m_asm.store32i(RAX, 0, 0);
+        }
+        else if (state == FS_COMPARE)
+        {
+            // PF_Z | PF_G << 1 | PF_L << 2
+            m_asm.test(REG_CMP, REG_CMP);
+            m_asm.setcc(CC_E, RCX);
+            m_asm.setcc(CC_G, RDX);
+            m_asm.setcc(CC_L, RAX);
+            m_asm.movzx8(RAX, RAX);
+            m_asm.movzx8(RCX, RCX);
+            m_asm.movzx8(RDX, RDX);
+            m_asm.lea32(RCX, RCX, RDX, 2);
+            m_asm.lea32(RCX, RCX, RAX, 4);
+            m_asm.load64(RAX, REG_RT, RT_OFFSET(flags));
+            m_asm.store32(RAX, 0, RCX);
+        }
+    }
+
+    void emitOperand(int dst, const ExecInstruction& ins, int idx, uint16_t flag)
+    {
+        if (ins.flags & flag)
+            m_asm.mov(dst, HR(ins.argv[idx]));
+        else
+            m_asm.movi(dst, ins.argv[idx]);
+    }
+
+    void emitExecute(const ExecInstruction& ins, uint64_t addr)
+    {
+        storeRegisters();
+        m_asm.mov(RDI, REG_RT);
+        m_asm.movi(RSI, (uint64_t)(size_t)&ins);
+        m_asm.callm(REG_RT, RT_OFFSET(execute));
+        loadRegisters();
+        m_asm.cmp32i(REG_RT, RT_OFFSET(status), 0);
+        m_asm.jcc(CC_NE, exitTo(addr + 1, m_state));
+    }
+
+    void emitMove(const ExecInstruction& ins)
+    {
+        const int dst = HR(ins.argv[0]);
+
+        if (!(ins.flags & (IF_BTEB | IF_BTEW | IF_BTEL)))
+        {
+            emitOperand(dst, ins, 1, IF_REG1);
+            return;
+        }
+
+        emitOperand(RAX, ins, 1, IF_REG1);
+        if (ins.flags & IF_BTEB)
+            m_asm.mov8(dst, RAX);
+        else if (ins.flags & IF_BTEW)
+            m_asm.mov16(dst, RAX);
+        else
+        {
+            // A 32 bit move clears the upper half on the host,
+            // but not in the VM.
+            m_asm.mov32(RCX, RAX);
+            m_asm.mov(RDX, dst);
+            m_asm.shri(RDX, 32);
+            m_asm.shli(RDX, 32);
+            m_asm.orr(RDX, RCX);
+            m_asm.mov(dst, RDX);
+        }
+    }
+
+    void emitMath(const ExecInstruction& ins, uint64_t addr)
+    {
+        const int dst = HR(ins.argv[0]);
+        if (ins.argc > 2)
+        {
+            emitOperand(RAX, ins, 1, IF_REG1);
+            emitOperand(RCX, ins, 2, IF_REG2);
+        }
+        else
+        {
+            m_asm.mov(RAX, dst);
+            emitOperand(RCX, ins, 1, IF_REG1);
+        }
+
+        switch (ins.op)
+        {
+        case OP_ADD:
+            m_asm.add(RAX, RCX);
+            break;
+        case OP_SUB:
+            m_asm.sub(RAX, RCX);
+            break;
+        case OP_MUL:
+            m_asm.imul(RAX, RCX);
+            break;
+        case OP_SHR:
+            m_asm.shr(RAX);
+            break;
+        case OP_SHL:
+            m_asm.shl(RAX);
+            break;
+        case OP_DIV:
+            // leave the error to the interpreter
+            m_asm.test(RCX, RCX);
+            m_asm.jcc(CC_E, exitTo(addr, m_state));
+            m_asm.xor32(RDX, RDX);
+            m_asm.div(RCX);
+            break;
+        default:
+            break;
+        }
+        m_asm.mov(dst, RAX);
+    }
+
+    // With lazy flags the operands of the last cmp are always in
+    // memory, so there is nothing to write back at an exit. The
+    // host flags are only reused while nothing has touched them.
+    void emitLazyGuard(const ExecInstruction& ins, const Tracer::Step& step, bool live)
+    {
+        if (!live)
+        {
+            m_asm.load64(RDX, REG_RT, RT_OFFSET(compare));
+            m_asm.load64(RAX, RDX, 0);
+            m_asm.load64(RCX, RDX, 8);
+            m_asm.cmp(RAX, RCX);
+        }
+
+        const int cc = BranchCondition(ins.op);
+        if (step.next == ins.argv[0])
+            m_asm.jcc(cc ^ 1, exitTo(step.addr + 1, FS_MEMORY));
+        else
+            m_asm.jcc(cc, exitTo(ins.argv[0], FS_MEMORY));
+    }
+
+    void emitLazyCompare(const ExecInstruction& ins)
+    {
+        emitOperand(RAX, ins, 0, IF_REG0);
+        emitOperand(RCX, ins, 1, IF_REG1);
+        m_asm.load64(RDX, REG_RT, RT_OFFSET(compare));
+        m_asm.store64(RDX, 0, RAX);
+        m_asm.store64(RDX, 8, RCX);
+        m_asm.cmp(RAX, RCX);
+    }
+
+    void emitGuard(const ExecInstruction& ins, const Tracer::Step& step)
+    {
+        const bool taken      = step.next == ins.argv[0];
+        const int  takenState = ins.op == OP_JNE ? m_state : FS_ZERO;
+
+        int cc;
+        if (m_state == FS_ZERO)
+        {
+            // The outcome is known, only jne is taken.
+            return;
+        }
+        else if (m_state == FS_COMPARE)
+        {
+            cc = BranchCondition(ins.op);
+            m_asm.test(REG_CMP, REG_CMP);
+        }
+        else
+        {
+            uint32_t mask;
+            switch (ins.op)
+            {
+            case OP_JEQ:
+            case OP_JNE:
+                mask = PF_Z;
+                break;
+            case OP_JLT:
+                mask = PF_L;
+                break;
+            case OP_JGT:
+                mask = PF_G;
+                break;
+            case OP_JLE:
+                mask = PF_Z | PF_L;
+                break;
+            case OP_JGE:
+            default:
+                mask = PF_Z | PF_G;
+                break;
+            }
+
+            cc = ins.op == OP_JNE ? CC_E : CC_NE;
+            m_asm.load64(RAX, REG_RT, RT_OFFSET(flags));
+            m_asm.test32i(RAX, 0, mask);
+        }
+
+        // Condition codes come in pairs, the low bit inverts them.
+        if (taken)
+        {
+            m_asm.jcc(cc ^ 1, exitTo(step.addr + 1, m_state));
+            m_state = takenState;
+        }
+        else
+            m_asm.jcc(cc, exitTo(ins.argv[0], takenState));
+    }
+
+    void emitReturn(void)
+    {
+        m_asm.movzx16(RAX, HR(0));
+        m_asm.load64(RCX, REG_RT, RT_OFFSET(ret));
+        m_asm.store32(RCX, 0, RAX);
+        m_frames.pop_back();
+    }
+
+    void emitStep(const Tracer::Step& step)
+    {
+        const ExecInstruction& ins = m_ins[(size_t)step.addr];
+
+        const bool live = m_flagsLive;
+        m_flagsLive     = false;
+
+        switch (ins.op)
+        {
+        case OP_RET:
+            emitReturn();
+            break;
+        case OP_MOV:
+            if (!(ins.flags & IF_INSP))
+                emitMove(ins);
+            break;
+        case OP_GTO:
+            if (ins.flags & IF_SYMU || !(ins.flags & IF_ADDR))
+                emitExecute(ins, step.addr);
+            else
+            {
+                m_frames.push_back(step.addr + 1);
+                if (m_frames.size() > m_depth)
+                    m_depth = m_frames.size();
+            }
+            break;
+        case OP_INC:
+            m_asm.inc(HR(ins.argv[0]));
+            break;
+        case OP_DEC:
+            m_asm.dec(HR(ins.argv[0]));
+            break;
+        case OP_CMP:
+            if (m_lazyFlags)
+            {
+                emitLazyCompare(ins);
+                m_flagsLive = true;
+                break;
+            }
+            emitOperand(REG_CMP, ins, 0, IF_REG0);
+            emitOperand(RCX, ins, 1, IF_REG1);
+            m_asm.sub(REG_CMP, RCX);
+            m_state = FS_COMPARE;
+            break;
+        case OP_JMP:
+            break;
+        case OP_JEQ:
+        case OP_JNE:
+        case OP_JLT:
+        case OP_JGT:
+        case OP_JLE:
+        case OP_JGE:
+            if (m_lazyFlags)
+            {
+                emitLazyGuard(ins, step, live);
+                m_flagsLive = true;
+            }
+            else
+                emitGuard(ins, step);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_SHR:
+        case OP_SHL:
+            if (ins.flags & IF_ADRD)
+                emitExecute(ins, step.addr);
+            else
+                emitMath(ins, step.addr);
+            break;
+        default:
+            emitExecute(ins, step.addr);
+            break;
+        }
+    }
+
+public:
+    TraceBuilder(const ExecInstructions& ins,
+                 const Tracer::Steps&    steps,
+                 bool                    lazyFlags) :
+        m_ins(ins),
+        m_steps(steps),
+        m_state(FS_MEMORY),
+        m_depth(0),
+        m_lazyFlags(lazyFlags),
+        m_flagsLive(false)
+    {
+        m_epilogue = m_asm.label();
+    }
+
+    // uint64_t trace(JitRuntime* rt)
+    Trace* build(void)
+    {
+        m_asm.push(RBX);
+        m_asm.push(RBP);
+        m_asm.push(R12);
+        m_asm.push(R13);
+        m_asm.push(R14);
+        m_asm.push(R15);
+        m_asm.subi(RSP, 8);
+        m_asm.mov(REG_RT, RDI);
+        loadRegisters();
+
+        Label header = m_asm.label();
+        m_asm.bind(header);
+
+        Tracer::Steps::const_iterator it;
+        for (it = m_steps.begin(); it != m_steps.end(); ++it)
+            emitStep(*it);
+
+        // The loop is entered with the flags in memory.
+        storeFlags(m_state);
+        m_asm.jmp(header);
+
+        TraceExits exits;
+        exits.reserve(m_exits.size());
+
+        std::vector<PendingExit>::const_iterator eit;
+        for (eit = m_exits.begin(); eit != m_exits.end(); ++eit)
+        {
+            m_asm.bind(eit->label);
+            storeFlags(eit->state);
+            storeRegisters();
+            m_asm.movi(RAX, exits.size());
+            m_asm.jmp(m_epilogue);
+            exits.push_back(eit->exit);
+        }
+
+        m_asm.bind(m_epilogue);
+        m_asm.addi(RSP, 8);
+        m_asm.pop(R15);
+        m_asm.pop(R14);
+        m_asm.pop(R13);
+        m_asm.pop(R12);
+        m_asm.pop(RBP);
+        m_asm.pop(RBX);
+        m_asm.ret();
+
+        if (!m_asm.resolve())
+            return nullptr;
+
+        const size_t size = m_asm.size();
+
+        uint8_t* code = (uint8_t*)mmap(nullptr,
+                                       size,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS,
+                                       -1,
+                                       0);
+        if (code == MAP_FAILED)
+            return nullptr;
+
+        memcpy(code, m_asm.data(), size);
+        if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(code, size);
+            return nullptr;
+        }
+        return new Trace(code, size, m_depth, exits);
+    }
+};
+
+Trace::Trace(uint8_t* code, size_t size, size_t depth, const TraceExits& exits) :
+    m_code(code),
+    m_size(size),
+    m_depth(depth),
+    m_exits(exits)
+{
+}
+
+Trace::~Trace()
+{
+    if (m_code)
+        munmap(m_code, m_size);
+}
+
+Tracer::Tracer(const ExecInstructions& ins, bool lazyFlags) :
+    m_ins(ins),
+    m_slots(ins.size(), Slot({0, nullptr})),
+    m_headers(ins.size(), 1),
+    m_steps(),
+    m_frames(),
+    m_header(0),
+    m_recording(false),
+    m_lazyFlags(lazyFlags),
+    m_stats({})
+{
+}
+
+Tracer::~Tracer()
+{
+    Slots::iterator it = m_slots.begin();
+    while (it != m_slots.end())
+        delete (it++)->trace;
+}
+
+Trace* Tracer::branch(uint64_t addr)
+{
+    if (addr >= m_slots.size())
+        return nullptr;
+
+    Slot& slot = m_slots[(size_t)addr];
+    if (slot.trace)
+        return m_recording ? nullptr : slot.trace;
+
+    // A loop that failed to record stays at the threshold.
+    if (m_recording || slot.count >= TRACE_THRESHOLD)
+        return nullptr;
+
+    if (++slot.count >= TRACE_THRESHOLD)
+    {
+        m_header    = addr;
+        m_recording = true;
+        m_steps.clear();
+        m_frames.clear();
+        m_stats.recorded++;
+    }
+    return nullptr;
+}
+
+bool Tracer::isTraceable(const ExecInstruction& ins, uint64_t addr, uint64_t next)
+{
+    if (next >= m_ins.size())
+        return false;
+
+    if (ins.flags & IF_REG0 && ins.argv[0] >= MAX_REG)
+        return false;
+    if (ins.flags & IF_REG1 && ins.argv[1] >= MAX_REG)
+        return false;
+    if (ins.flags & IF_REG2 && ins.argv[2] >= MAX_REG)
+        return false;
+
+    switch (ins.op)
+    {
+    case OP_RET:
+        if (m_frames.empty())
+            return false;
+        m_frames.pop_back();
+        return true;
+    case OP_MOV:
+        if (ins.flags & IF_INSP)
+            return (ins.flags & IF_REG1) == 0;
+        return (ins.flags & ~(IF_REG0 | IF_REG1 | IF_BTEB | IF_BTEW | IF_BTEL)) == 0 &&
+               ins.argv[0] < MAX_REG;
+    case OP_GTO:
+        if (ins.flags & IF_ADDR && !(ins.flags & IF_SYMU))
+            m_frames.push_back(addr + 1);
+        return true;
+    case OP_INC:
+    case OP_DEC:
+        return ins.argv[0] < MAX_REG;
+    case OP_JEQ:
+    case OP_JNE:
+    case OP_JLT:
+    case OP_JGT:
+    case OP_JLE:
+    case OP_JGE:
+        // The direction could not be told apart from the trace.
+        return ins.argv[0] != addr + 1;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_SHR:
+    case OP_SHL:
+        return (ins.flags & IF_ADRD) != 0 || ins.argv[0] < MAX_REG;
+    default:
+        return true;
+    }
+}
+
+void Tracer::record(uint64_t addr, uint64_t next)
+{
+    // Skips the branch that started the recording.
+    if (m_steps.empty() && addr != m_header)
+        return;
+
+    if (m_steps.size() >= TRACE_MAX_LENGTH ||
+        !isTraceable(m_ins[(size_t)addr], addr, next))
+    {
+        abort();
+        return;
+    }
+
+    Step step = {addr, next};
+    m_steps.push_back(step);
+
+    if (next == m_header && m_frames.empty())
+        close();
+}
+
+void Tracer::abort(void)
+{
+    m_recording                 = false;
+    m_headers[(size_t)m_header] = 0;
+    m_stats.aborted++;
+}
+
+void Tracer::stop(void)
+{
+    if (m_recording)
+        abort();
+}
+
+void Tracer::close(void)
+{
+    m_recording = false;
+
+    TraceBuilder builder(m_ins, m_steps, m_lazyFlags);
+
+    Trace* trace = builder.build();
+    if (!trace)
+    {
+        m_headers[(size_t)m_header] = 0;
+        m_stats.aborted++;
+        return;
+    }
+
+    m_slots[(size_t)m_header].trace = trace;
+    m_stats.compiled++;
+    m_stats.codeSize += trace->getSize();
+}
+
+#else
+
+Trace::Trace(uint8_t*, size_t, size_t, const TraceExits&) :
+    m_code(nullptr),
+    m_size(0),
+    m_depth(0),
+    m_exits()
+{
+}
+
+Trace::~Trace()
+{
+}
+
+Tracer::Tracer(const ExecInstructions& ins, bool lazyFlags) :
+    m_ins(ins),
+    m_slots(),
+    m_headers(),
+    m_steps(),
+    m_frames(),
+    m_header(0),
+    m_recording(false),
+    m_lazyFlags(lazyFlags),
+    m_stats({})
+{
+}
+
+Tracer::~Tracer()
+{
+}
+
+Trace* Tracer::branch(uint64_t)
+{
+    return nullptr;
+}
+
+void Tracer::record(uint64_t, uint64_t)
+{
+}
+
+#endif  // TVM_JIT
@@ -0,0 +1,159 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Trace_h_
+#define _Trace_h_
+
+#include <vector>
+#include "Jit.h"
+
+// Number of backward branches to a loop header before it is recorded.
+#define TRACE_THRESHOLD 64
+// Maximum number of instructions in a single trace.
+#define TRACE_MAX_LENGTH 512
+
+struct TraceExit
+{
+    uint64_t              next;    // instruction to resume at
+    std::vector<uint64_t> frames;  // return addresses of inlined calls
+};
+
+typedef std::vector<TraceExit> TraceExits;
+
+struct TraceStats
+{
+    size_t recorded;
+    size_t compiled;
+    size_t aborted;
+    size_t entered;
+    size_t codeSize;
+};
+
+class Trace
+{
+public:
+    typedef uint64_t (*Function)(JitRuntime* rt);
+
+private:
+    uint8_t*   m_code;
+    size_t     m_size;
+    size_t     m_depth;
+    TraceExits m_exits;
+
+public:
+    Trace(uint8_t* code, size_t size, size_t depth, const TraceExits& exits);
+    ~Trace();
+
+    // Runs the loop until a guard fails, and returns where
+    // the interpreter has to pick up.
+    inline const TraceExit& run(JitRuntime* rt) const
+    {
+        return m_exits[(size_t)((Function)m_code)(rt)];
+    }
+
+    // The deepest call that was inlined into the trace.
+    inline size_t getDepth(void) const
+    {
+        return m_depth;
+    }
+
+    inline size_t getSize(void) const
+    {
+        return m_size;
+    }
+};
+
+class Tracer
+{
+public:
+    struct Step
+    {
+        uint64_t addr;
+        uint64_t next;
+    };
+
+    typedef std::vector<Step> Steps;
+
+private:
+    struct Slot
+    {
+        uint32_t count;
+        Trace*   trace;
+    };
+
+    typedef std::vector<Slot> Slots;
+
+    const ExecInstructions& m_ins;
+    Slots                   m_slots;
+    std::vector<uint8_t>    m_headers;
+    Steps                   m_steps;
+    std::vector<uint64_t>   m_frames;
+    uint64_t                m_header;
+    bool                    m_recording;
+    bool                    m_lazyFlags;
+    TraceStats              m_stats;
+
+    void abort(void);
+    void close(void);
+    bool isTraceable(const ExecInstruction& ins, uint64_t addr, uint64_t next);
+
+public:
+    Tracer(const ExecInstructions& ins, bool lazyFlags);
+    ~Tracer();
+
+    // Called on every backward branch. Returns the compiled
+    // trace for addr if there is one, otherwise it counts the
+    // branch and starts recording once the loop is hot.
+    Trace* branch(uint64_t addr);
+
+    // Drops a recording that was still in progress when the program
+    // stopped, so the next launch starts without one.
+    void stop(void);
+
+    // Adds an executed instruction to the current recording.
+    // next is the instruction the interpreter will run next.
+    void record(uint64_t addr, uint64_t next);
+
+    // One byte per instruction, set while a backward branch to it
+    // still has to be passed to branch. It is cleared once the loop
+    // has failed to record, so the interpreter can stop asking.
+    inline const uint8_t* getHeaders(void) const
+    {
+        return m_headers.data();
+    }
+
+    inline bool isRecording(void) const
+    {
+        return m_recording;
+    }
+
+    inline void entered(void)
+    {
+        m_stats.entered++;
+    }
+
+    inline const TraceStats& getStats(void) const
+    {
+        return m_stats;
+    }
+};
+
+#endif  //_Trace_h_
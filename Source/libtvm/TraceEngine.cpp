@@ -0,0 +1,155 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "TraceEngine.h"
+#include "Program.h"
+
+#ifdef TVM_TRACE
+
+TraceEngine::TraceEngine() :
+    m_tracer(nullptr),
+    m_runtime({}),
+    m_program(nullptr)
+{
+}
+
+TraceEngine::~TraceEngine()
+{
+    delete m_tracer;
+}
+
+const char* TraceEngine::getName(void) const
+{
+    return "trace";
+}
+
+int TraceEngine::prepare(Program& prog)
+{
+    delete m_tracer;
+    m_tracer = new Tracer(getInstructions(prog), hasLazyFlags(prog));
+    return PS_OK;
+}
+
+const Tracer* TraceEngine::getTracer(void) const
+{
+    return m_tracer;
+}
+
+void TraceEngine::rewind(Program&, uint64_t)
+{
+    if (m_tracer)
+        m_tracer->stop();
+}
+
+void TraceEngine::prepareRuntime(Program& prog)
+{
+    m_program         = &prog;
+    m_runtime.regs    = getRegisters(prog);
+    m_runtime.flags   = &getFlags(prog);
+    m_runtime.compare = getCompare(prog);
+    m_runtime.ret     = &getReturn(prog);
+    m_runtime.status  = 0;
+    m_runtime.user    = this;
+    m_runtime.execute = traceExecute;
+}
+
+void TraceEngine::execute(Program& prog)
+{
+    if (!m_tracer)
+        prepare(prog);
+
+    prepareRuntime(prog);
+
+    const size_t   tinst   = getInstructions(prog).size();
+    const uint8_t* headers = m_tracer->getHeaders();
+
+    // Everything outside of a trace runs on the threaded loop. It only
+    // returns here on a backward branch to a loop the tracer is still
+    // counting or has compiled, so the other instructions are not
+    // tested at all.
+    for (;;)
+    {
+        run<false, true>(prog, 0, headers);
+        if (getCurrent(prog) >= tinst || hasExited(prog))
+            break;
+
+        enterTrace(prog, getCurrent(prog));
+        if (m_tracer->isRecording())
+            record(prog);
+    }
+}
+
+bool TraceEngine::runsSource(void) const
+{
+    return true;
+}
+
+void TraceEngine::record(Program& prog)
+{
+    const ExecInstructions& ins     = getInstructions(prog);
+    size_t                  tinst   = ins.size();
+    const ExecInstruction*  basePtr = ins.data();
+    uint64_t&               curinst = getCurrent(prog);
+
+    // A loop is recorded from the source instructions, one step at a
+    // time, until it closes or is aborted. The packed code has the
+    // same addresses, so the threaded loop picks up from wherever
+    // that happens.
+    while (m_tracer->isRecording() && curinst < tinst && !hasExited(prog))
+    {
+        const uint64_t addr = curinst++;
+        step(prog, basePtr[addr]);
+        m_tracer->record(addr, curinst);
+    }
+}
+
+void TraceEngine::enterTrace(Program& prog, uint64_t addr)
+{
+    ArrayStack& callStack = getCallStack(prog);
+
+    Trace* trace = m_tracer->branch(addr);
+    if (!trace || callStack.size() + trace->getDepth() > MAX_STK)
+        return;
+
+    m_tracer->entered();
+
+    const TraceExit& te = trace->run(&m_runtime);
+    if (hasExited(prog))
+        return;
+
+    // Calls that were inlined in the trace still
+    // need to return to the interpreter.
+    std::vector<uint64_t>::const_iterator it;
+    for (it = te.frames.begin(); it != te.frames.end(); ++it)
+        callStack.push(*it);
+
+    getCurrent(prog) = te.next;
+}
+
+void TraceEngine::traceExecute(JitRuntime* rt, const ExecInstruction* inst)
+{
+    Program& prog = *((TraceEngine*)rt->user)->m_program;
+
+    step(prog, *inst);
+    rt->status = hasExited(prog) ? 1 : 0;
+}
+
+#endif  // TVM_TRACE
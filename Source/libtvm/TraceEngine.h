@@ -0,0 +1,67 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _TraceEngine_h_
+#define _TraceEngine_h_
+
+#include "ThreadedEngine.h"
+#include "Trace.h"
+
+// Traces are entered from the threaded loop.
+#if defined(TVM_JIT) && defined(TVM_COMPUTED_GOTO)
+#define TVM_TRACE 1
+#endif
+
+#ifdef TVM_TRACE
+
+// The threaded engine, except that a loop that has been branched to
+// often enough is recorded and compiled, and from then on a branch
+// to it runs the compiled trace. See Tracer.
+class TraceEngine : public ThreadedEngine
+{
+private:
+    Tracer*    m_tracer;
+    JitRuntime m_runtime;
+    Program*   m_program;
+
+    void prepareRuntime(Program& prog);
+    void enterTrace(Program& prog, uint64_t addr);
+    void record(Program& prog);
+
+    static void traceExecute(JitRuntime* rt, const ExecInstruction* inst);
+
+public:
+    TraceEngine();
+    ~TraceEngine();
+
+    const char* getName(void) const;
+
+    int  prepare(Program& prog);
+    void execute(Program& prog);
+    void rewind(Program& prog, uint64_t addr);
+    bool runsSource(void) const;
+
+    const Tracer* getTracer(void) const;
+};
+
+#endif  // TVM_TRACE
+
+#endif  //_TraceEngine_h_
@@ -0,0 +1,74 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Verifier.h"
+
+static bool verifyRegisters(const ExecInstruction& ins)
+{
+    if (ins.flags & IF_REG0 && ins.argv[0] >= MAX_REG)
+        return false;
+    if (ins.flags & (IF_REG1 | IF_RIDX) && ins.argv[1] >= MAX_REG)
+        return false;
+    if (ins.flags & IF_REG2 && ins.argv[2] >= MAX_REG)
+        return false;
+
+    // The index operand of ldrs and strs names a register
+    if (ins.op == OP_LDRS || ins.op == OP_STRS)
+        return ins.index < MAX_REG;
+    return true;
+}
+
+bool VerifyInstruction(const ExecInstruction& ins, size_t dataSize)
+{
+    if (!verifyRegisters(ins))
+        return false;
+
+    switch (ins.op)
+    {
+    case OP_DIV:
+        if (ins.argc > 2)
+            return ins.flags & IF_REG2 || ins.argv[2] != 0;
+        return ins.flags & IF_REG1 || ins.argv[1] != 0;
+    case OP_ADRP:
+        return ins.argv[1] < dataSize;
+    case OP_STP:
+    case OP_LDP:
+    case OP_STR:
+    case OP_LDR:
+        if (ins.flags & IF_STKP)
+            return ins.argv[1] / 8 <= MAX_STACK_REL;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool VerifyInstructions(const ExecInstructions& code, size_t dataSize)
+{
+    ExecInstructions::const_iterator it = code.begin();
+    while (it != code.end())
+    {
+        if (!VerifyInstruction(*it++, dataSize))
+            return false;
+    }
+    return true;
+}
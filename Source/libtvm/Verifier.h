@@ -0,0 +1,51 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _Verifier_h_
+#define _Verifier_h_
+
+#include "Declarations.h"
+
+// The largest stack adjustment stp, ldp, str and ldr accept, in
+// slots of eight bytes.
+const uint64_t MAX_STACK_REL = 32;
+
+// Proves, once at load time, the properties the handlers would
+// otherwise test on every execution:
+//
+//  - every register operand is below MAX_REG
+//  - an immediate divisor is not zero
+//  - adrp addresses a location inside the data table
+//  - a stack adjustment is no larger than MAX_STACK_REL slots
+//
+// Tests that depend on run time values, such as a register divisor
+// or the current stack depth, are never removed.
+//
+// Returns true when ins passes. LowerInstructions uses it to give
+// each instruction that passes the handler that skips these tests.
+extern bool VerifyInstruction(const ExecInstruction& ins, size_t dataSize);
+
+// Returns true when every instruction passes. The table engine only
+// has one handler per op code, so it uses the ones that skip the
+// tests when the whole program passes.
+extern bool VerifyInstructions(const ExecInstructions& code, size_t dataSize);
+
+#endif  //_Verifier_h_
@@ -21,39 +21,44 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "SharedLib.h"
 #include "SymbolUtils.h"
 
 #ifdef _WIN32
 #include <fcntl.h>
 #include <io.h>
-#include <string.h>
 #include <windows.h>
 #endif
 
-SYM_API SYM_EXPORT void __putchar(tvmregister_t regi)
+SYM_API SYM_EXPORT void __putchar(tvmcontext_t* ctx)
 {
-    uint8_t ch = prog_get_register8(regi, 0);
+    char ch = (char)prog_get_register8(ctx->regi, 0);
     if (ch)
-        putchar(ch);
+        prog_write(ctx, &ch, 1);
 }
 
-SYM_API SYM_EXPORT void __puts(tvmregister_t regi)
+SYM_API SYM_EXPORT void __puts(tvmcontext_t* ctx)
 {
-    size_t ptr = (size_t)prog_get_register64(regi, 0);
+    size_t ptr = (size_t)prog_get_register64(ctx->regi, 0);
     if (ptr)
-        puts((char*)ptr);
+    {
+        prog_write(ctx, (const char*)ptr, strlen((const char*)ptr));
+        prog_write(ctx, "\n", 1);
+    }
 }
 
-SYM_API SYM_EXPORT void __getchar(tvmregister_t regi)
+SYM_API SYM_EXPORT void __getchar(tvmcontext_t* ctx)
 {
-    prog_set_register8(regi, 0, getchar());
+    // Anything printed before reading is a prompt.
+    prog_flush(ctx);
+    prog_set_register8(ctx->regi, 0, (uint8_t)prog_read(ctx));
 }
 
 const SymbolTable stdlib[] = {
-    {"putchar", __putchar},
-    {"puts", __puts},
-    {"getchar", __getchar},
+    {"putchar", (Symbol)__putchar},
+    {"puts", (Symbol)__puts},
+    {"getchar", (Symbol)__getchar},
     {nullptr, nullptr},
 };
 
@@ -62,7 +67,13 @@ SYM_API SYM_EXPORT SymbolTable* std_init()
     return (SymbolTable*)stdlib;
 }
 
-#ifdef _WIN32
+SYM_API SYM_EXPORT int std_abi()
+{
+    return TVM_ABI_CONTEXT;
+}
+
+// Only used when std is built as its own library.
+#if defined(_WIN32) && !defined(TVM_BUILTIN_STD)
 BOOL WINAPI DllMain(HINSTANCE hInst, DWORD reason, LPVOID)
 {
     switch (reason)
@@ -41,6 +41,7 @@ struct ProgramInfo
     strvec_t files;
     strvec_t modules;
     bool     disableErrorFmt;
+    bool     lazyFlags;
     string   modulePath;
 };
 
@@ -81,6 +82,9 @@ int main(int argc, char **argv)
             case 'd':
                 ctx.disableErrorFmt = true;
                 break;
+            case 'f':
+                ctx.lazyFlags = true;
+                break;
             default:
                 break;
             }
@@ -102,6 +106,9 @@ int main(int argc, char **argv)
     FindModuleDirectory(ctx.modulePath);
 
     BinaryWriter w(ctx.modulePath);
+    if (ctx.lazyFlags)
+        w.setHeaderFlags(HF_LAZY_FLAGS);
+
     for (string file : ctx.files)
     {
         Parser p;
@@ -118,6 +125,7 @@ int main(int argc, char **argv)
             return PS_ERROR;
 
         w.mergeInstructions(p.getInstructions());
+        w.mergeExports(p.getExports());
 
         // This has not been tested on multiple files yet.
         break;
@@ -143,5 +151,6 @@ void usage(void)
     cout << "        -l link library.\n";
     cout << "        -d disable full path when reporting errors.\n";
     cout << "        -m print the module path and exit.\n";
+    cout << "        -f use lazy condition flags, cmp results can be tested more than once.\n";
     cout << "\n";
 }
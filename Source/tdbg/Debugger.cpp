@@ -29,7 +29,7 @@
 
 using namespace std;
 
-const DebugInstruction nop = {0, "nop", {0, 0, 0, {0, 0, 0}, 0, 0}};
+const DebugInstruction nop = {0, "nop", {0, 0, 0, {0, 0, 0}, 0, 0, nullptr}};
 
 Debugger::Debugger(const str_t& mod, const str_t& file) :
     Program(mod),
@@ -40,6 +40,10 @@ Debugger::Debugger(const str_t& mod, const str_t& file) :
     m_baseAddr(0),
     m_maxInstWidth(0)
 {
+    // The console shows the output after each step, and each step
+    // is taken from the source instructions the table engine keeps.
+    setBuffered(false);
+    setEngine("table");
     initialize();
 }
 
@@ -69,8 +73,6 @@ int Debugger::debug(void)
     constructDebugInfo();
     calculateDisplayRects();
 
-    m_dataTable.cloneInto(m_dataTableCpy);
-
     int cmd = CCS_NO_INPUT;
 
 top:
@@ -127,9 +129,9 @@ top:
 
 void Debugger::constructDebugInfo()
 {
-    m_debugInfo.reserve(m_ins.size());
+    m_debugInfo.reserve(m_image->ins.size());
 
-    ExecInstructions::iterator it = m_ins.begin(), end = m_ins.end();
+    ExecInstructions::iterator it = m_image->ins.begin(), end = m_image->ins.end();
     while (it != end)
     {
         const ExecInstruction& exec = (*it++);
@@ -140,7 +142,7 @@ void Debugger::constructDebugInfo()
         m_debugInfo.push_back(dbg);
     }
 
-    m_ins.clear();
+    m_image->ins.clear();
 }
 
 void Debugger::calculateDisplayRects(void)
@@ -253,13 +255,13 @@ void Debugger::stepOneInstruction(void)
         bool switchOutput = false;
 
         const DebugInstruction& dbg = m_debugInfo.at((size_t)m_curinst++);
-        if (OPCodeTable[dbg.inst.op] != nullptr)
+        if (dbg.inst.op > OP_BEG && dbg.inst.op < OP_MAX)
         {
             switchOutput = (dbg.inst.op == OP_GTO && dbg.inst.call) || (dbg.inst.op >= OP_PRG);
             if (switchOutput)
                 m_console->switchOutput(true);
 
-            (this->*OPCodeTable[dbg.inst.op])(dbg.inst);
+            step(dbg.inst);
 
             if (switchOutput)
                 m_console->switchOutput(false);
@@ -356,12 +358,14 @@ void Debugger::displayRegisters(void)
         value.str("");
     }
 
+    const uint32_t flags = getFlags();
+
     regi << "flags: [";
-    if (m_flags & PF_Z)
+    if (flags & PF_Z)
         regi << ' ' << 'Z';
-    if (m_flags & PF_G)
+    if (flags & PF_G)
         regi << ' ' << 'G';
-    if (m_flags & PF_L)
+    if (flags & PF_L)
         regi << ' ' << 'L';
     regi << ' ' << ']';
 
@@ -503,20 +507,11 @@ void Debugger::clearState(void)
 {
     m_console->clearOutput();
 
-    m_callStack.resize(0);
-    m_stack.resize(0);
-
-    memset(m_regi, 0, sizeof(Registers));
+    reset();
     memset(m_last, 0, sizeof(Registers));
 
     m_baseAddr = 0;
     m_lastAddr = -1;
-
-    m_dataTableCpy.cloneInto(m_dataTable);
-
-    m_flags   = 0;
-    m_curinst = m_startinst;
-    m_exit    = false;
 }
 
 void Debugger::disassemble(const DebugInstruction& inst, size_t i, int16_t y)
@@ -38,7 +38,6 @@ private:
     Registers         m_last;
     size_t            m_lastAddr;
     size_t            m_baseAddr;
-    MemoryStream      m_dataTableCpy;
     DebugInstructions m_debugInfo;
     int16_t           m_maxInstWidth;
 
@@ -20,25 +20,51 @@
 -------------------------------------------------------------------------------
 */
 #include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include "Batch.h"
+#include "ForkServer.h"
+#include "Jit.h"
 #include "Program.h"
+#include "Server.h"
 #include "SymbolUtils.h"
+#include "Trace.h"
 
-using namespace std;
 
-void usage(void);
+using namespace std;
 
 struct ProgramInfo
 {
-    bool   time;
-    string file;
-    string modulePath;
+    bool     time;
+    bool     stats;
+    bool     lazy;
+    bool     unbuffered;
+    bool     noCache;
+    string   file;
+    string   snapshotAt;
+    string   outputFile;
+    string   restoreFile;
+    string   control;
+    string   socket;
+    string   manifest;
+    string   modulePath;
+    strvec_t engines;
+    uint32_t regmask;
+    Register regi[MAX_REG];
 };
 
+void usage(void);
+int  run(const ProgramInfo &ctx, const string &engine);
+int  start(Program &prog, const ProgramInfo &ctx);
+int  serve(const ProgramInfo &ctx);
+bool runRemote(const ProgramInfo &ctx, const string &engine, int &rc);
+void displayStats(const Program &prog);
+void displayTraceStats(const Program &prog);
+
 int main(int argc, char **argv)
 {
     if (argc <= 1)
@@ -59,6 +85,65 @@ int main(int argc, char **argv)
             char ch = argv[i][1];
             if (ch == 't')
                 ctx.time = true;
+            else if (ch == 's')
+                ctx.stats = true;
+            else if (ch == 'l')
+                ctx.lazy = true;
+            else if (ch == 'u')
+                ctx.unbuffered = true;
+            else if (ch == 'n')
+                ctx.noCache = true;
+            else if (ch == 'a')
+            {
+                if (i + 1 < argc)
+                    ctx.snapshotAt = argv[++i];
+            }
+            else if (ch == 'o')
+            {
+                if (i + 1 < argc)
+                    ctx.outputFile = argv[++i];
+            }
+            else if (ch == 'f')
+            {
+                if (i + 1 < argc)
+                    ctx.control = argv[++i];
+            }
+            else if (ch == 'r')
+            {
+                if (i + 1 < argc)
+                    ctx.restoreFile = argv[++i];
+            }
+            else if (ch == 'b')
+            {
+                if (i + 1 < argc)
+                    ctx.manifest = argv[++i];
+            }
+            else if (ch == 'd')
+            {
+                if (i + 1 < argc)
+                    ctx.socket = argv[++i];
+            }
+            else if (ch == 'x')
+            {
+                // -x <register>=<value>
+                char *end = nullptr;
+                if (i + 1 < argc)
+                {
+                    unsigned long reg = strtoul(argv[++i], &end, 10);
+                    if (*end != '=' || reg >= MAX_REG)
+                    {
+                        cout << "invalid register assignment '" << argv[i] << "'\n";
+                        return 1;
+                    }
+                    ctx.regi[reg].x = strtoull(end + 1, nullptr, 0);
+                    ctx.regmask |= 1u << reg;
+                }
+            }
+            else if (ch == 'e')
+            {
+                if (i + 1 < argc)
+                    ctx.engines.push_back(argv[++i]);
+            }
             else if (ch == 'm')
             {
                 DisplayModulePath();
@@ -72,6 +157,23 @@ int main(int argc, char **argv)
         }
     }
 
+#ifndef TVM_CLIENT
+    if (!ctx.socket.empty())
+    {
+        FindModuleDirectory(ctx.modulePath);
+        return serve(ctx);
+    }
+#endif
+
+    if (!ctx.manifest.empty())
+    {
+        FindModuleDirectory(ctx.modulePath);
+
+        string results = ctx.outputFile.empty() ? ctx.manifest + ".results" : ctx.outputFile;
+        string engine  = ctx.engines.empty() ? "" : ctx.engines[0];
+        return RunBatch(ctx.manifest, results, ctx.modulePath, engine, ctx.lazy, 0) == PS_OK ? 0 : 1;
+    }
+
     if (ctx.file.empty())
     {
         usage();
@@ -81,28 +183,281 @@ int main(int argc, char **argv)
 
     FindModuleDirectory(ctx.modulePath);
 
+    if (!ctx.snapshotAt.empty() && ctx.outputFile.empty())
+        ctx.outputFile = ctx.file + ".tvms";
+
+    if (ctx.engines.empty())
+        return run(ctx, "");
+
+    // 'all' expands to every engine that is part of this build
+    strvec_t engines;
+    for (const string &name : ctx.engines)
+    {
+        if (name != "all")
+            engines.push_back(name);
+        else
+        {
+            for (size_t e = 0; e < GetEngineCount(); ++e)
+            {
+                if (GetEngineInfo(e).create)
+                    engines.push_back(GetEngineInfo(e).name);
+            }
+        }
+    }
+
+    // Each engine gets a freshly loaded program, the
+    // result is the first one that was not zero.
+    int rc = 0;
+    for (const string &name : engines)
+    {
+        int erc = run(ctx, name);
+        if (rc == 0)
+            rc = erc;
+    }
+    return rc;
+}
+
+int run(const ProgramInfo &ctx, const string &engine)
+{
+#ifdef TVM_CLIENT
+    int remote = 0;
+    if (runRemote(ctx, engine, remote))
+        return remote;
+#endif
+
     Program prog(ctx.modulePath);
+    if (!engine.empty())
+    {
+        if (prog.setEngine(engine) != PS_OK)
+            return 1;
+    }
+
+    prog.setLazyBinding(ctx.lazy);
+    prog.setBuffered(!ctx.unbuffered);
+    prog.setImageCache(!ctx.noCache);
     if (prog.load(ctx.file.c_str()) != PS_OK)
         return 1;
 
+    if (ctx.stats)
+        displayStats(prog);
+
+    for (uint8_t r = 0; r < MAX_REG; ++r)
+    {
+        if (ctx.regmask & (1u << r))
+            prog.setRegister(r, ctx.regi[r].x);
+    }
+
+    if (!ctx.snapshotAt.empty())
+    {
+        // An exported label, or an instruction index
+        uint64_t addr = prog.findExport(ctx.snapshotAt);
+        if (addr == (uint64_t)-1)
+        {
+            char *end = nullptr;
+            addr      = strtoull(ctx.snapshotAt.c_str(), &end, 10);
+            if (end == ctx.snapshotAt.c_str() || *end != 0)
+            {
+                cout << "the label '" << ctx.snapshotAt << "' was not exported with .global\n";
+                return 1;
+            }
+        }
+
+        if (prog.runTo(addr) != PS_OK || prog.saveState(ctx.outputFile) != PS_OK)
+            return 1;
+    }
+
+    if (!ctx.control.empty())
+    {
+        // Every run forks from the state the program is in now.
+        bool resume = !ctx.snapshotAt.empty() || !ctx.restoreFile.empty();
+        if (!ctx.restoreFile.empty() && prog.restoreState(ctx.restoreFile) != PS_OK)
+            return 1;
+        return RunForkServer(prog, ctx.control, resume) == PS_OK ? 0 : 1;
+    }
+
     int rc = 0;
     if (ctx.time)
     {
+        cout << "engine: " << prog.getEngineName() << endl;
         _TIME_CHECK_BEGIN
-        rc = prog.launch();
+        rc = start(prog, ctx);
         _TIME_CHECK_END;
     }
     else
-        rc = prog.launch();
+        rc = start(prog, ctx);
+
+    if (ctx.stats)
+        displayTraceStats(prog);
     return rc;
 }
 
+int start(Program &prog, const ProgramInfo &ctx)
+{
+    if (!ctx.snapshotAt.empty())
+        return prog.resume();
+
+    if (!ctx.restoreFile.empty())
+    {
+        if (prog.restoreState(ctx.restoreFile) != PS_OK)
+            return 1;
+        return prog.resume();
+    }
+    return prog.launch();
+}
+
+int serve(const ProgramInfo &ctx)
+{
+    Server server(ctx.modulePath, 0, 64);
+    server.setImageCache(!ctx.noCache);
+    if (server.open(ctx.socket) != PS_OK)
+        return 1;
+
+    cout << "listening on " << ctx.socket << endl;
+    server.serve();
+    return 0;
+}
+
+bool runRemote(const ProgramInfo &ctx, const string &engine, int &rc)
+{
+#ifndef _WIN32
+    // Anything the server does not do is run here.
+    if (ctx.stats || !ctx.snapshotAt.empty() || !ctx.restoreFile.empty() || !ctx.control.empty())
+        return false;
+
+    char *path = realpath(ctx.file.c_str(), nullptr);
+    if (!path)
+        return false;
+
+    ServerRequest req = {};
+    req.path          = path;
+    req.engine        = engine;
+    req.lazy          = ctx.lazy;
+    req.stream        = true;  // stdin is read as the program asks for it
+    req.regmask       = ctx.regmask;
+    memcpy(req.regi, ctx.regi, sizeof(Registers));
+    free(path);
+
+    int fd = ConnectServer(ctx.socket.empty() ? GetServerPath() : ctx.socket);
+    if (fd == -1)
+        return false;
+
+    ServerResponse resp = {};
+    if (SendRequest(fd, req, resp) != PS_OK)
+    {
+        rc = 1;
+        return true;
+    }
+
+    if (ctx.time && resp.status == PS_OK)
+        cout << "engine: " << resp.engine << endl;
+
+    fwrite(resp.output.data(), 1, resp.output.size(), stdout);
+    fflush(stdout);
+
+    if (resp.status != PS_OK)
+    {
+        rc = 1;
+        return true;
+    }
+
+    if (ctx.time)
+        cout << "run exec(" << fixed << setprecision(6) << (double)resp.runTime * 1e-9 << "s)" << endl;
+    rc = resp.exitCode;
+    return true;
+#else
+    return false;
+#endif
+}
+
 void usage(void)
 {
+#ifdef TVM_CLIENT
+    cout << "tvmclient <options> <program_path>\n\n";
+#else
     cout << "tvm <options> <program_path>\n\n";
+#endif
     cout << "    options:\n\n";
     cout << "        -h display this message.\n";
-    cout << "        -t display execution time.\n";
+    cout << "        -t display execution time and the engine used.\n";
+    cout << "        -e <name> select the execution engine. It can be given more than\n";
+    cout << "           once to run the program with each engine in turn, 'all'\n";
+    cout << "           selects every engine in this build.\n";
+    for (size_t i = 0; i < GetEngineCount(); ++i)
+    {
+        const EngineInfo &info = GetEngineInfo(i);
+        cout << "           " << left << setw(9) << info.name << right;
+        cout << info.description;
+        if (!info.create)
+            cout << " (not available)";
+        cout << '\n';
+    }
+    cout << "        -s display load and trace statistics.\n";
+    cout << "        -l open modules and bind host calls when they are first called.\n";
+    cout << "        -u write the program's output as soon as it is printed.\n";
+    cout << "        -n do not read or write the decoded image cache.\n";
+    cout << "        -a <label> run to an exported label, or an instruction index,\n";
+    cout << "           write a snapshot of the machine state and continue.\n";
+    cout << "        -o <file> the snapshot written by -a, <program_path>.tvms by default,\n";
+    cout << "           or the results written by -b, <manifest>.results by default.\n";
+    cout << "        -r <file> continue from a snapshot written by -a.\n";
+    cout << "        -x <register>=<value> set x(register) before main is launched.\n";
+#ifdef TVM_CLIENT
+    cout << "        -d <socket> the server's socket, $TVM_SOCKET, $XDG_RUNTIME_DIR/toyvm.sock\n";
+    cout << "           or /tmp/toyvm-<uid>.sock by default. The program runs here when no\n";
+    cout << "           server is listening, or with -s, -a, -r and -f.\n";
+#else
+    cout << "        -d <socket> serve requests from tvmclient on a UNIX socket.\n";
+#endif
+    cout << "        -b <manifest> run each '<image> <input> <output> [<register>=<value> ...]'\n";
+    cout << "           line of manifest on a thread per core and write the exit code\n";
+    cout << "           and run time of each to the results.\n";
+    cout << "        -f <control> load once and fork a run for each '<input> [<output>]'\n";
+    cout << "           line read from control, '-' for stdin. The exit code of each\n";
+    cout << "           run is written to stdout.\n";
     cout << "        -m print the module path and exit.\n";
     cout << "\n";
 }
+
+void displayStats(const Program &prog)
+{
+    const MemoryFootprint &mf = prog.getFootprint();
+
+    cout << "instructions:       " << mf.instructions << '\n';
+    cout << "source bytes:       " << mf.source << '\n';
+    cout << "packed bytes:       " << mf.packed << '\n';
+    cout << "data bytes:         " << mf.data << '\n';
+    cout << "string bytes:       " << mf.strings << '\n';
+    cout << "verified:           " << (prog.isVerified() ? "yes" : "no") << '\n';
+    cout << "verified handlers:  " << prog.getVerifiedCount() << '\n';
+    cout << "from cache:         " << (prog.isCached() ? "yes" : "no") << '\n';
+
+    const FusionStats &fs = prog.getFusionStats();
+
+    cout << "fused cmp, b*:      " << fs.compareBranch << '\n';
+    cout << "fused inc, cmp, b*: " << fs.incCompareBranch << '\n';
+    cout << "fused mov, bl:      " << fs.moveCall << '\n';
+
+    const JitCompiler *jit = prog.getJit();
+    if (jit)
+    {
+        const JitStats &js = jit->getStats();
+
+        cout << "jit functions:      " << js.compiled << '/' << js.functions << '\n';
+        cout << "jit code bytes:     " << js.codeSize << '\n';
+    }
+}
+
+void displayTraceStats(const Program &prog)
+{
+    const Tracer *tracer = prog.getTracer();
+    if (tracer)
+    {
+        const TraceStats &ts = tracer->getStats();
+
+        cout << "traces recorded:    " << ts.recorded << '\n';
+        cout << "traces compiled:    " << ts.compiled << '\n';
+        cout << "traces aborted:     " << ts.aborted << '\n';
+        cout << "traces entered:     " << ts.entered << '\n';
+        cout << "trace code bytes:   " << ts.codeSize << '\n';
+    }
+}
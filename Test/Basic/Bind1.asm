@@ -0,0 +1,34 @@
+; -------------------------------------
+                .data
+; -------------------------------------
+bindmsg: .asciz "bound"
+; -------------------------------------
+                .text
+; -------------------------------------
+printrow:
+    mov     x3, 'a'
+rowloop:
+    cmp     x3, 'e'
+    bgt     rowdone
+    mov     x0, x3
+    bl      putchar
+    inc     x3
+    b       rowloop
+rowdone:
+    mov     x0, 10
+    bl      putchar
+    ret
+
+main:
+    mov     x4, 0
+mainloop:
+    cmp     x4, 3
+    bge     maindone
+    bl      printrow
+    inc     x4
+    b       mainloop
+maindone:
+    adrp    x0, bindmsg
+    bl      puts
+    mov     x0, 0
+    ret
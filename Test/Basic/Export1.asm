@@ -0,0 +1,36 @@
+; ----------------------------------------------------
+; square, sum3 and callsq are exported and called
+; directly by the Embed1 test in Test/Embed.cpp.
+; ----------------------------------------------------
+    .global square
+    .global sum3
+    .global callsq
+; ----------------------------------------------------
+main:
+    mov     x0, 7
+    bl      square
+    prg     x0
+    mov     x1, 20
+    mov     x2, 300
+    bl      sum3
+    prg     x0
+    bl      tail
+    prg     x0
+    mov     x0, 0
+    ret
+
+square:
+    mul     x0, x0, x0
+    ret
+
+sum3:
+    add     x0, x1
+    add     x0, x2
+    ret
+
+; callsq is entered between the mov and the bl
+tail:
+    mov     x0, 3
+callsq:
+    bl      square
+    ret
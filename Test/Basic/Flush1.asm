@@ -0,0 +1,30 @@
+; ----------------------------------------------------
+; prg and the std module write into the same buffer,
+; so their output has to come out in the order it was
+; written. The last line has no new line and is only
+; written when the buffer is flushed on exit.
+; ----------------------------------------------------
+                    .data
+; ----------------------------------------------------
+msg:    .asciz  "puts"
+; ----------------------------------------------------
+                    .text
+; ----------------------------------------------------
+main:
+    mov     x2, 0
+loop:
+    prg     x2
+    mov     x0, 'a'
+    add     x0, x2
+    bl      putchar
+    mov     x0, 10
+    bl      putchar
+    adrp    x0, msg
+    bl      puts
+    inc     x2
+    cmp     x2, 3
+    blt     loop
+    mov     x0, '!'
+    bl      putchar
+    mov     x0, 0
+    ret
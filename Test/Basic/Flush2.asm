@@ -0,0 +1,25 @@
+; ----------------------------------------------------
+; The divide by zero message is written through stdio,
+; after everything the program printed before it, and
+; prg 3 never runs. launch then reports the failure.
+; RunError.cmake adds the last line, since tvm exits
+; with an error.
+; ----------------------------------------------------
+                    .data
+; ----------------------------------------------------
+msg:    .asciz  "before the error"
+; ----------------------------------------------------
+                    .text
+; ----------------------------------------------------
+main:
+    prg     1
+    mov     x0, 'a'
+    bl      putchar
+    adrp    x0, msg
+    bl      puts
+    prg     2
+    mov     x1, 0
+    div     x0, x1
+    prg     3
+    mov     x0, 0
+    ret
@@ -0,0 +1,27 @@
+; -------------------------------------
+                .data
+; -------------------------------------
+formatmsg: .asciz "version one"
+; -------------------------------------
+                .text
+; -------------------------------------
+widen:
+    stp     sp, 16
+    str     x1, [sp, 0]
+    mov     x2, 0x123456789A
+    add     x1, x2
+    ldr     x3, [sp, 0]
+    add     x1, x3
+    ldp     sp, 16
+    ret
+
+main:
+    mov     x1, 300
+    bl      widen
+    prg     x1
+    mov     x4, 70000
+    prg     x4
+    adrp    x0, formatmsg
+    bl      puts
+    mov     x0, 0
+    ret
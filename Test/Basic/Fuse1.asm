@@ -0,0 +1,26 @@
+main:
+    mov x0, 0
+    cmp x0, 1
+    b   mid
+top:
+    cmp x0, 3
+mid:
+    blt next
+    b   done
+next:
+    inc x0
+    prg x0
+    b   top
+done:
+    mov x2, 5
+    cmp x2, 7
+    beq never
+    blt less
+never:
+    prg 0
+    mov x0, 1
+    ret
+less:
+    prg 7
+    mov x0, 0
+    ret
@@ -0,0 +1,83 @@
+; -------------------------------------
+                .text
+; -------------------------------------
+classify:
+    cmp     x1, 10
+    blt     clow
+    beq     cequ
+    bgt     chigh
+    mov     x2, 99
+    ret
+clow:
+    mov     x2, 1
+    ret
+cequ:
+    mov     x2, 2
+    ret
+chigh:
+    mov     x2, 3
+    ret
+
+retest:
+    cmp     x1, 100
+    bge     rtge
+    add     x6, 1
+    ret
+rtge:
+    bge     rtagain
+    add     x6, 1000
+rtagain:
+    add     x6, 2
+    ret
+
+main:
+    mov     x0, 0
+    mov     x4, 0
+clsloop:
+    mov     x1, x0
+    bl      classify
+    add     x4, x2
+    inc     x0
+    cmp     x0, 200
+    blt     clsloop
+    prg     x4
+
+    mov     x0, 0
+    mov     x6, 0
+rtloop:
+    mov     x1, x0
+    bl      retest
+    inc     x0
+    cmp     x0, 300
+    bne     rtloop
+    prg     x6
+
+    mov     x0, 0
+    mov     x6, 0
+sameloop:
+    cmp     x0, 100
+    bge     samege
+    add     x6, 1
+    b       samenext
+samege:
+    bge     sametwice
+    add     x6, 1000
+sametwice:
+    add     x6, 2
+samenext:
+    inc     x0
+    cmp     x0, 300
+    blt     sameloop
+    prg     x6
+
+    mov     x7, 1
+    shl     x7, 63
+    mov     x8, 0
+    cmp     x7, 1
+    blt     minlt
+    mov     x8, 5
+minlt:
+    add     x8, 1
+    prg     x8
+    mov     x0, 0
+    ret
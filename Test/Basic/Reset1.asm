@@ -0,0 +1,26 @@
+; ----------------------------------------------------
+; The data table is larger than a page. The matrix
+; launches it again after a reset, which has to put
+; the counter back to zero.
+; ----------------------------------------------------
+                    .data
+; ----------------------------------------------------
+pad:    .zero   8192
+count:  .zero   8
+; ----------------------------------------------------
+                    .text
+; ----------------------------------------------------
+main:
+    adrp    x1, count
+    ldrs    x2, [x1, 0]
+    inc     x2
+    strs    x2, [x1, 0]
+    ldrs    x3, [x1, 0]
+    prg     x3
+    adrp    x4, pad
+    mov     x5, 4000
+    strs    x2, [x4, x5]
+    ldrs    x6, [x4, x5]
+    prg     x6
+    mov     x0, 0
+    ret
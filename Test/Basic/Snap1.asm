@@ -0,0 +1,52 @@
+; ----------------------------------------------------
+; checkpoint is exported so the Snapshot1 test in
+; Test/Snapshot.cpp can save the state inside work,
+; with data table addresses in x1, x4 and on the
+; stack. The data table is larger than a page.
+; ----------------------------------------------------
+    .global checkpoint
+; ----------------------------------------------------
+                    .data
+; ----------------------------------------------------
+pad:    .zero   8192
+count:  .zero   8
+; ----------------------------------------------------
+                    .text
+; ----------------------------------------------------
+main:
+    mov     x2, 0
+    bl      work
+    prg     x0
+    adrp    x1, count
+    mov     x3, 0
+    ldrs    x2, [x1, x3]
+    prg     x2
+    mov     x0, 0
+    ret
+
+work:
+    stp     sp, 16
+    adrp    x1, count
+    adrp    x4, pad
+    mov     x5, 6000
+    mov     x8, 0
+    mov     x3, 42
+    str     x3, [sp, 0]
+    str     x4, [sp, 8]
+loop:
+    inc     x2
+    strs    x2, [x1, x8]
+    cmp     x2, 5
+    blt     loop
+checkpoint:
+    inc     x2
+    strs    x2, [x1, x8]
+    strs    x2, [x4, x5]
+    cmp     x2, 10
+    blt     checkpoint
+    ldr     x7, [sp, 8]
+    ldrs    x6, [x7, x5]
+    ldr     x3, [sp, 0]
+    add     x0, x3, x6
+    ldp     sp, 16
+    ret
@@ -0,0 +1,49 @@
+; -------------------------------------
+                .text
+; -------------------------------------
+clamp:
+    cmp     x1, 50
+    blt     clampd
+    mov     x1, 50
+clampd:
+    ret
+
+toggle:
+    cmp     x7, 0
+    beq     tset
+    mov     x7, 0
+    add     x8, 2
+    ret
+tset:
+    mov     x7, 1
+    add     x8, 1
+    ret
+
+main:
+    mov     x0, 0
+    mov     x2, 0
+    mov     x3, 0
+    mov     x5, 0
+    mov     x6, 1
+    shl     x6, 32
+    mov     x7, 0
+    mov     x8, 0
+loop:
+    mov     x1, x0
+    bl      clamp
+    add     x2, x2, x1
+    div     x4, x0, 3
+    add     x3, x4
+    mov     b5, x0
+    mov     l6, x0
+    bl      toggle
+    inc     x0
+    cmp     x0, 200
+    blt     loop
+    prg     x2
+    prg     x3
+    prg     x5
+    prg     x6
+    prg     x8
+    mov     x0, 0
+    ret
@@ -0,0 +1,28 @@
+; -------------------------------------
+                .text
+; -------------------------------------
+; The divide by zero below is never executed, but it keeps
+; the file from being verified, so the checked handlers run.
+never:
+    div     x1, 0
+    ret
+
+main:
+    mov     x0, 7
+    mov     x1, 100
+    stp     sp, 16
+    str     x0, [sp, 0]
+    str     x1, [sp, 8]
+    ldr     x2, [sp, 0]
+    ldr     x3, [sp, 8]
+    ldp     sp, 16
+    div     x3, x2
+    prg     x3
+    div     x4, x1, 5
+    prg     x4
+    cmp     x0, 0
+    bne     skipnever
+    bl      never
+skipnever:
+    mov     x0, 0
+    ret
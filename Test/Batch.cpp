@@ -0,0 +1,86 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include "Batch.h"
+#include "Catch2.h"
+#include "SymbolUtils.h"
+
+TEST_CASE("Batch1")
+{
+    const std::string dir      = std::string(TestBinaryDirectory) + "/";
+    const std::string manifest = dir + "Batch1.jobs";
+    const std::string results  = dir + "Batch1.results";
+
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    {
+        std::ofstream jobs(manifest);
+        jobs << "# image input output registers\n";
+
+        int i;
+        for (i = 0; i < 8; ++i)
+            jobs << dir << "Snap1 - " << dir << "Batch1." << i << ".out 0=" << i << "\n";
+        jobs << "\n"
+             << dir << "Export1 - - 1=0x10\n";
+    }
+
+    EXPECT_EQ(RunBatch(manifest, results, modpath, "", false, 3), PS_OK);
+
+    std::ifstream in(results);
+    std::string   text;
+
+    int lines = 0;
+    while (std::getline(in, text))
+    {
+        int  line = 0, rc = -1;
+        char path[256];
+        EXPECT_EQ(sscanf(text.c_str(), "%d %d %*f %255s", &line, &rc, path), 3);
+        EXPECT_EQ(rc, 0);
+        EXPECT_EQ(line, lines < 8 ? lines + 2 : 11);
+        ++lines;
+    }
+    EXPECT_EQ(lines, 9);
+
+    int i;
+    for (i = 0; i < 8; ++i)
+    {
+        std::ifstream     out(dir + "Batch1." + std::to_string(i) + ".out");
+        std::stringstream ss;
+        ss << out.rdbuf();
+        EXPECT_EQ(ss.str(), "52\n10\n");
+    }
+
+    // A job that cannot be loaded is reported in the results.
+    std::ofstream(manifest) << dir << "missing - -\n";
+    EXPECT_EQ(RunBatch(manifest, results, modpath, "", false, 0), PS_ERROR);
+
+    std::ifstream failed(results);
+    std::getline(failed, text);
+    EXPECT_EQ(text, "1 error 0 " + dir + "missing");
+
+    // A malformed job stops the batch before anything runs.
+    std::ofstream(manifest) << dir << "Snap1 -\n";
+    EXPECT_EQ(RunBatch(manifest, results, modpath, "", false, 0), PS_ERROR);
+}
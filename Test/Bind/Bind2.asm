@@ -0,0 +1,17 @@
+; ----------------------------------------------------
+; Compiled by the Bind2 test in Test/Binding.cpp
+; against the two modules it registers. The string
+; table holds the names in the order they are first
+; used, which is not the order they are exported in.
+; Each call appends a digit to x0, so the result
+; shows which function every call was bound to.
+; ----------------------------------------------------
+                .text
+; ----------------------------------------------------
+main:
+    mov     x0, 0
+    bl      four
+    bl      two
+    bl      one
+    bl      two
+    ret
@@ -0,0 +1,175 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Catch2.h"
+#include "BinaryWriter.h"
+#include "Builtin.h"
+#include "Parser.h"
+#include "Program.h"
+
+const std::string BindSource = std::string(TestDirectory) + "/Bind/Bind2.asm";
+const std::string BindFile   = std::string(TestBinaryDirectory) + "/Bind2";
+
+static void appendDigit(tvmcontext_t* ctx, uint64_t digit)
+{
+    prog_set_register64(ctx->regi, 0, prog_get_register64(ctx->regi, 0) * 10 + digit);
+}
+
+static void one(tvmcontext_t* ctx)
+{
+    appendDigit(ctx, 1);
+}
+
+static void two(tvmcontext_t* ctx)
+{
+    appendDigit(ctx, 2);
+}
+
+static void three(tvmcontext_t* ctx)
+{
+    appendDigit(ctx, 3);
+}
+
+static void four(tvmcontext_t* ctx)
+{
+    appendDigit(ctx, 4);
+}
+
+static void five(tvmcontext_t* ctx)
+{
+    appendDigit(ctx, 5);
+}
+
+static const SymbolTable BindOne[] = {
+    {"one", (Symbol)one},
+    {"two", (Symbol)two},
+    {"three", (Symbol)three},
+    {nullptr, nullptr},
+};
+
+// BindOne without two.
+static const SymbolTable BindOneMissing[] = {
+    {"three", (Symbol)three},
+    {"one", (Symbol)one},
+    {nullptr, nullptr},
+};
+
+static const SymbolTable BindTwo[] = {
+    {"five", (Symbol)five},
+    {"four", (Symbol)four},
+    {nullptr, nullptr},
+};
+
+static SymbolTable* BindOneInit()
+{
+    return (SymbolTable*)BindOne;
+}
+
+static SymbolTable* BindOneMissingInit()
+{
+    return (SymbolTable*)BindOneMissing;
+}
+
+static SymbolTable* BindTwoInit()
+{
+    return (SymbolTable*)BindTwo;
+}
+
+static int BindAbi()
+{
+    return TVM_ABI_CONTEXT;
+}
+
+static int CompileBind2(void)
+{
+    Parser p;
+    if (p.parse(BindSource.c_str()) != PS_OK)
+        return PS_ERROR;
+
+    strvec_t     modules = {"bindone", "bindtwo"};
+    BinaryWriter w("");
+    if (w.mergeLabels(p.getLabels()) != PS_OK ||
+        w.mergeDataDeclarations(p.getDataDeclarations()) != PS_OK)
+        return PS_ERROR;
+
+    w.mergeInstructions(p.getInstructions());
+    w.mergeExports(p.getExports());
+
+    if (w.resolve(modules) != PS_OK ||
+        w.open(BindFile.c_str()) != PS_OK ||
+        w.writeHeader() != PS_OK ||
+        w.writeSections() != PS_OK)
+        return PS_ERROR;
+    return PS_OK;
+}
+
+static str_t ReadOutput(FILE* fp)
+{
+    char   buf[256];
+    size_t br = 0;
+    if (fseek(fp, 0, SEEK_SET) == 0)
+        br = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    return str_t(buf, br);
+}
+
+TEST_CASE("Bind2")
+{
+    RegisterBuiltinModule({"bindone", BindOneInit, BindAbi});
+    RegisterBuiltinModule({"bindtwo", BindTwoInit, BindAbi});
+    EXPECT_EQ(CompileBind2(), PS_OK);
+
+    // Each call is bound by its string table index, whatever
+    // position the name has in its module's table.
+    int i;
+    for (i = 0; i < 2; ++i)
+    {
+        Program prog("");
+        prog.setLazyBinding(i == 1);
+        EXPECT_EQ(prog.load(BindFile.c_str()), PS_OK);
+        EXPECT_EQ(prog.launch(), 4212);
+    }
+
+    // The image now uses a symbol that nothing exports.
+    RegisterBuiltinModule({"bindone", BindOneMissingInit, BindAbi});
+    {
+        Program prog("");
+        FILE*   fp = tmpfile();
+        prog.setOutput(fp);
+        EXPECT_EQ(prog.load(BindFile.c_str()), PS_ERROR);
+        fclose(fp);
+    }
+
+    // Lazily, the calls before it still run and the
+    // error is reported when it is first called.
+    {
+        Program prog("");
+        FILE*   fp = tmpfile();
+        prog.setOutput(fp);
+        prog.setLazyBinding(true);
+        EXPECT_EQ(prog.load(BindFile.c_str()), PS_OK);
+        EXPECT_EQ(prog.launch(), -1);
+        EXPECT_EQ(prog.getRegisters()[0].x, 4);
+        EXPECT_EQ(ReadOutput(fp), "failed to locate the symbol 'two'\nan error occurred\n");
+    }
+
+    RegisterBuiltinModule({"bindone", BindOneInit, BindAbi});
+}
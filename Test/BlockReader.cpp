@@ -90,3 +90,39 @@ TEST_CASE("BlockReader2")
 
     EXPECT_EQ(r.tell(), r.size());
 }
+
+TEST_CASE("BlockReader3")
+{
+    // Large enough to be mapped where mmap is available
+    const char*  name = "BlockReader3.tmp";
+    const size_t size = 3 * 4096 + 17;
+
+    FILE* fp = fopen(name, "wb");
+    EXPECT_TRUE(fp != nullptr);
+
+    size_t i;
+    for (i = 0; i < size; ++i)
+        fputc('a' + (int)(i % 26), fp);
+    fclose(fp);
+
+    BlockReader r;
+    r.open(name);
+    EXPECT_EQ(r.size(), size);
+    EXPECT_EQ(r.ptr()[size], 0);
+
+    for (i = 0; i < size && !r.eof(); ++i)
+        EXPECT_EQ(r.next(), 'a' + (int)(i % 26));
+    EXPECT_TRUE(r.eof());
+
+    r.offset(-(int64_t)size - 10);
+    EXPECT_EQ(r.tell(), 0);
+    r.offset((int64_t)size + 10);
+    EXPECT_EQ(r.tell(), size - 1);
+
+    // Opening again starts at the front of the new file
+    r.open(KeywordsFile.c_str());
+    EXPECT_EQ(r.tell(), 0);
+    EXPECT_FALSE(r.eof());
+
+    remove(name);
+}
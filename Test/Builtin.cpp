@@ -0,0 +1,88 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Catch2.h"
+#include "Builtin.h"
+#include "Program.h"
+
+#ifdef TVM_BUILTIN_STD
+
+// Compiled from Basic/TestPutChar.asm by the test build
+const std::string PutCharFile = std::string(TestBinaryDirectory) + "/TestPutChar";
+
+// Nothing is ever written here, so no module can be loaded from it.
+const std::string EmptyModulePath = std::string(TestBinaryDirectory) + "/Builtin1.d";
+
+static BuiltinModule StdModule = {};
+static int           InitCount = 0;
+
+static SymbolTable* CountedInit()
+{
+    ++InitCount;
+    return StdModule.init();
+}
+
+static str_t RunPutChar(bool lazy)
+{
+    Program prog(EmptyModulePath);
+    prog.setLazyBinding(lazy);
+
+    FILE* fp = tmpfile();
+    prog.setOutput(fp);
+    EXPECT_EQ(prog.load(PutCharFile.c_str()), PS_OK);
+    EXPECT_EQ(prog.launch(), 0);
+
+    char   buf[256];
+    size_t br = 0;
+    if (fseek(fp, 0, SEEK_SET) == 0)
+        br = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    return str_t(buf, br);
+}
+
+TEST_CASE("Builtin1")
+{
+    const BuiltinModule* mod = FindBuiltinModule("std");
+    EXPECT_NE(mod, nullptr);
+    EXPECT_EQ(FindBuiltinModule("nostd"), nullptr);
+    StdModule = *mod;
+
+    // Replace std with a module that counts how often it is opened.
+    BuiltinModule counted = {"std", CountedInit, StdModule.abi};
+    RegisterBuiltinModule(counted);
+    EXPECT_EQ(FindBuiltinModule("std")->init, &CountedInit);
+
+    str_t expected;
+    for (char ch = ' '; ch <= '~'; ++ch)
+        expected.push_back(ch);
+
+    EXPECT_EQ(RunPutChar(false), expected);
+    EXPECT_EQ(InitCount, 1);
+
+    // With lazy binding it is opened by the first call.
+    EXPECT_EQ(RunPutChar(true), expected);
+    EXPECT_EQ(InitCount, 2);
+
+    RegisterBuiltinModule(StdModule);
+    EXPECT_EQ(FindBuiltinModule("std")->init, StdModule.init);
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Catch2.h"
+#include "Embed.h"
+#include "Engine.h"
+
+// Compiled from Basic/Export1.asm by the test build
+const std::string ExportFile = std::string(TestBinaryDirectory) + "/Export1";
+
+TEST_CASE("Embed1")
+{
+    size_t e;
+    for (e = 0; e < GetEngineCount(); ++e)
+    {
+        const EngineInfo& info = GetEngineInfo(e);
+        if (!info.create)
+            continue;
+
+        tvmprogram_t* prog = tvm_create();
+        EXPECT_EQ(tvm_set_engine(prog, info.name), 0);
+        EXPECT_EQ(tvm_load(prog, ExportFile.c_str()), 0);
+
+        int64_t square = tvm_find(prog, "square");
+        int64_t sum3   = tvm_find(prog, "sum3");
+        int64_t callsq = tvm_find(prog, "callsq");
+        EXPECT_GE(square, 0);
+        EXPECT_GE(sum3, 0);
+        EXPECT_GE(callsq, 0);
+        EXPECT_EQ(tvm_find(prog, "main"), -1);
+        EXPECT_EQ(tvm_find(prog, "tail"), -1);
+
+        uint64_t i;
+        for (i = 0; i < 100; ++i)
+        {
+            tvm_set_register(prog, 0, i);
+            EXPECT_EQ(tvm_call(prog, square), (int)(i * i));
+            EXPECT_EQ(tvm_get_register(prog, 0), i * i);
+        }
+
+        tvm_set_register(prog, 0, 1);
+        tvm_set_register(prog, 1, 2);
+        tvm_set_register(prog, 2, 0x100000000);
+        EXPECT_EQ(tvm_call(prog, sum3), 3);
+        EXPECT_EQ(tvm_get_register(prog, 0), 0x100000003);
+
+        // Not 9, the mov before the label is not part of the call
+        tvm_set_register(prog, 0, 5);
+        EXPECT_EQ(tvm_call(prog, callsq), 25);
+
+        EXPECT_EQ(tvm_call(prog, -1), -1);
+        EXPECT_EQ(tvm_run(prog), 0);
+        EXPECT_EQ(tvm_run(prog), 0);
+        tvm_free(prog);
+    }
+}
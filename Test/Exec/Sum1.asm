@@ -0,0 +1,22 @@
+; Sums i*i + 3i for i in [0, 300000)
+square:
+    mul  x3, x1, x1
+    ret
+
+main:
+    mov  x0, 0
+    mov  x1, 0
+    mov  x2, 300000
+top:
+    cmp  x1, x2
+    bge  done
+    bl   square
+    add  x0, x0, x3
+    mul  x4, x1, 3
+    add  x0, x0, x4
+    inc  x1
+    b    top
+done:
+    prg  x0
+    mov  x0, 0
+    ret
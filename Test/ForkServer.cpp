@@ -0,0 +1,61 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <fstream>
+#include <sstream>
+#include "Catch2.h"
+#include "ForkServer.h"
+#include "Program.h"
+
+#ifndef _WIN32
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream     fp(path);
+    std::stringstream ss;
+    ss << fp.rdbuf();
+    return ss.str();
+}
+
+TEST_CASE("ForkServer1")
+{
+    const std::string dir     = std::string(TestBinaryDirectory) + "/";
+    const std::string control = dir + "ForkServer1.ctl";
+
+    std::ofstream(control) << "- " << dir << "ForkServer1.out1\n"
+                           << "- " << dir << "ForkServer1.out2\n";
+
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    // Both runs start from the state after load.
+    Program prog(modpath);
+    EXPECT_EQ(prog.load((dir + "Snap1").c_str()), PS_OK);
+    EXPECT_EQ(RunForkServer(prog, control, false), PS_OK);
+    EXPECT_EQ(ReadFile(dir + "ForkServer1.out1"), "52\n10\n");
+    EXPECT_EQ(ReadFile(dir + "ForkServer1.out2"), "52\n10\n");
+
+    // The data table of this process is not touched by the runs.
+    EXPECT_EQ(prog.getDataTable()[0], 0);
+    EXPECT_EQ(RunForkServer(prog, dir + "missing.ctl", false), PS_ERROR);
+}
+
+#endif
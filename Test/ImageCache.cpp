@@ -0,0 +1,164 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "Catch2.h"
+#include "ImageCache.h"
+#include "Program.h"
+
+#ifndef _WIN32
+
+static str_t ReadFile(const str_t& path)
+{
+    str_t data;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp)
+    {
+        char   buf[4096];
+        size_t br;
+        while ((br = fread(buf, 1, sizeof(buf), fp)) > 0)
+            data.append(buf, br);
+        fclose(fp);
+    }
+    return data;
+}
+
+static void WriteFile(const str_t& path, const str_t& data)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    REQUIRE(fp != nullptr);
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+}
+
+// Loads image with the cache and runs it. Returns true when
+// the load came from the cache.
+static bool LoadCached(const str_t& image, bool cache = true, const char* engine = nullptr)
+{
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    FILE* output = tmpfile();
+    REQUIRE(output != nullptr);
+
+    bool cached;
+    {
+        Program prog(modpath);
+        if (engine)
+            EXPECT_EQ(prog.setEngine(engine), PS_OK);
+        if (!cache)
+            prog.setImageCache(false);
+        prog.setOutput(output);
+        EXPECT_EQ(prog.load(image.c_str()), PS_OK);
+        EXPECT_EQ(prog.launch(), 0);
+        EXPECT_EQ(prog.getDataTable()[0], 10);
+        cached = prog.isCached();
+    }
+
+    fclose(output);
+    return cached;
+}
+
+TEST_CASE("ImageCache1")
+{
+    const str_t dir   = str_t(TestBinaryDirectory) + "/";
+    const str_t image = dir + "Cache1";
+    const str_t bytes = ReadFile(dir + "Snap1");
+    REQUIRE(!bytes.empty());
+
+    const char* home    = getenv("XDG_CACHE_HOME");
+    const str_t oldHome = home ? home : "";
+    setenv("XDG_CACHE_HOME", (dir + "Cache1.d").c_str(), 1);
+    unsetenv("TVM_NO_CACHE");
+    WriteFile(image, bytes);
+
+    const uint64_t hash  = HashBytes(bytes.data(), bytes.size(), TVM_HASH_SEED);
+    const str_t    entry = GetImageCachePath(hash);
+    remove(entry.c_str());
+
+    // Turning it off neither reads nor writes it.
+    EXPECT_FALSE(LoadCached(image, false));
+    EXPECT_EQ(ReadFile(entry), "");
+
+    // It is on by default, a miss writes the entry and the next load uses it.
+    EXPECT_FALSE(LoadCached(image));
+    EXPECT_NE(ReadFile(entry), "");
+    EXPECT_TRUE(LoadCached(image));
+
+    setenv("TVM_NO_CACHE", "1", 1);
+    EXPECT_FALSE(LoadCached(image));
+    setenv("TVM_NO_CACHE", "0", 1);
+    EXPECT_TRUE(LoadCached(image));
+    unsetenv("TVM_NO_CACHE");
+
+    // A damaged header or a short file is not used and is written again.
+    str_t saved = ReadFile(entry);
+    str_t bad   = saved;
+    bad[60] ^= 0x5A;
+    WriteFile(entry, bad);
+    EXPECT_FALSE(LoadCached(image));
+    EXPECT_TRUE(LoadCached(image));
+
+    WriteFile(entry, saved.substr(0, saved.size() - 8));
+    EXPECT_FALSE(LoadCached(image));
+    EXPECT_TRUE(LoadCached(image));
+
+    CachedImage cached;
+    EXPECT_EQ(ReadImageCache(entry, hash, bytes.size(), false, cached), PS_OK);
+    EXPECT_NE(cached.code.size(), 0);
+
+#ifdef TVM_COMPUTED_GOTO
+    EXPECT_EQ(cached.source.size(), 0);
+
+    // The entry the threaded engine wrote has no source instructions,
+    // so the table engine writes it again with them. Both use that one.
+    CachedImage source;
+    EXPECT_EQ(ReadImageCache(entry, hash, bytes.size(), true, source), PS_ERROR);
+    EXPECT_FALSE(LoadCached(image, true, "table"));
+    EXPECT_TRUE(LoadCached(image, true, "table"));
+    EXPECT_TRUE(LoadCached(image, true, "threaded"));
+
+    CachedImage both;
+    EXPECT_EQ(ReadImageCache(entry, hash, bytes.size(), true, both), PS_OK);
+    EXPECT_EQ(both.source.size(), both.code.size());
+#endif
+
+    // Changing the image leaves the old entry behind.
+    str_t edited = bytes;
+    edited.push_back(0);
+    WriteFile(image, edited);
+
+    const uint64_t editedHash = HashBytes(edited.data(), edited.size(), TVM_HASH_SEED);
+    remove(GetImageCachePath(editedHash).c_str());
+
+    CachedImage other;
+    EXPECT_EQ(ReadImageCache(entry, editedHash, edited.size(), false, other), PS_ERROR);
+    EXPECT_FALSE(LoadCached(image));
+    EXPECT_TRUE(LoadCached(image));
+
+    if (home)
+        setenv("XDG_CACHE_HOME", oldHome.c_str(), 1);
+    else
+        unsetenv("XDG_CACHE_HOME");
+}
+
+#endif
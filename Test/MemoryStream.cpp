@@ -65,7 +65,7 @@ TEST_CASE("Memory2")
 
     EXPECT_EQ(544, ms.capacity());
     ms.write8('E');  // cause an expansion
-    EXPECT_EQ(816, ms.capacity());
+    EXPECT_EQ(1088, ms.capacity());
 
     char *blk = new char[547];
 
@@ -0,0 +1,18 @@
+# Runs a program that is expected to stop with a run time error.
+# tvm's exit code would fail the build, so it is recorded as the
+# last line of the output instead.
+#
+#   cmake -D TVM=<tvm> -D IMAGE=<image> -D OUTPUT=<file> -P RunError.cmake
+execute_process(
+    COMMAND ${TVM} ${IMAGE}
+    OUTPUT_VARIABLE Output
+    RESULT_VARIABLE Result
+)
+
+if (Result EQUAL 0)
+    set(Status "exited normally")
+else()
+    set(Status "stopped with an error")
+endif()
+
+file(WRITE ${OUTPUT} "${Output}${Status}\n")
@@ -0,0 +1,112 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <thread>
+#include "Catch2.h"
+#include "Program.h"
+#include "Server.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+
+TEST_CASE("Server1")
+{
+    const std::string dir = std::string(TestBinaryDirectory) + "/";
+
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    Server server(modpath, 2, 4);
+
+    ServerRequest req = {};
+    req.path          = dir + "Snap1";
+
+    // The second run reuses the program the first one loaded.
+    int i;
+    for (i = 0; i < 2; ++i)
+    {
+        ServerResponse resp = {};
+        server.execute(req, resp);
+        EXPECT_EQ(resp.status, PS_OK);
+        EXPECT_EQ(resp.exitCode, 0);
+        EXPECT_EQ(resp.output, "52\n10\n");
+        EXPECT_EQ(resp.cached, i == 1);
+    }
+
+    ServerResponse missing = {};
+    req.path               = dir + "missing";
+    server.execute(req, missing);
+    EXPECT_EQ(missing.status, PS_ERROR);
+
+    // The loader's reason comes back in the response.
+    const std::string bad = dir + "Server1.bad";
+    FILE*             fp  = fopen(bad.c_str(), "wb");
+    EXPECT_NE(fp, nullptr);
+    fputs("not an image", fp);
+    fclose(fp);
+
+    ServerResponse invalid = {};
+    req.path               = bad;
+    server.execute(req, invalid);
+    EXPECT_EQ(invalid.status, PS_ERROR);
+    EXPECT_EQ(invalid.output, "invalid file type identifier\n");
+
+    ServerResponse engine = {};
+    req.path              = dir + "Snap1";
+    req.engine            = "none";
+    server.execute(req, engine);
+    EXPECT_EQ(engine.status, PS_ERROR);
+    EXPECT_EQ(engine.output, "unknown execution engine 'none'\n");
+    req.engine.clear();
+
+    const std::string socket = dir + "Server1.sock";
+    EXPECT_EQ(server.open(socket), PS_OK);
+
+    std::thread thread(&Server::serve, &server);
+
+    // A message larger than the limit is refused before
+    // anything is allocated for it, the server keeps going.
+    int large = ConnectServer(socket);
+    EXPECT_NE(large, -1);
+
+    uint32_t head[4] = {0, TVM_SERVER_VERSION, 0xFFFFFFFF, 0x3FFFFFFF};
+    EXPECT_EQ(write(large, head, sizeof(head)), (ssize_t)sizeof(head));
+    close(large);
+
+    req.path   = dir + "Export1";
+    req.engine = "table";
+    for (i = 0; i < 4; ++i)
+    {
+        ServerResponse resp = {};
+
+        int fd = ConnectServer(socket);
+        EXPECT_NE(fd, -1);
+        EXPECT_EQ(SendRequest(fd, req, resp), PS_OK);
+        EXPECT_EQ(resp.status, PS_OK);
+        EXPECT_EQ(resp.output, "49\n369\n9\n");
+        EXPECT_EQ(resp.engine, "table");
+    }
+
+    server.stop();
+    thread.join();
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <thread>
+#include "Catch2.h"
+#include "Program.h"
+
+// Compiled from Basic/Snap1.asm by the test build
+const std::string SharedFile = std::string(TestBinaryDirectory) + "/Snap1";
+
+static void RunShared(Program* prog, FILE* output, int* exitCode)
+{
+    prog->setOutput(output);
+    *exitCode = prog->launch();
+}
+
+TEST_CASE("SharedImage1")
+{
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    Program first(modpath);
+    EXPECT_EQ(first.setEngine("table"), PS_OK);
+    EXPECT_EQ(first.load(SharedFile.c_str()), PS_OK);
+
+    // Only a shared image can be loaded.
+    Program none(modpath);
+    EXPECT_EQ(none.load(ProgramImagePtr()), PS_ERROR);
+
+    const ProgramImagePtr& image = first.share();
+    EXPECT_TRUE(image->shared);
+    EXPECT_EQ(first.share().get(), image.get());
+
+    // Every engine runs the same image at once.
+    const size_t count = GetEngineCount() * 8;
+
+    std::vector<Program*>    progs;
+    std::vector<FILE*>       outputs(count, nullptr);
+    std::vector<int>         codes(count, -1);
+    std::vector<std::thread> threads;
+
+    size_t i;
+    for (i = 0; i < count; ++i)
+    {
+        const EngineInfo& info = GetEngineInfo(i % GetEngineCount());
+
+        Program* prog = new Program(modpath);
+        if (info.create)
+            EXPECT_EQ(prog->setEngine(info.name), PS_OK);
+        EXPECT_EQ(prog->load(image), PS_OK);
+
+        // The data table is the instance's own.
+        EXPECT_NE(prog->getDataTable(), first.getDataTable());
+        EXPECT_EQ(prog->getDataTableSize(), first.getDataTableSize());
+        EXPECT_EQ(prog->findExport("checkpoint"), first.findExport("checkpoint"));
+
+        progs.push_back(prog);
+        outputs[i] = tmpfile();
+        EXPECT_NE(outputs[i], nullptr);
+    }
+
+    // The programs hold the image, they did not copy it.
+    EXPECT_EQ(image.use_count(), (long)count + 1);
+
+    for (i = 0; i < count; ++i)
+        threads.push_back(std::thread(RunShared, progs[i], outputs[i], &codes[i]));
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (i = 0; i < count; ++i)
+    {
+        char buf[32] = {};
+        rewind(outputs[i]);
+        EXPECT_EQ(fread(buf, 1, sizeof(buf) - 1, outputs[i]), 6);
+        fclose(outputs[i]);
+
+        EXPECT_EQ(std::string(buf), "52\n10\n");
+        EXPECT_EQ(codes[i], 0);
+        EXPECT_EQ(progs[i]->getDataTable()[0], 10);
+        EXPECT_EQ(progs[i]->getDataTable()[6008], 10);
+
+        // reset goes back to the image's data table.
+        progs[i]->reset();
+        EXPECT_EQ(progs[i]->getDataTable()[0], 0);
+        delete progs[i];
+    }
+
+    // None of the runs wrote to the image.
+    EXPECT_EQ(first.getDataTable()[0], 0);
+    EXPECT_EQ(first.getDataTable()[6008], 0);
+    first.setOutput(nullptr);
+    EXPECT_EQ(first.launch(), 0);
+    EXPECT_EQ(first.getDataTable()[0], 10);
+}
+
+#ifdef TVM_COMPUTED_GOTO
+TEST_CASE("SharedImage2")
+{
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    // The threaded engine runs the packed code alone,
+    // so its image does not keep the source instructions.
+    Program threaded(modpath);
+    EXPECT_EQ(threaded.setEngine("threaded"), PS_OK);
+    EXPECT_EQ(threaded.load(SharedFile.c_str()), PS_OK);
+
+    const MemoryFootprint mf = threaded.getFootprint();
+    EXPECT_GT(mf.instructions, 0);
+    EXPECT_EQ(mf.source, 0);
+    EXPECT_GT(mf.packed, 0);
+
+    const ProgramImagePtr& image = threaded.share();
+
+    Program other(modpath);
+    EXPECT_EQ(other.load(image), PS_OK);
+
+    Program table(modpath);
+    EXPECT_EQ(table.setEngine("table"), PS_OK);
+
+    FILE* fp = tmpfile();
+    EXPECT_NE(fp, nullptr);
+    table.setOutput(fp);
+    EXPECT_EQ(table.load(image), PS_ERROR);
+
+    threaded.setOutput(fp);
+    other.setOutput(fp);
+    EXPECT_EQ(threaded.launch(), 0);
+    EXPECT_EQ(other.launch(), 0);
+    fclose(fp);
+}
+#endif
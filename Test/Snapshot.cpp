@@ -0,0 +1,100 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Catch2.h"
+#include "Program.h"
+#include <string.h>
+
+// Compiled from Basic/Snap1.asm by the test build
+const std::string SnapFile  = std::string(TestBinaryDirectory) + "/Snap1";
+const std::string StateFile = std::string(TestBinaryDirectory) + "/Snap1.tvms";
+
+TEST_CASE("Snapshot1")
+{
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    size_t e;
+    for (e = 0; e < GetEngineCount(); ++e)
+    {
+        const EngineInfo& info = GetEngineInfo(e);
+        if (!info.create)
+            continue;
+
+        uint64_t  base;
+        Registers at, after;
+        {
+            Program saved(modpath);
+            EXPECT_EQ(saved.setEngine(info.name), PS_OK);
+            EXPECT_EQ(saved.load(SnapFile.c_str()), PS_OK);
+
+            uint64_t addr = saved.findExport("checkpoint");
+            EXPECT_EQ(saved.runTo(addr), PS_OK);
+            EXPECT_EQ(saved.getRegisters()[2].x, 5);
+            EXPECT_EQ(saved.saveState(StateFile), PS_OK);
+            memcpy(at, saved.getRegisters(), sizeof(Registers));
+            base = (uint64_t)(size_t)saved.getDataTable();
+
+            // The saved table's address is still in use.
+            Program busy(modpath);
+            EXPECT_EQ(busy.load(SnapFile.c_str()), PS_OK);
+            EXPECT_EQ(busy.restoreState(StateFile), PS_ERROR);
+
+            EXPECT_EQ(saved.resume(), 0);
+            memcpy(after, saved.getRegisters(), sizeof(Registers));
+        }
+
+        Program restored(modpath);
+        EXPECT_EQ(restored.setEngine(info.name), PS_OK);
+        EXPECT_EQ(restored.load(SnapFile.c_str()), PS_OK);
+        EXPECT_EQ(restored.restoreState(StateFile), PS_OK);
+
+        // The table is back at its old address, so every register is
+        // restored as it was. Labels are placed in the order the code
+        // uses them, count comes first.
+        const uint8_t*  data = restored.getDataTable();
+        const Register* regi = restored.getRegisters();
+        EXPECT_EQ((uint64_t)(size_t)data, base);
+        for (size_t i = 0; i < MAX_REG; ++i)
+            EXPECT_EQ(regi[i].x, at[i].x);
+        EXPECT_EQ(regi[1].x, (uint64_t)(size_t)data);
+        EXPECT_EQ(regi[4].x, (uint64_t)(size_t)(data + 8));
+        EXPECT_EQ(data[0], 5);
+
+        EXPECT_EQ(restored.resume(), 0);
+        EXPECT_EQ(regi[0].x, after[0].x);
+        EXPECT_EQ(regi[2].x, after[2].x);
+        EXPECT_EQ(regi[3].x, after[3].x);
+        EXPECT_EQ(regi[6].x, after[6].x);
+        EXPECT_EQ(data[0], 10);
+        EXPECT_EQ(data[6008], 10);
+
+        // reset returns to the state after load, not the snapshot.
+        restored.reset();
+        EXPECT_EQ(restored.getDataTable()[0], 0);
+        EXPECT_EQ(restored.launch(), 0);
+
+        // The snapshot only fits the image it was taken from.
+        Program other(modpath);
+        EXPECT_EQ(other.load((std::string(TestBinaryDirectory) + "/Reset1").c_str()), PS_OK);
+        EXPECT_EQ(other.restoreState(StateFile), PS_ERROR);
+    }
+}
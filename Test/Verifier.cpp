@@ -0,0 +1,51 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Catch2.h"
+#include "Program.h"
+
+// Compiled from Basic/Verify1.asm and Basic/Snap1.asm by the test build
+const std::string VerifyFile   = std::string(TestBinaryDirectory) + "/Verify1";
+const std::string VerifiedFile = std::string(TestBinaryDirectory) + "/Snap1";
+
+TEST_CASE("Verifier1")
+{
+    str_t modpath;
+    FindModuleDirectory(modpath);
+
+    // The div by zero in never fails, so the program as a whole is
+    // not verified. The stp, str, ldr and ldp in main still pass
+    // on their own, the divisions in main are lowered instead.
+    Program unverified(modpath);
+    EXPECT_EQ(unverified.load(VerifyFile.c_str()), PS_OK);
+    EXPECT_FALSE(unverified.isVerified());
+    EXPECT_EQ(unverified.getVerifiedCount(), 6);
+
+    FILE* fp = tmpfile();
+    unverified.setOutput(fp);
+    EXPECT_EQ(unverified.launch(), 0);
+    fclose(fp);
+
+    Program verified(modpath);
+    EXPECT_EQ(verified.load(VerifiedFile.c_str()), PS_OK);
+    EXPECT_TRUE(verified.isVerified());
+    EXPECT_GT(verified.getVerifiedCount(), 0);
+}
@@ -0,0 +1,331 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) 2020 Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "Program.h"
+#include "SymbolUtils.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#define close _close
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Runs each program with every engine in this build and compares
+// the output, the return code and the final registers with the
+// table engine, which is the reference. Prints the best launch
+// time of each engine and exits with 1 on any difference. With -w
+// an engine also has to be as fast as the threaded engine.
+
+struct RunResult
+{
+    bool      loaded;
+    bool      repeats;  // later launches after reset matched the first
+    int       rc;
+    str_t     output;
+    Registers regi;
+    uint64_t  data;  // data table address
+    uint64_t  dataSize;
+    double    seconds;
+};
+
+struct MatrixInfo
+{
+    int      count;
+    strvec_t files;
+    str_t    modulePath;
+    str_t    winner;
+};
+
+// How much slower than the threaded engine the -w engine may
+// be before it counts as a failure. It leaves room for noise
+// on programs that have little for it to speed up.
+const double Tolerance = 1.25;
+
+void usage(void);
+
+static bool readFile(FILE *fp, str_t &dest)
+{
+    char   buf[512];
+    size_t br;
+
+    dest.clear();
+    rewind(fp);
+    while ((br = fread(buf, 1, sizeof(buf), fp)) > 0)
+        dest.append(buf, br);
+    return ferror(fp) == 0;
+}
+
+// Launches the program with stdout redirected into a temporary file,
+// so that output from both iostream and the C runtime is captured.
+static int captureLaunch(Program &prog, str_t &output, double &seconds)
+{
+    FILE *tmp = tmpfile();
+    if (!tmp)
+    {
+        printf("failed to create a temporary file\n");
+        return -1;
+    }
+
+    cout.flush();
+    fflush(stdout);
+    int saved = dup(fileno(stdout));
+    dup2(fileno(tmp), fileno(stdout));
+
+    chrono::high_resolution_clock::time_point begin, end;
+    begin  = chrono::high_resolution_clock().now();
+    int rc = prog.launch();
+    end    = chrono::high_resolution_clock().now();
+
+    cout.flush();
+    fflush(stdout);
+    dup2(saved, fileno(stdout));
+    close(saved);
+
+    seconds = chrono::duration<double>(end - begin).count();
+    readFile(tmp, output);
+    fclose(tmp);
+    return rc;
+}
+
+static bool compareRegisters(const RunResult &ref, const RunResult &res);
+
+// The program is loaded once and reset between launches. The first
+// run is the one that is compared, the rest have to repeat it and
+// only contribute to the best time.
+static void run(const MatrixInfo &ctx, const str_t &file, const char *engine, RunResult &res)
+{
+    res.loaded  = false;
+    res.repeats = true;
+    res.seconds = 0;
+
+    Program prog(ctx.modulePath);
+    if (prog.setEngine(engine) != PS_OK || prog.load(file.c_str()) != PS_OK)
+        return;
+
+    res.loaded   = true;
+    res.data     = (uint64_t)(size_t)prog.getDataTable();
+    res.dataSize = prog.getDataTableSize();
+
+    for (int i = 0; i < ctx.count; ++i)
+    {
+        if (i > 0)
+            prog.reset();
+
+        RunResult cur = res;
+        cur.rc        = captureLaunch(prog, cur.output, cur.seconds);
+        memcpy(cur.regi, prog.getRegisters(), sizeof(Registers));
+
+        if (i == 0)
+            res = cur;
+        else
+        {
+            if (cur.rc != res.rc || cur.output != res.output || !compareRegisters(res, cur))
+                res.repeats = false;
+            if (cur.seconds < res.seconds)
+                res.seconds = cur.seconds;
+        }
+    }
+}
+
+// Each load puts the data table at a different address, so a register
+// that was loaded with adrp, and possibly had part of it overwritten,
+// cannot be compared between engines. Those are registers within 64K
+// of the data table.
+static bool isDataAddress(uint64_t v, const RunResult &res)
+{
+    const uint64_t window = 0x10000;
+    return res.data != 0 && v + window >= res.data && v <= res.data + res.dataSize + window;
+}
+
+static bool compareRegisters(const RunResult &ref, const RunResult &res)
+{
+    for (int i = 0; i < MAX_REG; ++i)
+    {
+        uint64_t a = ref.regi[i].x, b = res.regi[i].x;
+        if (a != b && !(isDataAddress(a, ref) && isDataAddress(b, res)))
+            return false;
+    }
+    return true;
+}
+
+static const char *compare(const RunResult &ref, const RunResult &res)
+{
+    if (!res.loaded)
+        return "failed to load";
+    if (!res.repeats)
+        return "differs after reset";
+    if (res.output != ref.output)
+        return "output differs";
+    if (res.rc != ref.rc)
+        return "return code differs";
+    if (!compareRegisters(ref, res))
+        return "registers differ";
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    MatrixInfo ctx = {};
+    ctx.count      = 1;
+
+    int i;
+    for (i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+            ctx.files.push_back(argv[i]);
+        else if (argv[i][1] == 'n')
+        {
+            if (i + 1 < argc)
+                ctx.count = atoi(argv[++i]);
+        }
+        else if (argv[i][1] == 'w')
+        {
+            if (i + 1 < argc)
+                ctx.winner = argv[++i];
+        }
+        else if (argv[i][1] == 'h')
+        {
+            usage();
+            return 0;
+        }
+    }
+
+    if (ctx.files.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    if (ctx.count < 1)
+        ctx.count = 1;
+
+    FindModuleDirectory(ctx.modulePath);
+
+    vector<const char *> engines;
+    bool                 hasWinner = false;
+    for (size_t e = 0; e < GetEngineCount(); ++e)
+    {
+        if (GetEngineInfo(e).create)
+        {
+            engines.push_back(GetEngineInfo(e).name);
+            if (ctx.winner == GetEngineInfo(e).name)
+                hasWinner = true;
+        }
+    }
+
+    if (!ctx.winner.empty() && !hasWinner)
+    {
+        cout << "the " << ctx.winner << " engine is not available in this build\n";
+        return 0;
+    }
+
+    cout << left << setw(16) << "program";
+    for (const char *engine : engines)
+        cout << right << setw(12) << engine;
+    cout << '\n';
+
+    strvec_t failures;
+    for (const str_t &file : ctx.files)
+    {
+        size_t sep  = file.find_last_of("/\\");
+        str_t  name = sep == str_t::npos ? file : file.substr(sep + 1);
+
+        RunResult ref;
+        run(ctx, file, "table", ref);
+        if (!ref.loaded)
+        {
+            failures.push_back(name + ": failed to load");
+            continue;
+        }
+
+        // The best times of the -w engine and the threaded engine.
+        double winner = 0, threaded = 0;
+
+        cout << left << setw(16) << name << fixed << setprecision(6);
+        for (const char *engine : engines)
+        {
+            RunResult   res;
+            const char *err = nullptr;
+            if (strcmp(engine, "table") == 0)
+            {
+                res = ref;
+                if (!res.repeats)
+                    err = "differs after reset";
+            }
+            else
+            {
+                run(ctx, file, engine, res);
+                err = compare(ref, res);
+            }
+
+            if (err)
+            {
+                failures.push_back(name + ": " + engine + ' ' + err);
+                cout << right << setw(12) << "FAIL";
+            }
+            else
+            {
+                cout << right << setw(12) << res.seconds;
+                if (ctx.winner == engine)
+                    winner = res.seconds;
+                if (strcmp(engine, "threaded") == 0)
+                    threaded = res.seconds;
+            }
+        }
+        cout << endl;
+
+        if (winner > 0 && threaded > 0 && winner > threaded * Tolerance)
+            failures.push_back(name + ": " + ctx.winner + " is slower than threaded");
+    }
+
+    strvec_t::const_iterator it;
+    for (it = failures.begin(); it != failures.end(); ++it)
+        cout << "mismatch " << *it << '\n';
+
+    cout << ctx.files.size() << " programs, " << engines.size() << " engines, ";
+    cout << failures.size() << " failures" << endl;
+    return failures.empty() ? 0 : 1;
+}
+
+void usage(void)
+{
+    cout << "tvmmatrix <options> <program_path> ...\n\n";
+    cout << "    options:\n\n";
+    cout << "        -h display this message.\n";
+    cout << "        -n <count> launch each program count times and report the best time.\n";
+    cout << "           The program is reset between launches and each launch has to\n";
+    cout << "           match the first.\n";
+    cout << "        -w <engine> also fail when engine takes more than 25% longer\n";
+    cout << "           than the threaded engine on a program.\n";
+    cout << "\n";
+}